@@ -0,0 +1,149 @@
+/*
+ *  The code in this file is part of tcptrack. For more information see
+ *    http://www.rhythm.cx/~steve/devel/tcptrack
+ *
+ *     Copyright (C) Steve Benson - 2003
+ *
+ *  tcptrack is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your
+ *  option) any later version.
+ *
+ *  tcptrack is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GNU Make; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#include "../config.h"
+#include <stdio.h>
+#include "../src/BatchParse.h"
+#include "../src/LinkLayer.h"
+#include "../src/util.h"
+#include "bench.h"
+
+/* batchparse times parse_batch() over the capture, PB_BATCH packets at a
+ * time as the parse workers call it, with each instruction set this CPU
+ * has: plain C, SSSE3 and AVX2. The packets are copied into struct nlps
+ * first, as the capture threads do. Every instruction set has to fill in
+ * the same fields as the plain C version, or it is reported as wrong.
+ */
+
+// the packets, and what parse_batch() makes of them.
+static std::vector<struct nlp *> pkts;
+static std::vector<struct pktfields> fields;
+
+static uint64_t pass()
+{
+	uint64_t valid = 0;
+	for( size_t i=0; i < pkts.size(); i += PB_BATCH )
+	{
+		unsigned int n = pkts.size() - i;
+		if( n > PB_BATCH )
+			n = PB_BATCH;
+		valid += parse_batch(&pkts[i], n, &fields[i]);
+	}
+	return valid;
+}
+
+// everything but the padding.
+static bool same( const struct pktfields &a, const struct pktfields &b )
+{
+	if( a.version != b.version )
+		return false;
+	if( a.version == 0 )
+		return true;
+	return a.sport == b.sport && a.dport == b.dport && a.seq == b.seq
+		&& a.ack == b.ack && a.tcpoff == b.tcpoff && a.flags == b.flags
+		&& a.total_len == b.total_len && a.iphl == b.iphl;
+}
+
+// times BENCH_RUNS passes with isa and reports the fastest, then checks
+// the fields against ref, if there is one.
+static bool run( const char *isa, std::vector<struct pktfields> *ref )
+{
+	char what[64];
+	snprintf(what, sizeof(what), "parse_batch %s", isa);
+	if( ! parse_batch_use(isa) )
+	{
+		printf("%-28s not on this CPU\n", what);
+		return true;
+	}
+
+	uint64_t best = 0, valid = 0;
+	for( int i=0; i < BENCH_RUNS; i++ )
+	{
+		uint64_t t = bench_now();
+		valid = pass();
+		t = bench_now() - t;
+		if( best == 0 || t < best )
+			best = t;
+	}
+	bench_report(what, pkts.size(), best, 0);
+
+	if( valid != pkts.size() )
+	{
+		fprintf(stderr, "%s: only %llu of %llu packets valid\n", isa,
+				(unsigned long long)valid,
+				(unsigned long long)pkts.size());
+		return false;
+	}
+	if( ref == NULL )
+		return true;
+	for( size_t i=0; i < pkts.size(); i++ )
+	{
+		if( ! same(fields[i], (*ref)[i]) )
+		{
+			fprintf(stderr, "%s: packet %llu parsed differently\n",
+					isa, (unsigned long long)i);
+			return false;
+		}
+	}
+	return true;
+}
+
+int main( int argc, char **argv )
+{
+	if( argc != 2 )
+	{
+		fprintf(stderr, "Usage: %s <pcap file>\n", argv[0]);
+		return 1;
+	}
+
+	CapFile cf;
+	std::vector<struct benchpkt> raw;
+	if( ! bench_load(cf, argv[1], raw) )
+		return 1;
+
+	// only packets that passed check_nl() are queued, cut to SNAPLEN.
+	for( size_t i=0; i < raw.size(); i++ )
+	{
+		int off = nl_offset(raw[i].data, cf.linktype(), raw[i].h.caplen);
+		if( off < 0 )
+			continue;
+		unsigned int len = raw[i].h.caplen - off;
+		if( ! check_nl(raw[i].data+off, len) )
+			continue;
+		if( len > SNAPLEN )
+			len = SNAPLEN;
+		struct nlp *n = copynlp(raw[i].data+off, len, raw[i].h.ts);
+		if( n == NULL )
+			return 1;
+		pkts.push_back(n);
+	}
+	fields.resize(pkts.size());
+
+	if( ! run("scalar", NULL) )
+		return 1;
+	std::vector<struct pktfields> ref = fields;
+	if( ! run("ssse3", &ref) || ! run("avx2", &ref) )
+		return 1;
+
+	for( size_t i=0; i < pkts.size(); i++ )
+		nlp_free(pkts[i]);
+	return 0;
+}
@@ -0,0 +1,85 @@
+/*
+ *  The code in this file is part of tcptrack. For more information see
+ *    http://www.rhythm.cx/~steve/devel/tcptrack
+ *
+ *     Copyright (C) Steve Benson - 2003
+ *
+ *  tcptrack is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your
+ *  option) any later version.
+ *
+ *  tcptrack is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GNU Make; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#ifndef BENCH_H
+#define BENCH_H 1
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <vector>
+#include "../src/CapFile.h"
+
+/* Helpers shared by the programs make bench runs. Each one times a part
+ * of tcptrack over traffic made by tcptrack-gen and prints a line per
+ * variant timed with bench_report().
+ */
+
+// how many times each variant is timed. The fastest run is reported.
+#define BENCH_RUNS 5
+
+// monotonic time in nanoseconds.
+static inline uint64_t bench_now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000000 + ts.tv_nsec;
+}
+
+// prints how long n items (of bytes bytes in all, if not 0) took.
+static inline void bench_report( const char *what, uint64_t n, uint64_t ns,
+		uint64_t bytes )
+{
+	if( ns == 0 )
+		ns = 1;
+	printf("%-28s %10llu %9.2f ns %9.2f M/s", what, (unsigned long long)n,
+			(double)ns / (n ? n : 1), n * 1e3 / ns);
+	if( bytes )
+		printf(" %8.2f GB/s", (double)bytes / ns);
+	printf("\n");
+}
+
+// a packet of the capture being benchmarked.
+struct benchpkt
+{
+	struct pcap_pkthdr h;
+	const u_char *data; // points into the CapFile's mapping
+};
+
+// reads every packet of the capture at path into pkts, or prints why it
+// can't and returns false. The packets stay valid as long as cf does.
+static inline bool bench_load( CapFile &cf, const char *path,
+		std::vector<struct benchpkt> &pkts )
+{
+	char errbuf[PCAP_ERRBUF_SIZE];
+	if( ! cf.open(path, errbuf) )
+	{
+		fprintf(stderr, "%s\n", errbuf);
+		return false;
+	}
+
+	struct benchpkt b;
+	while( cf.next(&b.h, &b.data) )
+		pkts.push_back(b);
+	return true;
+}
+
+#endif
@@ -0,0 +1,121 @@
+/*
+ *  The code in this file is part of tcptrack. For more information see
+ *    http://www.rhythm.cx/~steve/devel/tcptrack
+ *
+ *     Copyright (C) Steve Benson - 2003
+ *
+ *  tcptrack is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your
+ *  option) any later version.
+ *
+ *  tcptrack is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GNU Make; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#include "../config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/CapFile.h"
+#include "bench.h"
+
+/* capfile times reading a capture file with CapFile, the way -T reads
+ * it, against libpcap's pcap_next_ex() on the same file. Each pass goes
+ * through every packet and reads its first and last byte, so neither
+ * reader gets away without touching the data. The file is read once
+ * before timing so both find it in the page cache.
+ */
+
+// not static, so what is added up in it is never optimized away.
+uint64_t sum;
+
+static bool pass_capfile( const char *path, uint64_t *n, uint64_t *bytes )
+{
+	char errbuf[PCAP_ERRBUF_SIZE];
+	CapFile cf;
+	if( ! cf.open(path, errbuf) )
+	{
+		fprintf(stderr, "%s\n", errbuf);
+		return false;
+	}
+
+	struct pcap_pkthdr h;
+	const u_char *data;
+	*n = *bytes = 0;
+	while( cf.next(&h, &data) )
+	{
+		if( h.caplen )
+			sum += data[0] + data[h.caplen-1];
+		(*n)++;
+		*bytes += h.caplen;
+	}
+	return true;
+}
+
+static bool pass_pcap( const char *path, uint64_t *n, uint64_t *bytes )
+{
+	char errbuf[PCAP_ERRBUF_SIZE];
+	pcap_t *p = pcap_open_offline(path, errbuf);
+	if( p == NULL )
+	{
+		fprintf(stderr, "pcap_open_offline: %s\n", errbuf);
+		return false;
+	}
+
+	struct pcap_pkthdr *h;
+	const u_char *data;
+	*n = *bytes = 0;
+	while( pcap_next_ex(p, &h, &data) == 1 )
+	{
+		if( h->caplen )
+			sum += data[0] + data[h->caplen-1];
+		(*n)++;
+		*bytes += h->caplen;
+	}
+	pcap_close(p);
+	return true;
+}
+
+// times BENCH_RUNS passes of pass over path and reports the fastest.
+static bool run( const char *what, const char *path,
+		bool (*pass)( const char *, uint64_t *, uint64_t * ) )
+{
+	uint64_t n, bytes, best = 0;
+	for( int i=0; i < BENCH_RUNS; i++ )
+	{
+		uint64_t t = bench_now();
+		if( ! pass(path, &n, &bytes) )
+			return false;
+		t = bench_now() - t;
+		if( best == 0 || t < best )
+			best = t;
+	}
+	bench_report(what, n, best, bytes);
+	return true;
+}
+
+int main( int argc, char **argv )
+{
+	if( argc != 2 )
+	{
+		fprintf(stderr, "Usage: %s <pcap file>\n", argv[0]);
+		return 1;
+	}
+
+	uint64_t n, bytes;
+	if( ! pass_capfile(argv[1], &n, &bytes) )
+		return 1;
+
+	if( ! run("CapFile::next", argv[1], pass_capfile) )
+		return 1;
+	if( ! run("pcap_next_ex", argv[1], pass_pcap) )
+		return 1;
+
+	return 0;
+}
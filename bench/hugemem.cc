@@ -0,0 +1,190 @@
+/*
+ *  The code in this file is part of tcptrack. For more information see
+ *    http://www.rhythm.cx/~steve/devel/tcptrack
+ *
+ *     Copyright (C) Steve Benson - 2003
+ *
+ *  tcptrack is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your
+ *  option) any later version.
+ *
+ *  tcptrack is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GNU Make; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#include "../config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include "../src/HugeMem.h"
+#include "../src/LinkLayer.h"
+#include "../src/TCPConnection.h"
+#include "../src/util.h"
+#include "bench.h"
+
+/* hugemem times what -H changes, with and without it. Without -H,
+ * SlabPool and huge_alloc() fall through to malloc() and free().
+ *
+ * Packet buffers: every packet of the capture is copied into a struct nlp
+ * as the capture threads do it, and freed BENCH_INFLIGHT packets later,
+ * as if that many sat in the packet queues.
+ *
+ * Connections: a block the size of a TCPConnection is allocated for
+ * every connection in the capture, and each packet adds to its
+ * connection's counters, in capture order.
+ */
+
+// how many packets are held before the oldest is freed.
+#define BENCH_INFLIGHT 4096
+
+// not static, so what is added up in it is never optimized away.
+uint64_t sum;
+
+// the network layer part of each packet kept, as the capture threads
+// would copy it, and which connection it belongs to.
+struct nlpkt
+{
+	const u_char *p;
+	unsigned int len;
+	struct timeval ts;
+	unsigned int conn;
+};
+
+static std::vector<struct nlpkt> pkts;
+static unsigned int nconns;
+
+// connections come out of one pool, as in TCPConnection.cc, so with -H
+// only the first pass maps memory for them.
+static SlabPool connpool( sizeof(TCPConnection) );
+
+static void pass_nlp()
+{
+	static struct nlp *held[BENCH_INFLIGHT];
+	unsigned int next = 0;
+	memset(held, 0, sizeof(held));
+
+	for( size_t i=0; i < pkts.size(); i++ )
+	{
+		struct nlp *n = copynlp(pkts[i].p, pkts[i].len, pkts[i].ts);
+		if( n == NULL )
+			abort();
+		if( held[next] != NULL )
+		{
+			sum += held[next]->len;
+			nlp_free(held[next]);
+		}
+		held[next] = n;
+		next = (next+1) % BENCH_INFLIGHT;
+	}
+	for( unsigned int i=0; i < BENCH_INFLIGHT; i++ )
+		if( held[i] != NULL )
+			nlp_free(held[i]);
+}
+
+static void pass_conns()
+{
+	std::vector<uint64_t *> conns(nconns);
+	for( unsigned int i=0; i < nconns; i++ )
+	{
+		conns[i] = (uint64_t *) connpool.alloc();
+		if( conns[i] == NULL )
+			abort();
+		memset(conns[i], 0, sizeof(TCPConnection));
+	}
+
+	// a counter at each end of the object, as a connection's byte
+	// counts and timestamps are spread over it.
+	const unsigned int last = sizeof(TCPConnection)/sizeof(uint64_t) - 1;
+	for( size_t i=0; i < pkts.size(); i++ )
+	{
+		uint64_t *c = conns[pkts[i].conn];
+		c[0] += pkts[i].len;
+		c[last]++;
+	}
+
+	for( unsigned int i=0; i < nconns; i++ )
+	{
+		sum += conns[i][0];
+		connpool.free(conns[i]);
+	}
+}
+
+// times BENCH_RUNS passes of pass and reports the fastest.
+static void run( const char *what, void (*pass)() )
+{
+	uint64_t best = 0;
+	for( int i=0; i < BENCH_RUNS; i++ )
+	{
+		uint64_t t = bench_now();
+		pass();
+		t = bench_now() - t;
+		if( best == 0 || t < best )
+			best = t;
+	}
+	bench_report(what, pkts.size(), best, 0);
+}
+
+int main( int argc, char **argv )
+{
+	if( argc != 2 )
+	{
+		fprintf(stderr, "Usage: %s <pcap file>\n", argv[0]);
+		return 1;
+	}
+
+	CapFile cf;
+	std::vector<struct benchpkt> raw;
+	if( ! bench_load(cf, argv[1], raw) )
+		return 1;
+
+	std::map<uint32_t, unsigned int> conns;
+	for( size_t i=0; i < raw.size(); i++ )
+	{
+		int off = nl_offset(raw[i].data, cf.linktype(), raw[i].h.caplen);
+		if( off < 0 )
+			continue;
+		struct nlpkt k;
+		k.p = raw[i].data + off;
+		k.len = raw[i].h.caplen - off;
+		if( ! check_nl(k.p, k.len) )
+			continue;
+		if( k.len > SNAPLEN )
+			k.len = SNAPLEN;
+		k.ts = raw[i].h.ts;
+		std::map<uint32_t, unsigned int>::iterator c =
+			conns.insert(std::make_pair(flow_hash(k.p),
+				(unsigned int)conns.size())).first;
+		k.conn = c->second;
+		pkts.push_back(k);
+	}
+	nconns = conns.size();
+
+	for( int h=0; h < 2; h++ )
+	{
+		huge_setup(h);
+		const char *mode = h ? "-H" : "malloc";
+		char what[64];
+
+		snprintf(what, sizeof(what), "nlp alloc/free %s", mode);
+		run(what, pass_nlp);
+
+		snprintf(what, sizeof(what), "connections %s", mode);
+		run(what, pass_conns);
+	}
+
+	struct hugestats hs = huge_stats();
+	printf("-H mapped %llu MB in huge pages, %llu MB with THP advice, "
+			"%llu MB plain\n",
+			(unsigned long long)hs.hugetlb >> 20,
+			(unsigned long long)hs.thp >> 20,
+			(unsigned long long)hs.plain >> 20);
+	return 0;
+}
@@ -0,0 +1,228 @@
+/*
+ *  The code in this file is part of tcptrack. For more information see
+ *    http://www.rhythm.cx/~steve/devel/tcptrack
+ *
+ *     Copyright (C) Steve Benson - 2003
+ *
+ *  tcptrack is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your
+ *  option) any later version.
+ *
+ *  tcptrack is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GNU Make; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#include "../config.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include "../src/LinkLayer.h"
+#include "../src/util.h"
+#include "bench.h"
+
+/* linklayer times finding and checking the network layer header of every
+ * packet in the capture, for each link type tcptrack reads. tcptrack-gen
+ * only writes Ethernet, so each packet is rewritten with the other link
+ * headers first. Each link type is timed three ways:
+ *
+ *   nl_offset    the switch on the link type at run time
+ *   link_offset  the parser specialized for the link type, which is what
+ *                the capture callbacks use
+ *   decap_link   the table driven parser -D uses, allowed one tunnel
+ *
+ * Every variant then runs check_nl() on what it found, as the capture
+ * callbacks do.
+ */
+
+// only this much of each packet is kept. It is plenty for the headers.
+#define BENCH_HEADROOM 128
+
+// not static, so what is added up in it is never optimized away.
+uint64_t sum;
+
+// the same packets, rewritten for one link type.
+struct linkpkts
+{
+	std::vector<u_char> buf; // BENCH_HEADROOM bytes per packet
+	std::vector<unsigned int> caplen;
+};
+
+// the kinds of rewriting: the link type and whether a VLAN tag is added.
+enum linkkind { LK_EN10MB, LK_VLAN, LK_SLL, LK_RAW, LK_NULL };
+
+// rewrite an Ethernet frame e, len bytes, with the link header of kind k
+// into out. Returns the new length.
+static unsigned int relink( const u_char *e, unsigned int len,
+		enum linkkind k, u_char *out )
+{
+	const struct sniff_ethernet *eth = (const struct sniff_ethernet *) e;
+	const u_char *ip = e + ENET_HEADER_LEN;
+	unsigned int iplen = len - ENET_HEADER_LEN;
+	unsigned int hl = 0;
+
+	switch( k )
+	{
+	case LK_EN10MB:
+		hl = ENET_HEADER_LEN;
+		memcpy(out, e, hl);
+		break;
+	case LK_VLAN:
+		hl = ENET_HEADER_LEN + VLAN_HEADER_LEN;
+		memcpy(out, e, 2*ETHER_ADDR_LEN);
+		out[12] = ETHERTYPE_VLAN >> 8;
+		out[13] = ETHERTYPE_VLAN & 0xff;
+		out[14] = 0;
+		out[15] = 42;
+		memcpy(out+16, &eth->ether_type, 2);
+		break;
+	case LK_SLL:
+		// packet type, address type and length, the address, then the
+		// protocol.
+		hl = SLL_HEADER_LEN;
+		memset(out, 0, hl);
+		out[3] = 1;
+		out[5] = ETHER_ADDR_LEN;
+		memcpy(out+6, eth->ether_shost, ETHER_ADDR_LEN);
+		memcpy(out+14, &eth->ether_type, 2);
+		break;
+	case LK_RAW:
+		break;
+	case LK_NULL:
+		{
+			// the address family, in the byte order of the host that
+			// captured it.
+			uint32_t af = (ip[0] >> 4) == 6 ? AF_INET6 : AF_INET;
+			hl = NULL_HEADER_LEN;
+			memcpy(out, &af, hl);
+		}
+		break;
+	}
+
+	if( hl + iplen > BENCH_HEADROOM )
+		iplen = BENCH_HEADROOM - hl;
+	memcpy(out+hl, ip, iplen);
+	return hl + iplen;
+}
+
+static void build( const std::vector<struct benchpkt> &raw, enum linkkind k,
+		struct linkpkts &lp )
+{
+	lp.buf.resize(raw.size() * BENCH_HEADROOM);
+	lp.caplen.clear();
+	for( size_t i=0; i < raw.size(); i++ )
+	{
+		if( raw[i].h.caplen < ENET_HEADER_LEN )
+			continue;
+		u_char *out = &lp.buf[lp.caplen.size() * BENCH_HEADROOM];
+		lp.caplen.push_back(relink(raw[i].data, raw[i].h.caplen, k, out));
+	}
+}
+
+template <int DLT> static int by_switch( const u_char *p, unsigned int caplen )
+{
+	return nl_offset(p, DLT, caplen);
+}
+
+template <int DLT> static int by_decap( const u_char *p, unsigned int caplen )
+{
+	return decap_link<DLT>(p, caplen, 1);
+}
+
+// one pass over the packets, finding their headers with find. Returns
+// how many are usable TCP packets.
+template <int (*find)( const u_char *, unsigned int )>
+static uint64_t pass( const struct linkpkts &lp )
+{
+	uint64_t ok = 0;
+	for( size_t i=0; i < lp.caplen.size(); i++ )
+	{
+		const u_char *p = &lp.buf[i * BENCH_HEADROOM];
+		int off = find(p, lp.caplen[i]);
+		if( off < 0 || ! check_nl(p+off, lp.caplen[i]-off) )
+			continue;
+		sum += off;
+		ok++;
+	}
+	return ok;
+}
+
+// times BENCH_RUNS passes and reports the fastest. Every packet has to be
+// found usable, or the parser is wrong.
+template <int (*find)( const u_char *, unsigned int )>
+static bool run( const char *link, const char *how,
+		const struct linkpkts &lp, uint64_t usable )
+{
+	uint64_t best = 0;
+	for( int i=0; i < BENCH_RUNS; i++ )
+	{
+		uint64_t t = bench_now();
+		uint64_t ok = pass<find>(lp);
+		t = bench_now() - t;
+		if( ok != usable )
+		{
+			fprintf(stderr, "%s %s: %llu of %llu packets usable\n",
+					link, how, (unsigned long long)ok,
+					(unsigned long long)usable);
+			return false;
+		}
+		if( best == 0 || t < best )
+			best = t;
+	}
+
+	char what[64];
+	snprintf(what, sizeof(what), "%s %s", link, how);
+	bench_report(what, lp.caplen.size(), best, 0);
+	return true;
+}
+
+template <int DLT>
+static bool run_link( const char *link, const struct linkpkts &lp,
+		uint64_t usable )
+{
+	return run< by_switch<DLT> >(link, "nl_offset", lp, usable)
+		&& run< link_offset<DLT> >(link, "link_offset", lp, usable)
+		&& run< by_decap<DLT> >(link, "decap_link", lp, usable);
+}
+
+int main( int argc, char **argv )
+{
+	if( argc != 2 )
+	{
+		fprintf(stderr, "Usage: %s <pcap file>\n", argv[0]);
+		return 1;
+	}
+
+	CapFile cf;
+	std::vector<struct benchpkt> raw;
+	if( ! bench_load(cf, argv[1], raw) )
+		return 1;
+	if( cf.linktype() != DLT_EN10MB )
+	{
+		fprintf(stderr, "%s: not an Ethernet capture\n", argv[1]);
+		return 1;
+	}
+
+	// what the plain Ethernet parser makes of them is the reference.
+	struct linkpkts lp;
+	build(raw, LK_EN10MB, lp);
+	uint64_t usable = pass< link_offset<DLT_EN10MB> >(lp);
+
+	bool ok = run_link<DLT_EN10MB>("EN10MB", lp, usable);
+	build(raw, LK_VLAN, lp);
+	ok = ok && run_link<DLT_EN10MB>("EN10MB+VLAN", lp, usable);
+	build(raw, LK_SLL, lp);
+	ok = ok && run_link<DLT_LINUX_SLL>("LINUX_SLL", lp, usable);
+	build(raw, LK_RAW, lp);
+	ok = ok && run_link<DLT_RAW>("RAW", lp, usable);
+	build(raw, LK_NULL, lp);
+	ok = ok && run_link<DLT_NULL>("NULL", lp, usable);
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,135 @@
+/*
+ *  The code in this file is part of tcptrack. For more information see
+ *    http://www.rhythm.cx/~steve/devel/tcptrack
+ *
+ *     Copyright (C) Steve Benson - 2003
+ *
+ *  tcptrack is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your
+ *  option) any later version.
+ *
+ *  tcptrack is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GNU Make; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#include "../config.h"
+#include <stdio.h>
+#include <string.h>
+#include "../src/LinkLayer.h"
+#include "../src/Sampler.h"
+#include "../src/util.h"
+#include "bench.h"
+
+/* sampler times what every captured packet costs before it is copied:
+ * flow_hash() on its own, which -S and sharding between capture threads
+ * use, and Sampler::weigh() with sampling off, with -s, with -S and with
+ * both. The headers are copied out of the capture first, as a capture
+ * thread has the packet it is looking at in cache. For each rate it also
+ * prints how many packets were kept and how many they stand for: with -s
+ * that should come close to all of them, with -S to 1 in BENCH_RATE.
+ */
+
+// the rate each kind of sampling is timed at.
+#define BENCH_RATE 10
+
+// not static, so what is added up in it is never optimized away.
+uint64_t sum;
+
+// room for the IP and TCP headers of one packet.
+#define BENCH_SLOT 64
+
+// the network layer header of each usable packet, one per slot.
+static std::vector<u_char> slots;
+static std::vector<const u_char *> pkts;
+
+static uint64_t kept, weight;
+
+static void pass_hash( Sampler & )
+{
+	for( size_t i=0; i < pkts.size(); i++ )
+		sum += flow_hash(pkts[i]);
+}
+
+static void pass_weigh( Sampler &s )
+{
+	uint32_t rng = Sampler::seed(0);
+	kept = weight = 0;
+	for( size_t i=0; i < pkts.size(); i++ )
+	{
+		unsigned int w = s.weigh(pkts[i], rng);
+		if( w == 0 )
+			continue;
+		kept++;
+		weight += w;
+	}
+}
+
+// times BENCH_RUNS passes and reports the fastest.
+static void run( const char *what, Sampler &s, void (*pass)( Sampler & ) )
+{
+	uint64_t best = 0;
+	for( int i=0; i < BENCH_RUNS; i++ )
+	{
+		uint64_t t = bench_now();
+		pass(s);
+		t = bench_now() - t;
+		if( best == 0 || t < best )
+			best = t;
+	}
+	bench_report(what, pkts.size(), best, 0);
+}
+
+static void run_weigh( const char *what, unsigned int prate,
+		unsigned int frate )
+{
+	Sampler s;
+	s.packets(prate);
+	s.flows(frate);
+	run(what, s, pass_weigh);
+	printf("%28s kept %llu, standing for %llu\n", "",
+			(unsigned long long)kept, (unsigned long long)weight);
+}
+
+int main( int argc, char **argv )
+{
+	if( argc != 2 )
+	{
+		fprintf(stderr, "Usage: %s <pcap file>\n", argv[0]);
+		return 1;
+	}
+
+	CapFile cf;
+	std::vector<struct benchpkt> raw;
+	if( ! bench_load(cf, argv[1], raw) )
+		return 1;
+
+	// weigh() is only handed packets that passed check_nl().
+	slots.resize(raw.size() * BENCH_SLOT);
+	for( size_t i=0; i < raw.size(); i++ )
+	{
+		int off = nl_offset(raw[i].data, cf.linktype(), raw[i].h.caplen);
+		if( off < 0 )
+			continue;
+		unsigned int len = raw[i].h.caplen - off;
+		if( ! check_nl(raw[i].data+off, len) )
+			continue;
+		u_char *slot = &slots[pkts.size() * BENCH_SLOT];
+		memcpy(slot, raw[i].data+off, len < BENCH_SLOT ? len : BENCH_SLOT);
+		pkts.push_back(slot);
+	}
+
+	Sampler none;
+	run("flow_hash", none, pass_hash);
+	run_weigh("weigh", 1, 1);
+	run_weigh("weigh -s 10", BENCH_RATE, 1);
+	run_weigh("weigh -S 10", 1, BENCH_RATE);
+	run_weigh("weigh -s 10 -S 10", BENCH_RATE, BENCH_RATE);
+	return 0;
+}
@@ -0,0 +1,164 @@
+/*
+ *  The code in this file is part of tcptrack. For more information see
+ *    http://www.rhythm.cx/~steve/devel/tcptrack
+ *
+ *     Copyright (C) Steve Benson - 2003
+ *
+ *  tcptrack is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your
+ *  option) any later version.
+ *
+ *  tcptrack is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GNU Make; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#define _GNU_SOURCE 1
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/syscall.h>
+#include "Affinity.h"
+
+static const char *stage_names[AFF_NSTAGES] =
+	{ "capture", "buffer", "maint", "ui", "names", "collector",
+	  "parse" };
+
+Affinity::Affinity()
+{
+	memnode=-1;
+}
+
+const char * Affinity::stageName( int stage )
+{
+	return stage_names[stage];
+}
+
+bool Affinity::set( const char *s )
+{
+	const char *eq = strchr(s,'=');
+	if( eq == NULL )
+		return false;
+
+	int stage;
+	for( stage=0; stage<AFF_NSTAGES; stage++ )
+		if( strlen(stage_names[stage]) == (size_t)(eq-s)
+				&& strncmp(s, stage_names[stage], eq-s) == 0 )
+			break;
+	if( stage == AFF_NSTAGES )
+		return false;
+
+	long ncpus = sysconf(_SC_NPROCESSORS_CONF);
+	std::vector<int> l;
+
+	// a comma separated list of CPUs and ranges of CPUs.
+	const char *p = eq+1;
+	while( *p )
+	{
+		char *end;
+		long first = strtol(p, &end, 10);
+		if( end == p || first < 0 )
+			return false;
+		long last = first;
+		p = end;
+		if( *p == '-' )
+		{
+			last = strtol(p+1, &end, 10);
+			if( end == p+1 || last < first )
+				return false;
+			p = end;
+		}
+		if( last >= ncpus )
+			return false;
+		for( long c=first; c<=last; c++ )
+			l.push_back(c);
+
+		if( *p == ',' )
+			++p;
+		else if( *p != 0 )
+			return false;
+	}
+	if( l.empty() )
+		return false;
+
+	cpulist[stage] = l;
+	spec[stage] = eq+1;
+	return true;
+}
+
+void Affinity::apply( int stage )
+{
+#ifdef CPU_SETSIZE
+	if( cpulist[stage].empty() )
+		return;
+
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for( unsigned int i=0; i<cpulist[stage].size(); i++ )
+		CPU_SET(cpulist[stage][i], &set);
+
+	// if this fails the thread just runs wherever it is allowed to.
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
+
+std::string Affinity::cpus( int stage )
+{
+	if( cpulist[stage].empty() )
+		return "any";
+	return spec[stage];
+}
+
+int Affinity::node( int stage )
+{
+	if( cpulist[stage].empty() )
+		return -1;
+
+	// /sys/devices/system/cpu/cpuN has a nodeM link for its node.
+	char path[64];
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpulist[stage][0]);
+	DIR *d = opendir(path);
+	if( d == NULL )
+		return -1;
+
+	int n = -1;
+	struct dirent *e;
+	while( (e = readdir(d)) != NULL )
+	{
+		if( strncmp(e->d_name, "node", 4) == 0 && e->d_name[4] >= '0' && e->d_name[4] <= '9' )
+		{
+			n = atoi(e->d_name+4);
+			break;
+		}
+	}
+	closedir(d);
+	return n;
+}
+
+// from linux/mempolicy.h
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+
+void Affinity::placeMemory()
+{
+#ifdef SYS_set_mempolicy
+	int n = node(AFF_CAPTURE);
+	if( n < 0 || n >= (int)(8*sizeof(unsigned long)) )
+		return;
+
+	unsigned long mask = 1UL << n;
+	if( syscall(SYS_set_mempolicy, MPOL_PREFERRED, &mask, 8*sizeof(mask)) == 0 )
+		memnode = n;
+#endif
+}
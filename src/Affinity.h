@@ -0,0 +1,79 @@
+/*
+ *  The code in this file is part of tcptrack. For more information see
+ *    http://www.rhythm.cx/~steve/devel/tcptrack
+ *
+ *     Copyright (C) Steve Benson - 2003
+ *
+ *  tcptrack is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your
+ *  option) any later version.
+ *
+ *  tcptrack is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GNU Make; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#ifndef AFFINITY_H
+#define AFFINITY_H 1
+
+#include <string>
+#include <vector>
+
+// the pipeline stages that can be pinned to CPUs.
+#define AFF_CAPTURE 0   // Sniffer (and everything, in single-threaded mode)
+#define AFF_BUFFER 1    // PacketBuffer
+#define AFF_MAINT 2     // TCContainer maintenance
+#define AFF_UI 3        // TextUI
+#define AFF_NAMES 4     // name lookups
+#define AFF_COLLECTOR 5 // Collector
+#define AFF_PARSE 6     // PacketBuffer parse workers, all on the same CPUs
+#define AFF_NSTAGES 7
+
+/* Affinity keeps the CPUs each pipeline stage should run on, as given with
+ * -A stage=cpus, and pins threads to them. Each thread calls apply() for
+ * its own stage when it starts. Stages that weren't given run anywhere.
+ *
+ * On Linux memory is placed on the NUMA node of the thread that first
+ * touches it. To keep the connection table and packet buffers next to the
+ * capture thread, placeMemory() also asks for memory to come from its
+ * node.
+ */
+class Affinity
+{
+public:
+	Affinity();
+
+	// parse a "stage=cpulist" spec, e.g. "capture=2" or "names=4-7,12".
+	// returns false if it doesn't make sense.
+	bool set( const char *spec );
+
+	// pin the calling thread to the CPUs given for stage, if any.
+	void apply( int stage );
+
+	// prefer the capture stage's NUMA node for memory allocated by this
+	// thread and threads it starts from now on.
+	void placeMemory();
+
+	// for the statistics view.
+	static const char * stageName( int stage );
+	// the CPU list as given, or "any".
+	std::string cpus( int stage );
+	// the NUMA node of the stage's first CPU, or -1 if not pinned or
+	// unknown.
+	int node( int stage );
+	// the node memory is preferred on, or -1.
+	int memNode() { return memnode; }
+
+private:
+	std::vector<int> cpulist[AFF_NSTAGES];
+	std::string spec[AFF_NSTAGES];
+	int memnode;
+};
+
+#endif
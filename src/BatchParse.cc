@@ -0,0 +1,311 @@
+/*
+ *  The code in this file is part of tcptrack. For more information see
+ *    http://www.rhythm.cx/~steve/devel/tcptrack
+ *
+ *     Copyright (C) Steve Benson - 2003
+ *
+ *  tcptrack is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your
+ *  option) any later version.
+ *
+ *  tcptrack is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GNU Make; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#include "../config.h"
+#include <string.h>
+#include <assert.h>
+#include <netinet/in.h>
+#include "BatchParse.h"
+#include "headers.h"
+#include "defs.h"
+#include "util.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BP_X86 1
+#include <immintrin.h>
+#endif
+
+// a batch, byte by byte in columns, so the checks can run over many
+// packets at once.
+struct bpcols
+{
+	uint8_t verihl[PB_BATCH]; // version and IHL, or 0 if too short
+	uint8_t proto[PB_BATCH];
+	uint8_t tcpoff[PB_BATCH]; // data offset byte of the TCP header
+	uint8_t valid[PB_BATCH];  // 0xff if the packet passed
+	const u_char *tcp[PB_BATCH];
+	// written to the pktfields last, since the shuffled store
+	// overwrites it.
+	uint16_t total_len[PB_BATCH];
+};
+
+// collect the bytes that are checked, and fill in the IP fields. Bounds
+// are checked here, so the vector code never reads past a packet.
+static void gather( struct nlp *const *pkts, unsigned int n,
+	struct pktfields *out, struct bpcols *c )
+{
+	for( unsigned int i=0; i<n; i++ )
+	{
+		const u_char *p = pkts[i]->p;
+		unsigned int len = pkts[i]->len;
+		uint8_t b0 = p[0];
+		unsigned int hl;
+
+		if( (b0 >> 4) == 6 )
+		{
+			hl = IP6_HEADER_LEN;
+			c->proto[i] = len >= IP6_HEADER_LEN ? p[6] : 0;
+			c->total_len[i] = len >= IP6_HEADER_LEN ? (p[4] << 8) | p[5] : 0;
+		}
+		else
+		{
+			hl = (b0 & 0x0f) * 4;
+			c->proto[i] = p[9];
+			c->total_len[i] = (p[2] << 8) | p[3];
+		}
+		out[i].iphl = hl;
+
+		if( len < hl + TCP_HEADER_LEN )
+		{
+			c->verihl[i] = 0;
+			c->tcpoff[i] = 0;
+			c->tcp[i] = NULL;
+		}
+		else
+		{
+			c->verihl[i] = b0;
+			c->tcpoff[i] = p[hl+12];
+			c->tcp[i] = p + hl;
+		}
+	}
+
+	// the vector checks run to the end of their last group.
+	memset( &c->verihl[n], 0, PB_BATCH-n );
+	memset( &c->proto[n], 0, PB_BATCH-n );
+	memset( &c->tcpoff[n], 0, PB_BATCH-n );
+}
+
+// the checks, for the bytes of one packet.
+static inline bool check_scalar( uint8_t verihl, uint8_t proto, uint8_t tcpoff )
+{
+	bool ip = ( (verihl & 0xf0) == 0x40 && (verihl & 0x0f) >= 5 )
+		|| (verihl & 0xf0) == 0x60;
+	return ip && proto == IPPROTO_TCP && tcpoff >= 0x50;
+}
+
+// byte swap the start of a TCP header into f.
+static inline void extract_scalar( const u_char *t, struct pktfields *f )
+{
+	f->sport = (t[0] << 8) | t[1];
+	f->dport = (t[2] << 8) | t[3];
+	f->seq = ((uint32_t)t[4] << 24) | (t[5] << 16) | (t[6] << 8) | t[7];
+	f->ack = ((uint32_t)t[8] << 24) | (t[9] << 16) | (t[10] << 8) | t[11];
+	f->tcpoff = t[12];
+	f->flags = t[13];
+}
+
+static unsigned int finish( unsigned int n, struct pktfields *out,
+	const struct bpcols *c )
+{
+	unsigned int good = 0;
+	for( unsigned int i=0; i<n; i++ )
+	{
+		out[i].total_len = c->total_len[i];
+		if( c->valid[i] )
+		{
+			out[i].version = c->verihl[i] >> 4;
+			++good;
+		}
+		else
+			out[i].version = 0;
+	}
+	return good;
+}
+
+static unsigned int parse_scalar( struct nlp *const *pkts, unsigned int n,
+	struct pktfields *out )
+{
+	struct bpcols c;
+	gather( pkts, n, out, &c );
+	for( unsigned int i=0; i<n; i++ )
+	{
+		c.valid[i] = check_scalar( c.verihl[i], c.proto[i], c.tcpoff[i] ) ? 0xff : 0;
+		if( c.valid[i] )
+			extract_scalar( c.tcp[i], &out[i] );
+	}
+	return finish( n, out, &c );
+}
+
+#ifdef BP_X86
+
+// sport, dport, seq and ack byte swapped; offset and flags as they are.
+#define BP_SHUFFLE 1, 0, 3, 2, 7, 6, 5, 4, 11, 10, 9, 8, 12, 13, -128, -128
+
+__attribute__((target("ssse3")))
+static unsigned int parse_ssse3( struct nlp *const *pkts, unsigned int n,
+	struct pktfields *out )
+{
+	struct bpcols c;
+	gather( pkts, n, out, &c );
+
+	// 16 packets per compare. The columns are PB_BATCH long, so the
+	// last, partial, group reads bytes that are ignored.
+	const __m128i hi = _mm_set1_epi8( (char)0xf0 );
+	const __m128i lo = _mm_set1_epi8( 0x0f );
+	for( unsigned int i=0; i<n; i+=16 )
+	{
+		__m128i v = _mm_loadu_si128( (const __m128i *) &c.verihl[i] );
+		__m128i pr = _mm_loadu_si128( (const __m128i *) &c.proto[i] );
+		__m128i off = _mm_loadu_si128( (const __m128i *) &c.tcpoff[i] );
+
+		__m128i ver = _mm_and_si128( v, hi );
+		__m128i is4 = _mm_cmpeq_epi8( ver, _mm_set1_epi8(0x40) );
+		__m128i is6 = _mm_cmpeq_epi8( ver, _mm_set1_epi8(0x60) );
+		__m128i ihl = _mm_cmpgt_epi8( _mm_and_si128(v, lo), _mm_set1_epi8(4) );
+		__m128i ip = _mm_or_si128( _mm_and_si128(is4, ihl), is6 );
+		__m128i tcp = _mm_cmpeq_epi8( pr, _mm_set1_epi8(IPPROTO_TCP) );
+		__m128i offok = _mm_cmpeq_epi8( _mm_max_epu8(off, _mm_set1_epi8(0x50)), off );
+
+		__m128i ok = _mm_and_si128( ip, _mm_and_si128(tcp, offok) );
+		_mm_storeu_si128( (__m128i *) &c.valid[i], ok );
+	}
+
+	const __m128i shuf = _mm_setr_epi8( BP_SHUFFLE );
+	for( unsigned int i=0; i<n; i++ )
+	{
+		if( !c.valid[i] )
+			continue;
+		// the TCP header is at least 20 bytes, so 16 can be loaded.
+		__m128i t = _mm_loadu_si128( (const __m128i *) c.tcp[i] );
+		_mm_storeu_si128( (__m128i *) &out[i], _mm_shuffle_epi8(t, shuf) );
+	}
+	return finish( n, out, &c );
+}
+
+__attribute__((target("avx2")))
+static unsigned int parse_avx2( struct nlp *const *pkts, unsigned int n,
+	struct pktfields *out )
+{
+	struct bpcols c;
+	gather( pkts, n, out, &c );
+
+	// 32 packets per compare.
+	const __m256i hi = _mm256_set1_epi8( (char)0xf0 );
+	const __m256i lo = _mm256_set1_epi8( 0x0f );
+	for( unsigned int i=0; i<n; i+=32 )
+	{
+		__m256i v = _mm256_loadu_si256( (const __m256i *) &c.verihl[i] );
+		__m256i pr = _mm256_loadu_si256( (const __m256i *) &c.proto[i] );
+		__m256i off = _mm256_loadu_si256( (const __m256i *) &c.tcpoff[i] );
+
+		__m256i ver = _mm256_and_si256( v, hi );
+		__m256i is4 = _mm256_cmpeq_epi8( ver, _mm256_set1_epi8(0x40) );
+		__m256i is6 = _mm256_cmpeq_epi8( ver, _mm256_set1_epi8(0x60) );
+		__m256i ihl = _mm256_cmpgt_epi8( _mm256_and_si256(v, lo), _mm256_set1_epi8(4) );
+		__m256i ip = _mm256_or_si256( _mm256_and_si256(is4, ihl), is6 );
+		__m256i tcp = _mm256_cmpeq_epi8( pr, _mm256_set1_epi8(IPPROTO_TCP) );
+		__m256i offok = _mm256_cmpeq_epi8( _mm256_max_epu8(off, _mm256_set1_epi8(0x50)), off );
+
+		__m256i ok = _mm256_and_si256( ip, _mm256_and_si256(tcp, offok) );
+		_mm256_storeu_si256( (__m256i *) &c.valid[i], ok );
+	}
+
+	// two headers per shuffle.
+	const __m256i shuf = _mm256_setr_epi8( BP_SHUFFLE, BP_SHUFFLE );
+	unsigned int i = 0;
+	for( ; i+1<n; i+=2 )
+	{
+		if( c.valid[i] && c.valid[i+1] )
+		{
+			__m256i t = _mm256_inserti128_si256( _mm256_castsi128_si256(
+				_mm_loadu_si128((const __m128i *) c.tcp[i])),
+				_mm_loadu_si128((const __m128i *) c.tcp[i+1]), 1 );
+			t = _mm256_shuffle_epi8( t, shuf );
+			_mm_storeu_si128( (__m128i *) &out[i], _mm256_castsi256_si128(t) );
+			_mm_storeu_si128( (__m128i *) &out[i+1], _mm256_extracti128_si256(t, 1) );
+		}
+		else
+		{
+			if( c.valid[i] )
+				extract_scalar( c.tcp[i], &out[i] );
+			if( c.valid[i+1] )
+				extract_scalar( c.tcp[i+1], &out[i+1] );
+		}
+	}
+	if( i<n && c.valid[i] )
+		extract_scalar( c.tcp[i], &out[i] );
+
+	return finish( n, out, &c );
+}
+
+#endif
+
+typedef unsigned int (*parse_fn)( struct nlp *const *, unsigned int, struct pktfields * );
+
+static parse_fn pick( const char **name )
+{
+#ifdef BP_X86
+	__builtin_cpu_init();
+	if( __builtin_cpu_supports("avx2") )
+	{
+		*name = "avx2";
+		return parse_avx2;
+	}
+	if( __builtin_cpu_supports("ssse3") )
+	{
+		*name = "ssse3";
+		return parse_ssse3;
+	}
+#endif
+	*name = "scalar";
+	return parse_scalar;
+}
+
+static const char *isa_name;
+static parse_fn parse_impl = pick( &isa_name );
+
+unsigned int parse_batch( struct nlp *const *pkts, unsigned int n,
+	struct pktfields *out )
+{
+	assert( n <= PB_BATCH );
+	return parse_impl( pkts, n, out );
+}
+
+const char * parse_batch_isa()
+{
+	return isa_name;
+}
+
+bool parse_batch_use( const char *isa )
+{
+	if( strcmp(isa, "scalar") == 0 )
+	{
+		isa_name = "scalar";
+		parse_impl = parse_scalar;
+		return true;
+	}
+#ifdef BP_X86
+	__builtin_cpu_init();
+	if( strcmp(isa, "ssse3") == 0 && __builtin_cpu_supports("ssse3") )
+	{
+		isa_name = "ssse3";
+		parse_impl = parse_ssse3;
+		return true;
+	}
+	if( strcmp(isa, "avx2") == 0 && __builtin_cpu_supports("avx2") )
+	{
+		isa_name = "avx2";
+		parse_impl = parse_avx2;
+		return true;
+	}
+#endif
+	return false;
+}
@@ -0,0 +1,68 @@
+/*
+ *  The code in this file is part of tcptrack. For more information see
+ *    http://www.rhythm.cx/~steve/devel/tcptrack
+ *
+ *     Copyright (C) Steve Benson - 2003
+ *
+ *  tcptrack is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your
+ *  option) any later version.
+ *
+ *  tcptrack is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GNU Make; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#ifndef BATCHPARSE_H
+#define BATCHPARSE_H 1
+
+#include <sys/types.h>
+#include <stdint.h>
+
+struct nlp;
+
+// the header fields of one packet that TCPPacket and TCPHeader need, in
+// host byte order. The first 14 bytes are laid out like the start of a
+// TCP header, so one byte shuffle of the header fills them in.
+struct pktfields
+{
+	uint16_t sport;
+	uint16_t dport;
+	uint32_t seq;
+	uint32_t ack;
+	uint8_t tcpoff;     // TCP header length in 32 bit words, high 4 bits
+	uint8_t flags;
+	uint16_t total_len; // as TCPPacket::totalLen()
+	uint8_t iphl;       // IP header length in bytes
+	uint8_t version;    // 4 or 6. 0 if the packet isn't a usable TCP packet
+	uint16_t pad;
+};
+
+/* parse_batch() validates and extracts the headers of up to PB_BATCH
+ * packets at once. Validation (IP version, IHL, protocol and TCP data
+ * offset) is done for the whole batch with byte-wise vector compares, and
+ * each TCP header's ports, sequence and ack numbers are byte swapped with
+ * a single shuffle. Where the CPU has AVX2 or SSSE3 that is used, picked at
+ * run time; otherwise a plain C version does the same.
+ *
+ * Returns how many of the n packets are valid. out[i] is filled in for
+ * every one; invalid ones get version 0.
+ */
+unsigned int parse_batch( struct nlp *const *pkts, unsigned int n,
+	struct pktfields *out );
+
+// the instruction set parse_batch() uses: "avx2", "ssse3" or "scalar".
+const char * parse_batch_isa();
+
+// make parse_batch() use the named instruction set instead of the best
+// one the CPU has, to compare them. Returns false, changing nothing, if
+// the CPU or the build doesn't have it. Not while packets are parsed.
+bool parse_batch_use( const char *isa );
+
+#endif
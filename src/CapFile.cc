@@ -0,0 +1,565 @@
+/*
+ *  The code in this file is part of tcptrack. For more information see
+ *    http://www.rhythm.cx/~steve/devel/tcptrack
+ *
+ *     Copyright (C) Steve Benson - 2003
+ *
+ *  tcptrack is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your
+ *  option) any later version.
+ *
+ *  tcptrack is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GNU Make; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#include "../config.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "CapFile.h"
+
+#define CAPIDX_MAGIC "tcptidx2"
+
+/* A saved time index is a header and then the entries, every field in
+ * little-endian byte order whatever the host's. The header is
+ *
+ *    0  magic     8 bytes, CAPIDX_MAGIC
+ *    8  count     u32, entries
+ *   12  mtimens   u32, nanoseconds of the capture file's modification time
+ *   16  filesize  u64, of the capture file when it was indexed
+ *   24  mtime     i64, seconds of its modification time
+ *   32  base      i64, the second of the first entry
+ *
+ * and each entry is pos and section as u64, then nifaces as u32 and four
+ * bytes of padding.
+ */
+#define CAPIDX_HDRLEN 40
+#define CAPIDX_ENTLEN 24
+
+static void put_le( u_char *p, uint64_t x, int n )
+{
+	for( int i=0; i<n; i++ )
+		p[i] = (u_char)(x >> (8*i));
+}
+
+static uint64_t get_le( const u_char *p, int n )
+{
+	uint64_t x = 0;
+	for( int i=n-1; i>=0; i-- )
+		x = (x << 8) | p[i];
+	return x;
+}
+
+#define PCAP_MAGIC       0xa1b2c3d4
+#define PCAP_MAGIC_NSEC  0xa1b23c4d
+#define PCAPNG_SHB       0x0a0d0d0a
+#define PCAPNG_BOM       0x1a2b3c4d
+#define PCAPNG_IDB       1
+#define PCAPNG_PB        2 // obsolete packet block
+#define PCAPNG_SPB       3
+#define PCAPNG_EPB       6
+#define PCAPNG_TSRESOL   9 // if_tsresol option
+
+// the few LINKTYPE_* values that aren't the same as their DLT_*.
+static int linktype_dlt( uint32_t lt )
+{
+	lt &= 0x03ffffff; // the rest are FCS flags
+	if( lt == 101 )
+		return DLT_RAW;
+	return lt;
+}
+
+static uint32_t swap32( uint32_t x )
+{
+	return (x >> 24) | ((x >> 8) & 0xff00) | ((x << 8) & 0xff0000) | (x << 24);
+}
+
+CapFile::CapFile()
+{
+	fd=-1;
+	base=NULL;
+	size=0;
+	pos=0;
+	advised=0;
+	ng=false;
+	swapped=false;
+	nano=false;
+	dlt=-1;
+	idxbase=0;
+	idxdone=false;
+	idxfull=false;
+	mtime.tv_sec=0;
+	mtime.tv_nsec=0;
+	recpos=0;
+	section=0;
+}
+
+CapFile::~CapFile()
+{
+	if( base != NULL )
+		munmap( (void *)base, size );
+	if( fd != -1 )
+		close(fd);
+}
+
+uint16_t CapFile::get16( const u_char *p ) const
+{
+	uint16_t x;
+	memcpy( &x, p, 2 );
+	return swapped ? (uint16_t)((x >> 8) | (x << 8)) : x;
+}
+
+uint32_t CapFile::get32( const u_char *p ) const
+{
+	uint32_t x;
+	memcpy( &x, p, 4 );
+	return swapped ? swap32(x) : x;
+}
+
+bool CapFile::open( const char *path, char *errbuf )
+{
+	fd = ::open( path, O_RDONLY );
+	if( fd == -1 )
+	{
+		snprintf( errbuf, PCAP_ERRBUF_SIZE, "%s: %s", path, strerror(errno) );
+		return false;
+	}
+
+	struct stat st;
+	if( fstat(fd, &st) == -1 || st.st_size < 24 )
+	{
+		snprintf( errbuf, PCAP_ERRBUF_SIZE, "%s: too short", path );
+		return false;
+	}
+	size = st.st_size;
+	mtime = st.st_mtim;
+	idxpath = std::string(path) + CAPIDX_SUFFIX;
+
+	void *m = mmap( NULL, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	if( m == MAP_FAILED )
+	{
+		snprintf( errbuf, PCAP_ERRBUF_SIZE, "mmap: %s", strerror(errno) );
+		return false;
+	}
+	base = (const u_char *) m;
+	madvise( m, size, MADV_SEQUENTIAL );
+#ifdef POSIX_FADV_SEQUENTIAL
+	posix_fadvise( fd, 0, 0, POSIX_FADV_SEQUENTIAL );
+#endif
+	readAhead();
+
+	uint32_t magic;
+	memcpy( &magic, base, 4 );
+
+	if( magic == PCAPNG_SHB )
+	{
+		ng = true;
+		if( !readSection() || ifaces.empty() )
+		{
+			snprintf( errbuf, PCAP_ERRBUF_SIZE,
+				"%s: no interfaces in the first section", path );
+			return false;
+		}
+		dlt = ifaces[0].dlt;
+		loadIndex();
+		return true;
+	}
+
+	if( magic == PCAP_MAGIC || magic == PCAP_MAGIC_NSEC )
+		swapped = false;
+	else if( magic == swap32(PCAP_MAGIC) || magic == swap32(PCAP_MAGIC_NSEC) )
+		swapped = true;
+	else
+	{
+		snprintf( errbuf, PCAP_ERRBUF_SIZE, "%s: unknown file format", path );
+		return false;
+	}
+	nano = ( get32(base) == PCAP_MAGIC_NSEC );
+	dlt = linktype_dlt( get32(base+20) );
+	pos = 24;
+	loadIndex();
+	return true;
+}
+
+// ask for the next CAPFILE_AHEAD bytes once the reader is half way into
+// the last lot.
+void CapFile::readAhead()
+{
+	while( advised < size && pos + CAPFILE_AHEAD/2 >= advised )
+	{
+		size_t len = CAPFILE_AHEAD;
+		if( advised + len > size )
+			len = size - advised;
+		madvise( (void *)(base + advised), len, MADV_WILLNEED );
+		advised += len;
+	}
+}
+
+bool CapFile::next( struct pcap_pkthdr *h, const u_char **data )
+{
+	if( pos >= advised - CAPFILE_AHEAD/2 )
+		readAhead();
+	if( ng ? nextPcapng(h, data) : nextPcap(h, data) )
+	{
+		note( h->ts.tv_sec );
+		return true;
+	}
+	if( !idxdone && !idxfull )
+	{
+		idxdone = true;
+		saveIndex();
+	}
+	return false;
+}
+
+bool CapFile::nextPcap( struct pcap_pkthdr *h, const u_char **data )
+{
+	if( pos + 16 > size )
+		return false;
+
+	const u_char *r = base + pos;
+	uint32_t caplen = get32(r+8);
+	if( caplen > size - pos - 16 )
+		return false;
+
+	recpos = pos;
+	h->ts.tv_sec = get32(r);
+	h->ts.tv_usec = nano ? get32(r+4) / 1000 : get32(r+4);
+	h->caplen = caplen;
+	h->len = get32(r+12);
+	*data = r+16;
+	pos += 16 + caplen;
+	return true;
+}
+
+// read the section header block at pos and the interfaces that follow it.
+// Sets the byte order for the section.
+bool CapFile::readSection()
+{
+	if( pos + 28 > size )
+		return false;
+
+	uint32_t bom;
+	memcpy( &bom, base+pos+8, 4 );
+	if( bom == PCAPNG_BOM )
+		swapped = false;
+	else if( bom == swap32(PCAPNG_BOM) )
+		swapped = true;
+	else
+		return false;
+
+	uint32_t blen = get32(base+pos+4);
+	if( blen < 28 || blen > size - pos )
+		return false;
+	section = pos;
+	pos += blen;
+	ifaces.clear();
+
+	// interfaces are described before any packets refer to them.
+	while( pos + 12 <= size && get32(base+pos) == PCAPNG_IDB )
+	{
+		blen = get32(base+pos+4);
+		if( blen < 20 || blen > size - pos )
+			return false;
+		readInterface( base+pos, blen );
+		pos += blen;
+	}
+	return true;
+}
+
+void CapFile::readInterface( const u_char *b, uint32_t blen )
+{
+	struct capiface ci;
+	ci.dlt = linktype_dlt( get16(b+8) );
+	ci.tsrate = 1000000;
+
+	// the options, up to the block's trailing length.
+	const u_char *o = b+16;
+	const u_char *end = b+blen-4;
+	while( o + 4 <= end )
+	{
+		uint16_t code = get16(o);
+		uint16_t len = get16(o+2);
+		if( code == 0 || o + 4 + len > end )
+			break;
+		if( code == PCAPNG_TSRESOL && len >= 1 )
+		{
+			// 10^-n seconds, or 2^-n if the top bit is set.
+			uint8_t r = o[4];
+			uint64_t rate = 1;
+			for( int i=0; i<(r & 0x7f) && rate < 1000000000000000000ULL; i++ )
+				rate *= (r & 0x80) ? 2 : 10;
+			ci.tsrate = rate;
+		}
+		o += 4 + ((len + 3) & ~3);
+	}
+	ifaces.push_back(ci);
+}
+
+bool CapFile::nextPcapng( struct pcap_pkthdr *h, const u_char **data )
+{
+	while( pos + 12 <= size )
+	{
+		const u_char *b = base + pos;
+		uint32_t type;
+		memcpy( &type, b, 4 ); // the same either way round
+		if( type == PCAPNG_SHB )
+		{
+			if( !readSection() )
+				return false;
+			continue;
+		}
+
+		uint32_t blen = get32(b+4);
+		if( blen < 12 || blen > size - pos )
+			return false;
+		type = get32(b);
+		recpos = pos;
+		pos += blen;
+
+		uint32_t ifid, caplen, len;
+		uint64_t ts;
+		const u_char *pkt;
+		if( type == PCAPNG_EPB && blen >= 32 )
+		{
+			ifid = get32(b+8);
+			ts = ((uint64_t)get32(b+12) << 32) | get32(b+16);
+			caplen = get32(b+20);
+			len = get32(b+24);
+			pkt = b+28;
+			if( caplen > blen - 32 )
+				return false;
+		}
+		else if( type == PCAPNG_PB && blen >= 32 )
+		{
+			ifid = get16(b+8);
+			ts = ((uint64_t)get32(b+12) << 32) | get32(b+16);
+			caplen = get32(b+20);
+			len = get32(b+24);
+			pkt = b+28;
+			if( caplen > blen - 32 )
+				return false;
+		}
+		else if( type == PCAPNG_SPB && blen >= 16 )
+		{
+			// no timestamp, and the captured length is what fits.
+			ifid = 0;
+			ts = 0;
+			len = get32(b+8);
+			caplen = blen - 16;
+			if( caplen > len )
+				caplen = len;
+			pkt = b+12;
+		}
+		else if( type == PCAPNG_IDB && blen >= 20 )
+		{
+			readInterface( b, blen );
+			continue;
+		}
+		else
+			continue;
+
+		if( ifid >= ifaces.size() || ifaces[ifid].dlt != dlt )
+			continue;
+
+		uint64_t rate = ifaces[ifid].tsrate;
+		h->ts.tv_sec = ts / rate;
+		h->ts.tv_usec = (uint64_t)((long double)(ts % rate) * 1000000 / rate);
+		h->caplen = caplen;
+		h->len = len;
+		*data = pkt;
+		return true;
+	}
+	return false;
+}
+
+// index the record last handed out, if it's the first of a second.
+void CapFile::note( time_t sec )
+{
+	if( idxdone || idxfull )
+		return;
+	if( idx.empty() )
+		idxbase = sec;
+	else if( sec < idxbase + (time_t)idx.size() )
+		return;
+	if( sec - idxbase >= CAPIDX_MAX )
+	{
+		idxfull = true;
+		return;
+	}
+
+	// seconds without packets start at the next one that has some.
+	struct capidx e;
+	e.pos = recpos;
+	e.section = section;
+	e.nifaces = ifaces.size();
+	e.pad = 0;
+	while( idxbase + (time_t)idx.size() <= sec )
+		idx.push_back(e);
+}
+
+// carry on reading at index entry e.
+void CapFile::restore( const struct capidx &e )
+{
+	if( ng )
+	{
+		// the section's byte order and interfaces are needed to
+		// read anything in it.
+		pos = e.section;
+		readSection();
+		while( ifaces.size() < e.nifaces && pos + 12 <= e.pos )
+		{
+			uint32_t blen = get32(base+pos+4);
+			if( blen < 12 || blen > size - pos )
+				break;
+			if( get32(base+pos) == PCAPNG_IDB && blen >= 20 )
+				readInterface( base+pos, blen );
+			pos += blen;
+		}
+	}
+	pos = e.pos;
+
+	// the readahead starts over from here.
+	advised = pos - pos % CAPFILE_AHEAD;
+	readAhead();
+}
+
+time_t CapFile::startTime()
+{
+	if( idx.empty() )
+	{
+		// reading the first packet indexes it. Then go back to it.
+		struct pcap_pkthdr h;
+		const u_char *data;
+		if( !next(&h, &data) )
+			return -1;
+		restore( idx[0] );
+	}
+	return idxbase;
+}
+
+bool CapFile::seek( time_t t )
+{
+	if( startTime() == -1 )
+		return false;
+
+	if( t < idxbase )
+		t = idxbase;
+	if( t - idxbase < (time_t)idx.size() )
+	{
+		restore( idx[t - idxbase] );
+		return true;
+	}
+
+	// past what has been indexed. Read on from the last second that has,
+	// which indexes everything up to t on the way.
+	restore( idx.back() );
+	struct pcap_pkthdr h;
+	const u_char *data;
+	while( next(&h, &data) )
+	{
+		if( h.ts.tv_sec >= t )
+		{
+			pos = recpos;
+			break;
+		}
+	}
+	return true;
+}
+
+// load the saved index, if there is one and it's for this file as it is
+// now.
+bool CapFile::loadIndex()
+{
+	int ifd = ::open( idxpath.c_str(), O_RDONLY );
+	if( ifd == -1 )
+		return false;
+
+	u_char hdr[CAPIDX_HDRLEN];
+	struct stat st;
+	bool ok = read(ifd, hdr, sizeof(hdr)) == (ssize_t)sizeof(hdr)
+		&& memcmp(hdr, CAPIDX_MAGIC, 8) == 0;
+	uint32_t count = ok ? get_le(hdr+8, 4) : 0;
+	ok = ok && count > 0 && count <= CAPIDX_MAX
+		&& get_le(hdr+12, 4) == (uint64_t)mtime.tv_nsec
+		&& get_le(hdr+16, 8) == (uint64_t)size
+		&& (int64_t)get_le(hdr+24, 8) == (int64_t)mtime.tv_sec
+		&& fstat(ifd, &st) == 0
+		&& (uint64_t)st.st_size == CAPIDX_HDRLEN + (uint64_t)count*CAPIDX_ENTLEN;
+	std::vector<u_char> buf;
+	if( ok )
+	{
+		buf.resize( count * CAPIDX_ENTLEN );
+		ok = read(ifd, &buf[0], buf.size()) == (ssize_t)buf.size();
+	}
+	close(ifd);
+
+	if( !ok )
+	{
+		idx.clear();
+		return false;
+	}
+
+	idx.resize(count);
+	for( uint32_t i=0; i<count; i++ )
+	{
+		const u_char *e = &buf[i*CAPIDX_ENTLEN];
+		idx[i].pos = get_le(e, 8);
+		idx[i].section = get_le(e+8, 8);
+		idx[i].nifaces = get_le(e+16, 4);
+		idx[i].pad = 0;
+	}
+	idxbase = (int64_t)get_le(hdr+32, 8);
+	idxdone = true;
+	return true;
+}
+
+// save the index next to the file, if we may. It's written to a temporary
+// file first so that anyone else reading the same file at the same time
+// only ever sees a whole one.
+void CapFile::saveIndex()
+{
+	if( idx.empty() )
+		return;
+
+	std::string tmp = idxpath + ".XXXXXX";
+	std::vector<char> name( tmp.begin(), tmp.end() );
+	name.push_back(0);
+	int tfd = mkstemp( &name[0] );
+	if( tfd == -1 )
+		return;
+	fchmod( tfd, 0644 );
+
+	std::vector<u_char> buf( CAPIDX_HDRLEN + idx.size()*CAPIDX_ENTLEN, 0 );
+	u_char *hdr = &buf[0];
+	memcpy( hdr, CAPIDX_MAGIC, 8 );
+	put_le( hdr+8, idx.size(), 4 );
+	put_le( hdr+12, mtime.tv_nsec, 4 );
+	put_le( hdr+16, size, 8 );
+	put_le( hdr+24, (int64_t)mtime.tv_sec, 8 );
+	put_le( hdr+32, (int64_t)idxbase, 8 );
+	for( size_t i=0; i<idx.size(); i++ )
+	{
+		u_char *e = &buf[CAPIDX_HDRLEN + i*CAPIDX_ENTLEN];
+		put_le( e, idx[i].pos, 8 );
+		put_le( e+8, idx[i].section, 8 );
+		put_le( e+16, idx[i].nifaces, 4 );
+	}
+
+	bool ok = write(tfd, &buf[0], buf.size()) == (ssize_t)buf.size();
+	if( close(tfd) != 0 )
+		ok = false;
+	if( !ok || rename(&name[0], idxpath.c_str()) != 0 )
+		unlink( &name[0] );
+}
@@ -0,0 +1,149 @@
+/*
+ *  The code in this file is part of tcptrack. For more information see
+ *    http://www.rhythm.cx/~steve/devel/tcptrack
+ *
+ *     Copyright (C) Steve Benson - 2003
+ *
+ *  tcptrack is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your
+ *  option) any later version.
+ *
+ *  tcptrack is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GNU Make; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#ifndef CAPFILE_H
+#define CAPFILE_H 1
+
+#include "../config.h"
+#include <sys/types.h>
+#include <stdint.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#ifdef HAVE_PCAP_PCAP_H
+#include <pcap/pcap.h>
+#endif
+#ifdef HAVE_PCAP_H
+#include <pcap.h>
+#endif
+
+// how far ahead of the reader the kernel is asked to read the file.
+#define CAPFILE_AHEAD (16*1024*1024)
+
+// the time index is given up on for files spanning more seconds than this
+// (about 48 days). Seeking then scans from the last second indexed.
+#define CAPIDX_MAX (1<<22)
+
+// appended to a capture file's name for its time index.
+#define CAPIDX_SUFFIX ".tcpidx"
+
+/* CapFile reads pcap and pcapng files for -T without libpcap. The whole
+ * file is mapped and its records are walked in place, so each packet is
+ * handed out as a pointer into the mapping instead of being read() into a
+ * buffer first. The kernel is told the file is read sequentially and asked
+ * to read CAPFILE_AHEAD bytes ahead of wherever the reader is.
+ *
+ * pcap files may be in either byte order, with micro or nanosecond
+ * timestamps. pcapng files may have any number of sections and
+ * interfaces, with any timestamp resolution; enhanced, simple and the
+ * old-style packet blocks are read and everything else is skipped.
+ * Timestamps are handed out in microseconds either way.
+ *
+ * While the file is read, CapFile notes where each second of capture time
+ * starts. Once it has been read to the end, that time index is saved next
+ * to the file (as the file name plus CAPIDX_SUFFIX, if the directory can
+ * be written to) and loaded the next time the file is opened, as long as
+ * the file hasn't changed since. seek() then goes straight to any second.
+ * Without a complete index it reads forward from the last second it knows,
+ * indexing as it goes.
+ */
+class CapFile
+{
+public:
+	CapFile();
+	~CapFile();
+
+	// map the file at path and read its header. Returns false, with the
+	// reason in errbuf (PCAP_ERRBUF_SIZE long), if it can't be opened or
+	// isn't a file this reader understands.
+	bool open( const char *path, char *errbuf );
+
+	// the DLT_* link type of the packets handed out. In a pcapng file,
+	// that of the first interface; packets from interfaces of any other
+	// link type are skipped.
+	int linktype() const { return dlt; }
+
+	// the next packet. data points into the mapping and stays valid until
+	// the CapFile is deleted. Returns false at the end of the file, or
+	// where it is cut short.
+	bool next( struct pcap_pkthdr *h, const u_char **data );
+
+	// the capture time of the first packet, or -1 if there are none.
+	time_t startTime();
+	// carry on reading from the first packet captured at or after t, or
+	// from the end if there is none. Returns false if there are no
+	// packets at all.
+	bool seek( time_t t );
+
+private:
+	bool nextPcap( struct pcap_pkthdr *h, const u_char **data );
+	bool nextPcapng( struct pcap_pkthdr *h, const u_char **data );
+	bool readSection();
+	void readInterface( const u_char *b, uint32_t blen );
+	void readAhead();
+
+	// an index entry: where the first record of a second starts. In a
+	// pcapng file, also the section it's in and how many of the
+	// section's interfaces had been described by then.
+	struct capidx
+	{
+		uint64_t pos;
+		uint64_t section;
+		uint32_t nifaces;
+		uint32_t pad;
+	};
+	void note( time_t sec );
+	void restore( const struct capidx &e );
+	bool loadIndex();
+	void saveIndex();
+	std::string idxpath;
+	std::vector<struct capidx> idx; // idx[i] is second idxbase+i
+	time_t idxbase;
+	bool idxdone;     // loaded, or the file has been read to the end
+	bool idxfull;     // spans more than CAPIDX_MAX seconds
+	struct timespec mtime; // the file's, to tell if an index is stale
+	size_t recpos;    // where the record last handed out starts
+	size_t section;   // where the current pcapng section starts
+
+	uint16_t get16( const u_char *p ) const;
+	uint32_t get32( const u_char *p ) const;
+
+	int fd;
+	const u_char *base;
+	size_t size;
+	size_t pos;       // where the next record starts
+	size_t advised;   // how far readahead has been asked for
+
+	bool ng;          // pcapng?
+	bool swapped;     // written in the other byte order?
+	bool nano;        // pcap with nanosecond timestamps?
+	int dlt;
+
+	// the interfaces of the current pcapng section.
+	struct capiface
+	{
+		int dlt;
+		uint64_t tsrate; // timestamp units per second
+	};
+	std::vector<struct capiface> ifaces;
+};
+
+#endif
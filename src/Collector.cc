@@ -1,4 +1,4 @@
-/* 
+/*
  *  The code in this file is part of tcptrack. For more information see
  *    http://www.rhythm.cx/~steve/devel/tcptrack
  *
@@ -20,13 +20,122 @@
  *  
  */
 
+#define _DEFAULT_SOURCE 1
+#define _BSD_SOURCE 1
+#define _REENTRANT
+#include <pthread.h>
+#include <sched.h>
+#include <assert.h>
 #include "TCPConnection.h"
 #include "Collector.h"
+#include "defs.h"
+#include "GenericError.h"
+#include "TCPTrack.h"
+
+extern TCPTrack *app;
+
+Collector::Collector()
+{
+	inq = &q1;
+	outq = &q2;
+	pthread_initted=false;
+	stopping=false;
+
+	pthread_mutex_init( &inq_lock, NULL );
+	pthread_cond_init( &inq_flag, NULL );
+}
+
+void Collector::init()
+{
+	pthread_attr_t attr;
+	if( pthread_attr_init( &attr ) != 0 )
+		throw GenericError("pthread_attr_init() failed");
+
+	pthread_attr_setstacksize( &attr, SS_C );
+
+	if( pthread_create(&maint_thread_tid,&attr,collector_thread_func,this) != 0 )
+		throw GenericError("pthread_create() returned an error");
+
+	pthread_initted=true;
+}
+
+Collector::~Collector()
+{
+	if( pthread_initted )
+	{
+		assert( pthread_mutex_lock(&inq_lock) == 0 );
+		stopping=true;
+		assert( pthread_cond_signal(&inq_flag) == 0 );
+		assert( pthread_mutex_unlock(&inq_lock) == 0 );
+
+		pthread_join(maint_thread_tid,NULL);
+	}
+
+	// anything left over if the thread never ran.
+	for( unsigned int i=0; i<inq->size(); i++ )
+		delete (*inq)[i];
+}
 
 void Collector::collect(TCPConnection *c)
 {
-	// in the future when multiple SortedIterators are allowed and 
-	// the TCContainer isn't locked, this will have to be sure that the 
-	// connection being deleted isn't referenced anywhere before deleting it
-	delete c;
+	if( !pthread_initted )
+	{
+		delete c;
+		return;
+	}
+
+	assert( pthread_mutex_lock(&inq_lock) == 0 );
+	inq->push_back(c);
+	// the maintenance thread hands over a whole purge at once. Only
+	// wake the collector for the first one.
+	if( inq->size() == 1 )
+		assert( pthread_cond_signal(&inq_flag) == 0 );
+	assert( pthread_mutex_unlock(&inq_lock) == 0 );
+}
+
+void Collector::maint_thread_run()
+{
+	// this is cleanup work. Let everything else go first.
+#ifdef SCHED_IDLE
+	struct sched_param sp;
+	sp.sched_priority = 0;
+	pthread_setschedparam( pthread_self(), SCHED_IDLE, &sp );
+#endif
+
+	while(1)
+	{
+		assert( pthread_mutex_lock(&inq_lock) == 0 );
+		while( inq->empty() && !stopping )
+			pthread_cond_wait(&inq_flag,&inq_lock);
+
+		if( inq->empty() && stopping )
+		{
+			assert( pthread_mutex_unlock(&inq_lock) == 0 );
+			return;
+		}
+
+		// swap in & out queues so collect() never waits on the
+		// deletes below.
+		std::vector<TCPConnection *> *tmp = inq;
+		inq = outq;
+		outq = tmp;
+		assert( pthread_mutex_unlock(&inq_lock) == 0 );
+
+		// outq is only touched by this thread.
+		// deleting a connection waits for its name lookup thread.
+		for( unsigned int i=0; i<outq->size(); i++ )
+			delete (*outq)[i];
+
+		outq->clear();
+	}
+}
+
+////////////////////////
+
+void *collector_thread_func( void *arg )
+{
+	Collector *c = (Collector *) arg;
+	app->affinity.apply(AFF_COLLECTOR);
+	c->maint_thread_run();
+	return NULL;
 }
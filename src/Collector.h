@@ -23,10 +23,53 @@
 #ifndef COLLECTOR_H
 #define COLLECTOR_H
 
+#include <pthread.h>
+#include <vector>
+
+class TCPConnection;
+
+/* The Collector gets connections that have been removed from the
+ * TCContainer and finishes them off in its own low priority thread.
+ * Destroying a connection can mean waiting for its name lookup thread,
+ * and that shouldn't happen while the connection table is locked and
+ * packets are waiting. collect() just queues the connection.
+ */
 class Collector
 {
 public:
+	Collector();
+	// finishes off anything still queued before returning.
+	~Collector();
+
+	// performs more constructor-like activity, but exceptions can
+	// be thrown from within here. Until this is called, collect()
+	// deletes connections right away.
+	void init();
+
+	// hand over a connection that nothing else references any more.
 	void collect(TCPConnection *c);
+
+	// do not call. only called from collector_thread_func.
+	void maint_thread_run();
+
+private:
+	// was the thread successfully launched?
+	bool pthread_initted;
+	bool stopping;
+
+	// collect() adds to inq. The collector thread swaps the queues
+	// and empties outq without holding the lock.
+	std::vector<TCPConnection *> q1;
+	std::vector<TCPConnection *> q2;
+	std::vector<TCPConnection *> *inq;
+	std::vector<TCPConnection *> *outq;
+	pthread_mutex_t inq_lock;
+	// set when something is queued or when stopping.
+	pthread_cond_t inq_flag;
+
+	pthread_t maint_thread_tid;
 };
 
+void *collector_thread_func( void * );
+
 #endif
@@ -0,0 +1,199 @@
+/*
+ *  The code in this file is part of tcptrack. For more information see
+ *    http://www.rhythm.cx/~steve/devel/tcptrack
+ *
+ *     Copyright (C) Steve Benson - 2003
+ *
+ *  tcptrack is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your
+ *  option) any later version.
+ *
+ *  tcptrack is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GNU Make; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#include "../config.h"
+#define _DEFAULT_SOURCE 1
+#define _BSD_SOURCE 1
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+#ifdef HAVE_SYS_TIMERFD_H
+#include <sys/timerfd.h>
+#endif
+#include "EventLoop.h"
+#include "defs.h"
+#include "TCPTrack.h"
+#include "GenericError.h"
+
+extern TCPTrack *app;
+
+EventLoop::EventLoop( std::vector<Sniffer *> &s, TCContainer *c, TextUI *u )
+{
+	sniffers=s;
+	container=c;
+	ui=u;
+	epfd=-1;
+	tfd=-1;
+	armed_intvl=0;
+}
+
+EventLoop::~EventLoop()
+{
+	if( tfd != -1 )
+		close(tfd);
+	if( epfd != -1 )
+		close(epfd);
+}
+
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_SYS_TIMERFD_H)
+
+void EventLoop::init()
+{
+	epfd = epoll_create(2+sniffers.size());
+	if( epfd == -1 )
+		throw GenericError("epoll_create() failed.");
+
+	tfd = timerfd_create(CLOCK_MONOTONIC, 0);
+	if( tfd == -1 )
+		throw GenericError("timerfd_create() failed.");
+	arm();
+
+	struct epoll_event ev;
+	ev.events = EPOLLIN;
+
+	ev.data.fd = tfd;
+	if( epoll_ctl(epfd, EPOLL_CTL_ADD, tfd, &ev) == -1 )
+		throw GenericError("epoll_ctl() failed.");
+
+	ev.data.fd = 0;
+	if( epoll_ctl(epfd, EPOLL_CTL_ADD, 0, &ev) == -1 )
+		throw GenericError("epoll_ctl() failed.");
+
+	for( unsigned int i=0; i<sniffers.size(); i++ )
+	{
+		int pfd = sniffers[i]->fd();
+		pfds.push_back(pfd);
+		ev.data.fd = pfd;
+		if( pfd == -1 || epoll_ctl(epfd, EPOLL_CTL_ADD, pfd, &ev) == -1 )
+		{
+			// regular files (test files) can't be put in an epoll set.
+			if( pfd != -1 && errno != EPERM )
+				throw GenericError("epoll_ctl() failed.");
+			polled.push_back(i);
+		}
+	}
+}
+
+void EventLoop::arm()
+{
+	unsigned int intvl = app->refresh_intvl;
+	struct itimerspec its;
+	its.it_value.tv_sec = intvl / 1000000;
+	its.it_value.tv_nsec = (intvl % 1000000) * 1000;
+	its.it_interval = its.it_value;
+
+	if( timerfd_settime(tfd, 0, &its, NULL) == -1 )
+		throw GenericError("timerfd_settime() failed.");
+	armed_intvl = intvl;
+}
+
+void EventLoop::run()
+{
+	struct epoll_event evs[2+MAX_IFACES];
+
+	while( !app->quitting() )
+	{
+		// when busy polling, never sleep in the kernel. A test file
+		// is read as soon as its next packet is due.
+		int timeout = app->busypoll ? 0 : -1;
+		if( !app->busypoll )
+		{
+			for( unsigned int k=0; k<polled.size(); k++ )
+			{
+				int t = sniffers[polled[k]]->idle();
+				if( t >= 0 && ( timeout < 0 || t < timeout ) )
+					timeout = t;
+			}
+		}
+		int n = epoll_wait(epfd, evs, 2+MAX_IFACES, timeout);
+		if( n == -1 )
+		{
+			if( errno == EINTR )
+				continue;
+			throw GenericError("epoll_wait() failed.");
+		}
+
+		for( int i=0; i<n; i++ )
+		{
+			int fd = evs[i].data.fd;
+			if( fd == tfd )
+			{
+				uint64_t expirations;
+				if( read(tfd, &expirations, sizeof(expirations)) < 0 )
+					continue;
+				for( unsigned int k=0; k<sniffers.size(); k++ )
+					sniffers[k]->flush();
+				container->maintain();
+				ui->update();
+			}
+			else if( fd == 0 )
+			{
+				ui->input( getch() );
+				ui->update();
+			}
+			else
+			{
+				for( unsigned int k=0; k<pfds.size(); k++ )
+					if( fd == pfds[k] )
+						sniffers[k]->dispatch();
+			}
+		}
+
+		// the end of the last test file ends the run, like in
+		// threaded mode.
+		for( unsigned int k=0; k<polled.size(); )
+		{
+			Sniffer *s = sniffers[polled[k]];
+			if( s->dispatch() == -1 && s->isFile() )
+			{
+				polled.erase( polled.begin()+k );
+				if( polled.empty() )
+					app->shutdown();
+			}
+			else
+				k++;
+		}
+
+		// + and - change the refresh interval.
+		if( app->refresh_intvl != armed_intvl )
+			arm();
+	}
+}
+
+#else
+
+void EventLoop::init()
+{
+	throw GenericError("Single-threaded mode needs epoll and timerfd, which this system doesn't have.");
+}
+
+void EventLoop::arm()
+{
+}
+
+void EventLoop::run()
+{
+}
+
+#endif
@@ -0,0 +1,69 @@
+/*
+ *  The code in this file is part of tcptrack. For more information see
+ *    http://www.rhythm.cx/~steve/devel/tcptrack
+ *
+ *     Copyright (C) Steve Benson - 2003
+ *
+ *  tcptrack is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your
+ *  option) any later version.
+ *
+ *  tcptrack is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GNU Make; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#ifndef EVENTLOOP_H
+#define EVENTLOOP_H 1
+
+#include <vector>
+#include "Sniffer.h"
+#include "TCContainer.h"
+#include "TextUI.h"
+
+/* EventLoop runs all of tcptrack in the calling thread. Instead of the
+ * Sniffer, PacketBuffer, TCContainer and TextUI threads each waking up on
+ * their own, one epoll loop waits on the pcap descriptors, a timerfd that
+ * fires once per refresh interval, and the terminal. Packets go straight
+ * from the Sniffer to the TCContainer, so no lock is ever contended.
+ *
+ * The objects have to be initialized in their unthreaded modes first.
+ */
+class EventLoop
+{
+public:
+	EventLoop( std::vector<Sniffer *> &s, TCContainer *c, TextUI *ui );
+	~EventLoop();
+
+	// like a constructor, but exceptions can be thrown.
+	void init();
+	// runs until TCPTrack::shutdown() is called.
+	void run();
+private:
+	// (re)start the timer with the current refresh interval.
+	void arm();
+
+	std::vector<Sniffer *> sniffers;
+	TCContainer *container;
+	TextUI *ui;
+
+	int epfd;   // epoll descriptor
+	int tfd;    // timerfd for the refresh interval
+	std::vector<int> pfds; // pcap descriptors, one for each sniffer
+
+	// sniffers whose descriptor couldn't be waited on, test files
+	// among them. Keep reading them while there's nothing else to do.
+	// A test file is dropped from here when it runs out.
+	std::vector<unsigned int> polled;
+
+	// the refresh interval the timer was last armed with.
+	unsigned int armed_intvl;
+};
+
+#endif
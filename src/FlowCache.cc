@@ -0,0 +1,173 @@
+/*
+ *  The code in this file is part of tcptrack. For more information see
+ *    http://www.rhythm.cx/~steve/devel/tcptrack
+ *
+ *     Copyright (C) Steve Benson - 2003
+ *
+ *  tcptrack is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your
+ *  option) any later version.
+ *
+ *  tcptrack is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GNU Make; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#include "../config.h"
+#include <string.h>
+#include "FlowCache.h"
+#include "TCContainer.h"
+#include "headers.h"
+
+FlowCache::FlowCache()
+{
+	memset( table, 0, sizeof(table) );
+	gettimeofday( &lastflush, NULL );
+}
+
+static uint32_t key_hash( const struct tcckey &k )
+{
+	const uint32_t *w = (const uint32_t *) &k;
+	uint32_t h = 2166136261U;
+	for( unsigned int i=0; i<sizeof(k)/4; i++ )
+		h = (h ^ w[i]) * 16777619U;
+	return h ^ (h >> 15);
+}
+
+bool FlowCache::absorb( const u_char *p, const struct timeval &ts,
+	unsigned int weight )
+{
+	struct tcckey k;
+	memset( &k, 0, sizeof(k) );
+	const struct sniff_tcp *tcp;
+	uint64_t iplen;
+
+	const struct sniff_ip *ip = (const struct sniff_ip *) p;
+	if( ip->ip_v == 6 )
+	{
+		const struct sniff_ip6 *ip6 = (const struct sniff_ip6 *) p;
+		k.family = 6;
+		k.srcaddr = ip6->ip_src;
+		k.dstaddr = ip6->ip_dst;
+		tcp = (const struct sniff_tcp *) (p + IP6_HEADER_LEN);
+		iplen = htons(ip6->ip_len); // as TCPPacket::totalLen() has it
+	}
+	else
+	{
+		k.family = 4;
+		memcpy( &k.srcaddr, &ip->ip_src, sizeof(ip->ip_src) );
+		memcpy( &k.dstaddr, &ip->ip_dst, sizeof(ip->ip_dst) );
+		tcp = (const struct sniff_tcp *) (p + ip->ip_hl*4);
+		iplen = ntohs(ip->ip_len);
+	}
+	k.srcport = ntohs(tcp->th_sport);
+	k.dstport = ntohs(tcp->th_dport);
+
+	struct tcckey r = k;
+	r.srcaddr = k.dstaddr;
+	r.dstaddr = k.srcaddr;
+	r.srcport = k.dstport;
+	r.dstport = k.srcport;
+
+	struct flowent *e = &table[ key_hash(k) & (FLOWCACHE_SIZE-1) ];
+	struct flowent *re = &table[ key_hash(r) & (FLOWCACHE_SIZE-1) ];
+	bool mine = e->used && memcmp( &e->key, &k, sizeof(k) ) == 0;
+	bool rmine = re->used && memcmp( &re->key, &r, sizeof(r) ) == 0;
+
+	// anything that can change the connection's state goes the full
+	// way, and both directions have to be confirmed again afterwards:
+	// the ACK that closes a connection comes from the other side. Until
+	// a FIN or RST has been through the container, it may still say the
+	// connection is established, so both directions are held back.
+	if( tcp->th_flags & (TH_SYN|TH_FIN|TH_RST) )
+	{
+		bool closing = tcp->th_flags & (TH_FIN|TH_RST);
+		if( !mine && !e->used && closing )
+		{
+			claim( e, k );
+			mine = true;
+		}
+		if( mine )
+		{
+			e->established = false;
+			e->closing = e->closing || closing;
+		}
+		if( rmine )
+		{
+			re->established = false;
+			re->closing = re->closing || closing;
+		}
+		return false;
+	}
+
+	if( mine && e->established )
+	{
+		e->bytes += iplen * weight;
+		e->packets += weight;
+		e->last = ts;
+		e->idle = 0;
+		return true;
+	}
+
+	// a new flow. Let the container see this packet and ask it about
+	// the flow at the next flush. If the slot is taken, the flow just
+	// isn't cached.
+	if( !e->used )
+	{
+		claim( e, k );
+		// the other direction may be waiting on a FIN.
+		e->closing = rmine && re->closing;
+	}
+	return false;
+}
+
+void FlowCache::claim( struct flowent *e, const struct tcckey &k )
+{
+	e->key = k;
+	e->used = true;
+	e->established = false;
+	e->closing = false;
+	e->idle = 0;
+	e->bytes = e->packets = 0;
+	e->conn = NULL;
+	e->conngen = 0;
+}
+
+bool FlowCache::due()
+{
+	struct timeval now;
+	gettimeofday( &now, NULL );
+	int64_t usec = (int64_t)(now.tv_sec - lastflush.tv_sec) * 1000000
+		+ (now.tv_usec - lastflush.tv_usec);
+	return usec >= FLOWCACHE_FLUSH || usec < 0;
+}
+
+void FlowCache::flush( TCContainer *c, unsigned int iface )
+{
+	gettimeofday( &lastflush, NULL );
+
+	for( unsigned int i=0; i<FLOWCACHE_SIZE; i++ )
+	{
+		struct flowent *e = &table[i];
+		if( e->used && e->packets == 0 && ++e->idle > FLOWCACHE_IDLE )
+			e->used = false;
+	}
+
+	c->applyFlows( table, FLOWCACHE_SIZE, iface );
+
+	for( unsigned int i=0; i<FLOWCACHE_SIZE; i++ )
+	{
+		struct flowent *e = &table[i];
+		e->bytes = e->packets = 0;
+		// flows still waiting on a FIN stay until they go idle, so
+		// the other direction can't be established in the meantime.
+		if( e->used && !e->established && !e->closing )
+			e->used = false;
+	}
+}
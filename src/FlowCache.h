@@ -0,0 +1,106 @@
+/*
+ *  The code in this file is part of tcptrack. For more information see
+ *    http://www.rhythm.cx/~steve/devel/tcptrack
+ *
+ *     Copyright (C) Steve Benson - 2003
+ *
+ *  tcptrack is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your
+ *  option) any later version.
+ *
+ *  tcptrack is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GNU Make; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#ifndef FLOWCACHE_H
+#define FLOWCACHE_H 1
+
+#include "../config.h"
+#include <sys/types.h>
+#include <sys/time.h>
+#include <stdint.h>
+#include <time.h>
+#include "TCCSnapshot.h"
+
+class TCContainer;
+class TCPConnection;
+
+// number of flows the cache holds. Must be a power of 2.
+#define FLOWCACHE_SIZE 4096
+// how often counts are handed to the TCContainer, in usec.
+#define FLOWCACHE_FLUSH 10000
+// established flows with no packets for this many flushes make room.
+#define FLOWCACHE_IDLE 100
+
+// a flow in the cache. key is the same compact key the snapshots use,
+// with direction: the two directions of a connection are two flows.
+struct flowent
+{
+	struct tcckey key;
+	bool used;
+	// the TCContainer has an established connection for this flow, so
+	// its packets can just be counted here.
+	bool established;
+	// a FIN or RST of the connection went the full way and may not
+	// have reached the TCContainer yet. The flow isn't established again
+	// until the container's state for it has moved on, or it goes idle.
+	bool closing;
+	unsigned int idle; // flushes since the last packet
+
+	// the connection, as the TCContainer last found it. Only good while
+	// the container's removal count is still conngen.
+	TCPConnection *conn;
+	unsigned long conngen;
+
+	// counts not handed to the TCContainer yet.
+	uint64_t bytes;
+	uint64_t packets;
+	// capture time of the last packet counted.
+	struct timeval last;
+};
+
+/* FlowCache sits in the capture thread, in front of getnlp(). Most
+ * packets belong to established connections and only change their byte
+ * and packet counts. Once the TCContainer has confirmed that a flow is
+ * established, its packets are counted here without being copied, queued
+ * or parsed any further, and the counts are handed over every
+ * FLOWCACHE_FLUSH usec.
+ *
+ * Packets with SYN, FIN or RST set, and packets of flows the cache
+ * doesn't know, still take the full path through PacketBuffer and
+ * TCContainer::processPacket().
+ *
+ * Only the capture thread uses a FlowCache.
+ */
+class FlowCache
+{
+public:
+	FlowCache();
+
+	// returns true if the network layer packet at p, which must have
+	// passed check_nl(), was counted here and needs nothing more done
+	// with it. weight is how many packets it stands for, if sampling.
+	bool absorb( const u_char *p, const struct timeval &ts,
+		unsigned int weight=1 );
+
+	// has FLOWCACHE_FLUSH passed since the last flush?
+	bool due();
+	// hand counts to c and find out which flows are established.
+	// iface is the -i interface the counts were taken on.
+	void flush( TCContainer *c, unsigned int iface=0 );
+
+private:
+	void claim( struct flowent *e, const struct tcckey &k );
+
+	struct flowent table[FLOWCACHE_SIZE];
+	struct timeval lastflush;
+};
+
+#endif
@@ -0,0 +1,385 @@
+/*
+ *  The code in this file is part of tcptrack. For more information see
+ *    http://www.rhythm.cx/~steve/devel/tcptrack
+ *
+ *     Copyright (C) Steve Benson - 2003
+ *
+ *  tcptrack is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your
+ *  option) any later version.
+ *
+ *  tcptrack is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GNU Make; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#include <string.h>
+#include <arpa/inet.h>
+#include "Generator.h"
+
+// there are GEN_CLIENTS client addresses, which use the ephemeral ports
+// from GEN_CLIENTPORT on, GEN_CLIENTPORTS of them.
+#define GEN_CLIENTS 65534
+#define GEN_CLIENTPORT 32768
+#define GEN_CLIENTPORTS 28232
+
+// the services connections go to. The more often a port is listed, the
+// more connections it gets.
+static const uint16_t server_ports[] =
+	{ 443, 443, 443, 443, 80, 80, 22, 25, 53, 3306, 5432, 6379, 8080 };
+#define NSERVER_PORTS (sizeof(server_ports)/sizeof(server_ports[0]))
+
+// where a SYN flood is aimed.
+#define GEN_FLOOD_PORT 80
+
+static const u_char client_mac[ETHER_ADDR_LEN] = { 2, 0, 0, 0, 0, 1 };
+static const u_char server_mac[ETHER_ADDR_LEN] = { 2, 0, 0, 0, 0, 2 };
+
+// adds up 16 bit words for the internet checksum.
+static uint32_t sum16( const u_char *p, unsigned int len, uint32_t sum )
+{
+	for( unsigned int i=0; i+1<len; i+=2 )
+		sum += (p[i] << 8) | p[i+1];
+	if( len & 1 )
+		sum += p[len-1] << 8;
+	return sum;
+}
+
+// folds a sum16() into a checksum, in network byte order.
+static uint16_t fold( uint32_t sum )
+{
+	while( sum >> 16 )
+		sum = (sum & 0xffff) + (sum >> 16);
+	return htons( ~sum & 0xffff );
+}
+
+Generator::Generator( const struct genconf &c )
+{
+	cf = c;
+
+	// splitmix64, so that nearby seeds don't start out alike.
+	uint64_t z = cf.seed + 0x9e3779b97f4a7c15ULL;
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	rng = z ^ (z >> 31);
+	if( rng == 0 )
+		rng = 1;
+
+	origin = (uint64_t)cf.start * 1000000;
+	stop = origin + (uint64_t)cf.duration * 1000000;
+	pktgap = cf.pps > 0 ? (uint64_t)cf.conns * 1000000 / cf.pps : 0;
+	life = cf.churn > 0 ? (uint64_t)(cf.conns * 1000000 / cf.churn) : 0;
+
+	totalweight = 0;
+	for( unsigned int i=0; i<cf.sizes.size(); i++ )
+		totalweight += cf.sizes[i].weight;
+
+	order = 0;
+	nextid = 0;
+	npackets = nbytes = nconns = 0;
+	memset( pkt, 0, sizeof(pkt) );
+	pktlen = 0;
+
+	// the connections open when the capture starts. Those that aren't
+	// mid-stream do their handshakes during the first second.
+	for( unsigned int i=0; i<cf.conns; i++ )
+		open( origin + random() % 1000000, true );
+
+	if( cf.churn > 0 )
+		schedule( origin + gap(1000000 / cf.churn), GE_OPEN );
+	if( cf.flood > 0 )
+		schedule( origin + gap(1000000 / cf.flood), GE_FLOOD );
+}
+
+// xorshift64*
+uint64_t Generator::random()
+{
+	rng ^= rng >> 12;
+	rng ^= rng << 25;
+	rng ^= rng >> 27;
+	return rng * 2685821657736338717ULL;
+}
+
+// a random wait averaging mean usec.
+uint64_t Generator::gap( uint64_t mean )
+{
+	return random() % (2*mean + 1);
+}
+
+unsigned int Generator::pickSize()
+{
+	unsigned int r = random() % totalweight;
+	unsigned int i = 0;
+	while( r >= cf.sizes[i].weight )
+		r -= cf.sizes[i++].weight;
+	return cf.sizes[i].size;
+}
+
+void Generator::schedule( uint64_t t, uint32_t slot )
+{
+	genevent e;
+	e.t = t;
+	e.order = order++;
+	e.slot = slot;
+	events.push(e);
+}
+
+// start a connection at time t.
+void Generator::open( uint64_t t, bool initial )
+{
+	uint32_t s;
+	if( ! freeslots.empty() )
+	{
+		s = freeslots.back();
+		freeslots.pop_back();
+	}
+	else
+	{
+		s = slots.size();
+		slots.push_back( genconn() );
+	}
+
+	genconn &c = slots[s];
+	c.id = nextid++;
+	c.v6 = percent() < cf.ipv6;
+	c.server = random() % GEN_SERVERS;
+	c.dport = server_ports[ random() % NSERVER_PORTS ];
+	c.seq[0] = random();
+	c.seq[1] = random();
+	c.rtt = 1000 + random() % 99000;
+	c.incomplete = !initial && percent() < cf.incomplete;
+	c.end = cf.churn > 0 ? t + gap(life) : UINT64_MAX;
+	++nconns;
+
+	if( percent() < cf.midstream )
+	{
+		c.step = GS_DATA;
+		schedule( t + gap(pktgap), s );
+	}
+	else
+	{
+		c.step = GS_SYN;
+		schedule( t, s );
+	}
+}
+
+// send whatever connection slot sends next, at time t.
+void Generator::step( uint64_t t, uint32_t slot )
+{
+	genconn &c = slots[slot];
+
+	if( c.step == GS_DATA && t >= c.end )
+		c.step = GS_FIN;
+
+	uint64_t next = t + c.rtt/2;
+	switch( c.step )
+	{
+	case GS_SYN:
+		build( c, 0, TH_SYN, 0 );
+		c.seq[0]++;
+		// half the incomplete handshakes go unanswered, the rest
+		// stop at the SYN-ACK.
+		if( c.incomplete && (random() & 1) )
+			c.step = GS_DONE;
+		else
+			c.step = GS_SYNACK;
+		break;
+	case GS_SYNACK:
+		build( c, 1, TH_SYN|TH_ACK, 0 );
+		c.seq[1]++;
+		c.step = c.incomplete ? GS_DONE : GS_ACK;
+		break;
+	case GS_ACK:
+		build( c, 0, TH_ACK, 0 );
+		c.step = GS_DATA;
+		next = pktgap > 0 ? t + gap(pktgap) : c.end;
+		break;
+	case GS_DATA:
+	{
+		// servers send two packets for every one from the client.
+		int dir = random() % 3 ? 1 : 0;
+		unsigned int size = pickSize();
+		build( c, dir, size > 0 ? TH_ACK|TH_PUSH : TH_ACK, size );
+		c.seq[dir] += size;
+		next = pktgap > 0 ? t + gap(pktgap) : c.end;
+		if( next > c.end )
+			next = c.end;
+		break;
+	}
+	case GS_FIN:
+		build( c, 0, TH_FIN|TH_ACK, 0 );
+		c.seq[0]++;
+		c.step = GS_FINACK;
+		break;
+	case GS_FINACK:
+		build( c, 1, TH_FIN|TH_ACK, 0 );
+		c.seq[1]++;
+		c.step = GS_LASTACK;
+		break;
+	case GS_LASTACK:
+		build( c, 0, TH_ACK, 0 );
+		c.step = GS_DONE;
+		break;
+	}
+
+	if( c.step == GS_DONE )
+		freeslots.push_back(slot);
+	else
+		schedule( next, slot );
+}
+
+// a SYN from a made up client that never answers.
+void Generator::flood( uint64_t t )
+{
+	genconn c;
+	c.id = random();
+	c.v6 = percent() < cf.ipv6;
+	c.server = 0;
+	c.dport = GEN_FLOOD_PORT;
+	c.seq[0] = random();
+	c.seq[1] = 0;
+	build( c, 0, TH_SYN, 0 );
+}
+
+// the client's address, then the server's. 4 bytes each for IPv4, 16
+// for IPv6.
+void Generator::buildAddrs( const struct genconn &c, u_char *cli, u_char *srv )
+{
+	// every connection gets its own client address and port pair, so
+	// no two open at once can be mistaken for each other.
+	uint64_t host = 1 + c.id % GEN_CLIENTS;
+	if( c.v6 )
+	{
+		// fd00::/8 for clients, 2001:db8::/32 for servers.
+		memset( cli, 0, 16 );
+		cli[0] = 0xfd;
+		cli[14] = host >> 8;
+		cli[15] = host;
+		memset( srv, 0, 16 );
+		srv[0] = 0x20; srv[1] = 0x01; srv[2] = 0x0d; srv[3] = 0xb8;
+		srv[15] = 1 + c.server;
+	}
+	else
+	{
+		// 10.0.0.0/16 for clients, 192.0.2.0/24 for servers.
+		cli[0] = 10;
+		cli[1] = 0;
+		cli[2] = host >> 8;
+		cli[3] = host;
+		srv[0] = 192; srv[1] = 0; srv[2] = 2;
+		srv[3] = 1 + c.server;
+	}
+}
+
+void Generator::build( const struct genconn &c, int dir, uint8_t flags,
+		unsigned int payload )
+{
+	// the payload is all zeros. Only the headers are ever written, so
+	// clearing the most they can take up keeps it that way.
+	memset( pkt, 0, ENET_HEADER_LEN + IP6_HEADER_LEN + TCP_HEADER_LEN );
+
+	u_char cli[16], srv[16];
+	buildAddrs( c, cli, srv );
+	const u_char *src = dir ? srv : cli;
+	const u_char *dst = dir ? cli : srv;
+	uint16_t cport = GEN_CLIENTPORT + c.id / GEN_CLIENTS % GEN_CLIENTPORTS;
+	unsigned int alen = c.v6 ? 16 : 4;
+	unsigned int tcplen = TCP_HEADER_LEN + payload;
+
+	struct sniff_ethernet *eth = (struct sniff_ethernet *)pkt;
+	memcpy( eth->ether_dhost, dir ? client_mac : server_mac, ETHER_ADDR_LEN );
+	memcpy( eth->ether_shost, dir ? server_mac : client_mac, ETHER_ADDR_LEN );
+
+	u_char *ip = pkt + ENET_HEADER_LEN;
+	u_char *th;
+	if( c.v6 )
+	{
+		eth->ether_type = htons(ETHERTYPE_IPV6);
+		uint32_t vtf = htonl( 6U << 28 );
+		uint16_t plen = htons( tcplen );
+		memcpy( ip, &vtf, 4 );
+		memcpy( ip+4, &plen, 2 );
+		ip[6] = IPPROTO_TCP;
+		ip[7] = 64;
+		memcpy( ip+8, src, 16 );
+		memcpy( ip+24, dst, 16 );
+		th = ip + IP6_HEADER_LEN;
+	}
+	else
+	{
+		eth->ether_type = htons(ETHERTYPE_IP);
+		struct sniff_ip *ip4 = (struct sniff_ip *)ip;
+		ip4->ip_v = 4;
+		ip4->ip_hl = IP_HEADER_LEN / 4;
+		ip4->ip_len = htons( IP_HEADER_LEN + tcplen );
+		ip4->ip_id = htons( npackets );
+		ip4->ip_off = htons( IP_DF );
+		ip4->ip_ttl = 64;
+		ip4->ip_p = IPPROTO_TCP;
+		memcpy( &ip4->ip_src, src, 4 );
+		memcpy( &ip4->ip_dst, dst, 4 );
+		ip4->ip_sum = fold( sum16(ip, IP_HEADER_LEN, 0) );
+		th = ip + IP_HEADER_LEN;
+	}
+
+	struct sniff_tcp *tcp = (struct sniff_tcp *)th;
+	tcp->th_sport = htons( dir ? c.dport : cport );
+	tcp->th_dport = htons( dir ? cport : c.dport );
+	tcp->th_seq = htonl( c.seq[dir] );
+	if( flags & TH_ACK )
+		tcp->th_ack = htonl( c.seq[!dir] );
+	tcp->th_off = TCP_HEADER_LEN / 4;
+	tcp->th_flags = flags;
+	tcp->th_win = htons( 65535 );
+
+	// the pseudo header, then the segment. The zeros in the payload
+	// don't add anything.
+	uint32_t sum = sum16( src, alen, 0 );
+	sum = sum16( dst, alen, sum );
+	sum += IPPROTO_TCP + tcplen;
+	tcp->th_sum = fold( sum16(th, TCP_HEADER_LEN, sum) );
+
+	pktlen = (th - pkt) + tcplen;
+}
+
+bool Generator::next( struct pcap_pkthdr *h, const u_char **data )
+{
+	while( ! events.empty() )
+	{
+		genevent e = events.top();
+		if( e.t >= stop )
+			return false;
+		events.pop();
+
+		pktlen = 0;
+		if( e.slot == GE_OPEN )
+		{
+			open( e.t, false );
+			schedule( e.t + 1 + gap(1000000 / cf.churn), GE_OPEN );
+			continue;
+		}
+		if( e.slot == GE_FLOOD )
+		{
+			flood( e.t );
+			schedule( e.t + 1 + gap(1000000 / cf.flood), GE_FLOOD );
+		}
+		else
+			step( e.t, e.slot );
+
+		h->ts.tv_sec = e.t / 1000000;
+		h->ts.tv_usec = e.t % 1000000;
+		h->len = pktlen;
+		h->caplen = pktlen < cf.snaplen ? pktlen : cf.snaplen;
+		*data = pkt;
+		++npackets;
+		nbytes += pktlen;
+		return true;
+	}
+	return false;
+}
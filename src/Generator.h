@@ -0,0 +1,179 @@
+/*
+ *  The code in this file is part of tcptrack. For more information see
+ *    http://www.rhythm.cx/~steve/devel/tcptrack
+ *
+ *     Copyright (C) Steve Benson - 2003
+ *
+ *  tcptrack is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your
+ *  option) any later version.
+ *
+ *  tcptrack is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GNU Make; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#ifndef GENERATOR_H
+#define GENERATOR_H 1
+
+#include "../config.h"
+#include <sys/types.h>
+#include <stdint.h>
+#include <vector>
+#include <queue>
+#include "headers.h"
+#ifdef HAVE_PCAP_PCAP_H
+#include <pcap/pcap.h>
+#endif
+#ifdef HAVE_PCAP_H
+#include <pcap.h>
+#endif
+
+// the largest TCP payload a packet can be given.
+#define GEN_MAXSIZE 9000
+
+// how many server addresses connections are spread over.
+#define GEN_SERVERS 64
+
+// one entry in the payload size mix: packets of size bytes, picked with
+// the given weight.
+struct gensize
+{
+	unsigned int size;
+	unsigned int weight;
+};
+
+// what a Generator makes. The percentages are of connections.
+struct genconf
+{
+	uint64_t seed;
+	time_t start;            // capture time of the first packet
+	unsigned int duration;   // seconds of traffic
+	unsigned int conns;      // connections open at once
+	double churn;            // new connections per second
+	unsigned int pps;        // packets per second over all connections
+	std::vector<struct gensize> sizes;
+	unsigned int midstream;  // already open, with no handshake seen
+	unsigned int incomplete; // attempts whose handshake never finishes
+	unsigned int ipv6;       // over IPv6 instead of IPv4
+	unsigned int flood;      // spoofed SYNs per second, on top
+	unsigned int snaplen;    // bytes of each packet kept
+};
+
+/* A Generator makes up ethernet/IP/TCP traffic for benchmarks, for when
+ * real captures can't be shared. It keeps genconf::conns connections
+ * open, closing old ones and opening new ones at genconf::churn per
+ * second so each lives about conns/churn seconds. Each connection does a
+ * full handshake unless it starts mid-stream or its handshake is left
+ * incomplete, sends its share of genconf::pps packets with payload sizes
+ * picked from the mix, and closes with FINs. Spoofed SYNs can be mixed
+ * in, as in a SYN flood.
+ *
+ * Everything comes from one random number generator seeded with
+ * genconf::seed, so the same genconf always gives the same packets,
+ * byte for byte, on any build.
+ *
+ * Packets are handed out the same way CapFile does it, so the traffic
+ * can be written to a file (see tcptrack-gen) or fed straight to
+ * whatever reads a CapFile.
+ */
+class Generator
+{
+public:
+	Generator( const struct genconf &cf );
+
+	// the link type of the packets handed out.
+	int linktype() const { return DLT_EN10MB; }
+
+	// the next packet. data stays valid until the next call. Returns
+	// false once genconf::duration seconds of traffic have been made.
+	bool next( struct pcap_pkthdr *h, const u_char **data );
+
+	// what has been made so far.
+	uint64_t packets() const { return npackets; }
+	uint64_t bytes() const { return nbytes; }
+	uint64_t connections() const { return nconns; }
+
+private:
+	// what a connection sends next.
+	enum genstep
+	{
+		GS_SYN, GS_SYNACK, GS_ACK, GS_DATA,
+		GS_FIN, GS_FINACK, GS_LASTACK, GS_DONE
+	};
+
+	struct genconn
+	{
+		uint64_t id;        // picks the client address and port
+		uint32_t seq[2];    // next sequence number, client and server
+		uint64_t end;       // when it starts closing (usec)
+		uint32_t rtt;       // usec
+		unsigned char step;
+		unsigned char v6;
+		unsigned char server;
+		unsigned char incomplete;
+		uint16_t dport;
+	};
+
+	// a packet to send. slot is a connection, or one of the GE_ kinds.
+	struct genevent
+	{
+		uint64_t t;
+		uint64_t order; // breaks ties, so the order never varies
+		uint32_t slot;
+		bool operator>( const genevent &o ) const
+		{
+			return t != o.t ? t > o.t : order > o.order;
+		}
+	};
+	static const uint32_t GE_OPEN = 0xffffffff;
+	static const uint32_t GE_FLOOD = 0xfffffffe;
+
+	void schedule( uint64_t t, uint32_t slot );
+	void open( uint64_t t, bool initial );
+	void step( uint64_t t, uint32_t slot );
+	void flood( uint64_t t );
+	unsigned int pickSize();
+	uint64_t gap( uint64_t mean );
+
+	// writes a packet into pkt. dir is 0 from the client, 1 from the
+	// server.
+	void build( const struct genconn &c, int dir, uint8_t flags,
+			unsigned int payload );
+	void buildAddrs( const struct genconn &c, u_char *src, u_char *dst );
+
+	uint64_t random();
+	unsigned int percent() { return random() % 100; }
+
+	struct genconf cf;
+	uint64_t rng;
+	uint64_t origin;    // genconf::start in usec
+	uint64_t stop;      // when the traffic ends (usec)
+	uint64_t pktgap;    // mean usec between one connection's packets
+	uint64_t life;      // mean connection lifetime (usec)
+	unsigned int totalweight;
+
+	std::vector<struct genconn> slots;
+	std::vector<uint32_t> freeslots;
+	std::priority_queue<genevent, std::vector<genevent>,
+		std::greater<genevent> > events;
+	uint64_t order;
+
+	uint64_t nextid;
+	uint64_t npackets;
+	uint64_t nbytes;
+	uint64_t nconns;
+
+	u_char pkt[ENET_HEADER_LEN + IP6_HEADER_LEN + TCP_HEADER_LEN
+		+ GEN_MAXSIZE];
+	unsigned int pktlen;
+	uint64_t pktts;
+};
+
+#endif
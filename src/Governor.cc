@@ -0,0 +1,143 @@
+/*
+ *  The code in this file is part of tcptrack. For more information see
+ *    http://www.rhythm.cx/~steve/devel/tcptrack
+ *
+ *     Copyright (C) Steve Benson - 2003
+ *
+ *  tcptrack is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your
+ *  option) any later version.
+ *
+ *  tcptrack is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GNU Make; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#include "Governor.h"
+#include "TCPTrack.h"
+#include "defs.h"
+
+extern TCPTrack *app;
+
+Governor::Governor()
+{
+	enabled = true;
+	cur = GOV_NORMAL;
+	calm = 0;
+	max_backlog = 0;
+	max_lag = 0;
+	slow_refresh = 0;
+}
+
+static void raise_to( std::atomic<uint64_t> &m, uint64_t v )
+{
+	uint64_t old = m;
+	while( v > old && !m.compare_exchange_weak(old, v) )
+		;
+}
+
+void Governor::observe( uint64_t backlog, uint64_t lag )
+{
+	raise_to( max_backlog, backlog );
+	raise_to( max_lag, lag );
+}
+
+void Governor::step()
+{
+	uint64_t backlog = max_backlog.exchange(0);
+	uint64_t lag = max_lag.exchange(0);
+
+	if( !enabled )
+		return;
+
+	if( backlog > GOV_BACKLOG_HIGH || lag > GOV_LAG_HIGH )
+	{
+		calm = 0;
+		if( cur < GOV_MAXLEVEL )
+			setLevel( cur+1 );
+	}
+	else if( backlog < GOV_BACKLOG_LOW && lag < GOV_LAG_LOW )
+	{
+		if( cur > GOV_NORMAL && ++calm >= GOV_CALM )
+		{
+			calm = 0;
+			setLevel( cur-1 );
+		}
+	}
+	else
+		calm = 0;
+}
+
+void Governor::setLevel( int level )
+{
+	if( cur == GOV_NORMAL )
+	{
+		base_detect = app->detect;
+		base_names = app->names;
+		base_sample = app->sampler.packetRate();
+	}
+
+	app->detect = level >= GOV_NODETECT ? false : base_detect;
+	app->names = level >= GOV_NONAMES ? false : base_names;
+
+	if( level >= GOV_SAMPLING && base_sample < GOV_SAMPLE )
+		app->sampler.packets( GOV_SAMPLE );
+	else
+		app->sampler.packets( base_sample );
+
+	// only touch the refresh interval when entering or leaving
+	// GOV_SLOW. If it was changed with +/- in between, that change is
+	// kept and only the slowdown is taken back out. +/- can come from
+	// the display thread at any time, so each change is made with a
+	// compare and swap against the value it was worked out from.
+	if( level == GOV_SLOW && cur < GOV_SLOW )
+	{
+		unsigned int r = app->refresh_intvl;
+		unsigned int n;
+		do
+		{
+			n = r * GOV_SLOWDOWN;
+			if( n > 32000000 )
+				n = 32000000;
+		} while( !app->refresh_intvl.compare_exchange_weak(r, n) );
+		base_refresh = r;
+		slow_refresh = n;
+	}
+	else if( level < GOV_SLOW && cur == GOV_SLOW )
+	{
+		unsigned int r = app->refresh_intvl;
+		unsigned int n;
+		do
+		{
+			if( r == slow_refresh )
+				n = base_refresh;
+			else
+			{
+				n = r / GOV_SLOWDOWN;
+				if( n < 31250 )
+					n = 31250;
+			}
+		} while( !app->refresh_intvl.compare_exchange_weak(r, n) );
+	}
+
+	cur = level;
+}
+
+const char * Governor::levelName( int level )
+{
+	switch( level )
+	{
+		case GOV_NORMAL: return "normal";
+		case GOV_NODETECT: return "detection off";
+		case GOV_NONAMES: return "name lookups off";
+		case GOV_SAMPLING: return "sampling";
+		case GOV_SLOW: return "slow refresh";
+	}
+	return "?";
+}
@@ -0,0 +1,82 @@
+/*
+ *  The code in this file is part of tcptrack. For more information see
+ *    http://www.rhythm.cx/~steve/devel/tcptrack
+ *
+ *     Copyright (C) Steve Benson - 2003
+ *
+ *  tcptrack is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your
+ *  option) any later version.
+ *
+ *  tcptrack is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GNU Make; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#ifndef GOVERNOR_H
+#define GOVERNOR_H 1
+
+#include <stdint.h>
+#include <atomic>
+
+// load shedding levels. Each level includes the ones before it.
+#define GOV_NORMAL 0   // nothing shed
+#define GOV_NODETECT 1 // don't detect connections that started earlier
+#define GOV_NONAMES 2  // don't look up names of new connections
+#define GOV_SAMPLING 3 // sample 1 in GOV_SAMPLE packets
+#define GOV_SLOW 4     // refresh GOV_SLOWDOWN times less often
+#define GOV_MAXLEVEL 4
+
+/* Governor sheds load when packets come in faster than they can be
+ * accounted. The stages that queue packets report how far behind they
+ * are with observe(). Once per refresh interval step() looks at the worst
+ * of those reports and moves at most one level up or down.
+ *
+ * Moving up turns features off in the order above; moving down turns them
+ * back on as they were set when the governor first stepped in.
+ */
+class Governor
+{
+public:
+	Governor();
+
+	// turn the governor off. It then stays at GOV_NORMAL.
+	void disable() { enabled = false; }
+
+	// backlog is the number of packets waiting, lag how long the oldest
+	// of them has waited in usec. Can be called from any thread.
+	void observe( uint64_t backlog, uint64_t lag );
+
+	// called once per refresh interval.
+	void step();
+
+	int level() const { return cur; }
+	static const char * levelName( int level );
+
+private:
+	void setLevel( int level );
+
+	bool enabled;
+	std::atomic<int> cur;
+	int calm; // intervals in a row under the LOW marks
+
+	// the worst seen since the last step().
+	std::atomic<uint64_t> max_backlog;
+	std::atomic<uint64_t> max_lag;
+
+	// the settings before the governor stepped in.
+	bool base_detect;
+	bool base_names;
+	unsigned int base_sample;
+	// the refresh interval before GOV_SLOW slowed it, and what it set.
+	unsigned int base_refresh;
+	unsigned int slow_refresh;
+};
+
+#endif
@@ -0,0 +1,227 @@
+/*
+ *  The code in this file is part of tcptrack. For more information see
+ *    http://www.rhythm.cx/~steve/devel/tcptrack
+ *
+ *     Copyright (C) Steve Benson - 2003
+ *
+ *  tcptrack is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your
+ *  option) any later version.
+ *
+ *  tcptrack is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GNU Make; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#define _DEFAULT_SOURCE 1
+#define _BSD_SOURCE 1
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/mman.h>
+#include "HugeMem.h"
+
+static bool huge_enabled = false;
+static struct hugestats stats;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// every mapping starts with one of these, so huge_unmap() knows its size
+// and which counter it came out of.
+struct hugehdr
+{
+	size_t len;
+	uint64_t *counter;
+	char pad[64 - sizeof(size_t) - sizeof(uint64_t *)];
+};
+
+void huge_setup( bool enable )
+{
+	huge_enabled = enable;
+	stats.enabled = enable;
+}
+
+struct hugestats huge_stats()
+{
+	assert( pthread_mutex_lock(&stats_lock) == 0 );
+	struct hugestats s = stats;
+	assert( pthread_mutex_unlock(&stats_lock) == 0 );
+	return s;
+}
+
+void * huge_map( size_t *len )
+{
+	size_t total = *len + sizeof(struct hugehdr);
+	total = (total + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+
+	void *p = MAP_FAILED;
+	uint64_t *counter = &stats.plain;
+
+#ifdef MAP_HUGETLB
+	p = mmap(NULL, total, PROT_READ|PROT_WRITE,
+		MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+	if( p != MAP_FAILED )
+		counter = &stats.hugetlb;
+#endif
+	if( p == MAP_FAILED )
+	{
+		p = mmap(NULL, total, PROT_READ|PROT_WRITE,
+			MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+		if( p == MAP_FAILED )
+			return NULL;
+#ifdef MADV_HUGEPAGE
+		if( madvise(p, total, MADV_HUGEPAGE) == 0 )
+			counter = &stats.thp;
+#endif
+	}
+
+	struct hugehdr *h = (struct hugehdr *) p;
+	h->len = total;
+	h->counter = counter;
+
+	assert( pthread_mutex_lock(&stats_lock) == 0 );
+	*counter += total;
+	assert( pthread_mutex_unlock(&stats_lock) == 0 );
+
+	*len = total - sizeof(struct hugehdr);
+	return h+1;
+}
+
+void huge_unmap( void *p )
+{
+	struct hugehdr *h = ((struct hugehdr *) p) - 1;
+
+	assert( pthread_mutex_lock(&stats_lock) == 0 );
+	*h->counter -= h->len;
+	assert( pthread_mutex_unlock(&stats_lock) == 0 );
+
+	munmap(h, h->len);
+}
+
+SlabPool::SlabPool( size_t objsize )
+{
+	// objects have to hold the free list link and stay aligned.
+	size = (objsize + 15) & ~(size_t)15;
+	freelist = NULL;
+	pthread_mutex_init( &lock, NULL );
+}
+
+// carve a new chunk into objects. Called with lock held.
+void SlabPool::grow()
+{
+	size_t len = HUGE_PAGE_SIZE - sizeof(struct hugehdr);
+	if( len < size )
+		len = size;
+
+	char *chunk = (char *) huge_map(&len);
+	if( chunk == NULL )
+		return;
+
+	for( size_t off = 0; off + size <= len; off += size )
+	{
+		*(void **)(chunk+off) = freelist;
+		freelist = chunk+off;
+	}
+}
+
+void * SlabPool::alloc()
+{
+	if( !huge_enabled )
+		return malloc(size);
+
+	assert( pthread_mutex_lock(&lock) == 0 );
+	if( freelist == NULL )
+		grow();
+	void *p = freelist;
+	if( p != NULL )
+		freelist = *(void **)p;
+	assert( pthread_mutex_unlock(&lock) == 0 );
+	return p;
+}
+
+void SlabPool::free( void *p )
+{
+	if( !huge_enabled )
+	{
+		::free(p);
+		return;
+	}
+
+	assert( pthread_mutex_lock(&lock) == 0 );
+	*(void **)p = freelist;
+	freelist = p;
+	assert( pthread_mutex_unlock(&lock) == 0 );
+}
+
+// size classes of 16 bytes up to HUGE_SMALL_MAX.
+static SlabPool *small_pools[HUGE_SMALL_MAX/16];
+static pthread_once_t small_once = PTHREAD_ONCE_INIT;
+
+// and power of two classes above that up to HUGE_MEDIUM_MAX.
+#define HUGE_MEDIUM_CLASSES 10
+static SlabPool *medium_pools[HUGE_MEDIUM_CLASSES];
+
+static void init_small_pools()
+{
+	for( int i=0; i<HUGE_SMALL_MAX/16; i++ )
+		small_pools[i] = new SlabPool( (i+1)*16 );
+	for( int i=0; i<HUGE_MEDIUM_CLASSES; i++ )
+		medium_pools[i] = new SlabPool( (size_t)HUGE_SMALL_MAX*2 << i );
+}
+
+// the medium class n bytes go in. HUGE_SMALL_MAX < n <= HUGE_MEDIUM_MAX.
+static int medium_class( size_t n )
+{
+	int c = 0;
+	while( ((size_t)HUGE_SMALL_MAX*2 << c) < n )
+		c++;
+	return c;
+}
+
+void * huge_alloc( size_t n )
+{
+	if( !huge_enabled )
+		return malloc(n);
+
+	if( n <= HUGE_SMALL_MAX )
+	{
+		pthread_once( &small_once, init_small_pools );
+		return small_pools[ n ? (n-1)/16 : 0 ]->alloc();
+	}
+
+	if( n <= HUGE_MEDIUM_MAX )
+	{
+		pthread_once( &small_once, init_small_pools );
+		return medium_pools[ medium_class(n) ]->alloc();
+	}
+
+	// a mapping of its own would waste most of a huge page.
+	if( n < HUGE_PAGE_SIZE )
+		return malloc(n);
+
+	size_t len = n;
+	return huge_map(&len);
+}
+
+void huge_free( void *p, size_t n )
+{
+	if( !huge_enabled )
+	{
+		free(p);
+		return;
+	}
+
+	if( n <= HUGE_SMALL_MAX )
+		small_pools[ n ? (n-1)/16 : 0 ]->free(p);
+	else if( n <= HUGE_MEDIUM_MAX )
+		medium_pools[ medium_class(n) ]->free(p);
+	else if( n < HUGE_PAGE_SIZE )
+		free(p);
+	else
+		huge_unmap(p);
+}
@@ -0,0 +1,130 @@
+/*
+ *  The code in this file is part of tcptrack. For more information see
+ *    http://www.rhythm.cx/~steve/devel/tcptrack
+ *
+ *     Copyright (C) Steve Benson - 2003
+ *
+ *  tcptrack is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your
+ *  option) any later version.
+ *
+ *  tcptrack is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GNU Make; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#ifndef HUGEMEM_H
+#define HUGEMEM_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <new>
+
+// the huge page size we aim for.
+#define HUGE_PAGE_SIZE (2*1024*1024)
+
+// allocations up to this size go to size class pools.
+#define HUGE_SMALL_MAX 256
+// above that, power of two size classes up to this, carved out of shared
+// chunks. Blocks between this and HUGE_PAGE_SIZE come from malloc(), only
+// a huge page or more gets a mapping of its own.
+#define HUGE_MEDIUM_MAX (256*1024)
+
+/* With -H the connection table, connection objects and packet buffers are
+ * carved out of memory backed by huge pages, so that a big table takes
+ * far fewer TLB entries. Memory is mapped with MAP_HUGETLB if the system
+ * has huge pages reserved. Otherwise it is mapped normally and
+ * transparent huge pages are asked for with madvise().
+ *
+ * Without -H everything here falls through to malloc() and free().
+ */
+
+// how much memory is mapped, and how. For the statistics view.
+struct hugestats
+{
+	bool enabled;
+	uint64_t hugetlb;  // bytes in MAP_HUGETLB mappings
+	uint64_t thp;      // bytes mapped with MADV_HUGEPAGE advice
+	uint64_t plain;    // bytes that got neither
+};
+
+// turn huge pages on or off. Call before anything is allocated.
+void huge_setup( bool enable );
+struct hugestats huge_stats();
+
+// map at least *len bytes. *len is set to the usable size, which fills
+// up the pages. Returns NULL if nothing could be mapped.
+void * huge_map( size_t *len );
+void huge_unmap( void *p );
+
+// a pool of fixed size objects, carved out of huge_map()ed chunks and
+// never given back to the system. Safe to use from any thread.
+class SlabPool
+{
+public:
+	SlabPool( size_t objsize );
+
+	void * alloc();
+	void free( void *p );
+private:
+	void grow();
+
+	size_t size;
+	// freed objects, linked through their first word.
+	void *freelist;
+	pthread_mutex_t lock;
+};
+
+// allocation of n bytes from the size class pools or, for blocks of a
+// huge page or more, straight from huge_map().
+void * huge_alloc( size_t n );
+void huge_free( void *p, size_t n );
+
+// an STL allocator over huge_alloc(), for the containers that make up
+// the connection table.
+template <class T>
+class HugeAllocator
+{
+public:
+	typedef T value_type;
+	typedef T * pointer;
+	typedef const T * const_pointer;
+	typedef T & reference;
+	typedef const T & const_reference;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+
+	template <class U> struct rebind { typedef HugeAllocator<U> other; };
+
+	HugeAllocator() {}
+	template <class U> HugeAllocator( const HugeAllocator<U> & ) {}
+
+	pointer address( reference x ) const { return &x; }
+	const_pointer address( const_reference x ) const { return &x; }
+
+	pointer allocate( size_type n, const void * = 0 )
+	{
+		void *p = huge_alloc( n*sizeof(T) );
+		if( p == NULL )
+			throw std::bad_alloc();
+		return (pointer) p;
+	}
+	void deallocate( pointer p, size_type n ) { huge_free( p, n*sizeof(T) ); }
+
+	size_type max_size() const { return ((size_t)-1) / sizeof(T); }
+
+	void construct( pointer p, const T &v ) { new((void *)p) T(v); }
+	void destroy( pointer p ) { p->~T(); }
+
+	bool operator==( const HugeAllocator & ) const { return true; }
+	bool operator!=( const HugeAllocator & ) const { return false; }
+};
+
+#endif
@@ -0,0 +1,268 @@
+/*
+ *  The code in this file is part of tcptrack. For more information see
+ *    http://www.rhythm.cx/~steve/devel/tcptrack
+ *
+ *     Copyright (C) Steve Benson - 2003
+ *
+ *  tcptrack is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your
+ *  option) any later version.
+ *
+ *  tcptrack is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GNU Make; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#include "LinkLayer.h"
+
+#define ETHERTYPE_QINQ 0x88a8
+#define ETHERTYPE_QINQ_OLD 0x9100
+#define ETHERTYPE_MPLS 0x8847
+#define ETHERTYPE_MPLS_MCAST 0x8848
+#define ETHERTYPE_TEB 0x6558     // transparent Ethernet bridging, in GRE
+#define ETHERTYPE_ERSPAN2 0x88be
+#define ETHERTYPE_ERSPAN3 0x22eb
+
+#define VXLAN_PORT 4789
+#define VXLAN_HEADER_LEN 8
+#define UDP_HEADER_LEN 8
+#define GRE_HEADER_LEN 4
+#define ERSPAN2_HEADER_LEN 8
+#define ERSPAN3_HEADER_LEN 12
+#define ERSPAN3_SUBHEADER_LEN 8
+
+#ifndef IPPROTO_GRE
+#define IPPROTO_GRE 47
+#endif
+
+// the packet being parsed.
+struct decap
+{
+	const u_char *p;
+	unsigned int caplen;
+	int tunnels; // how many more tunnels may be entered
+};
+
+// a parser looks at the header at off. It returns how long the header is
+// and sets *next to the kind of header after it, HDR_NONE or HDR_DONE.
+typedef unsigned int (*decap_fn)( struct decap &d, unsigned int off, int *next );
+
+static inline bool have( const struct decap &d, unsigned int off, unsigned int n )
+{
+	return off + n <= d.caplen;
+}
+
+static inline uint16_t get16( const struct decap &d, unsigned int off )
+{
+	return (d.p[off] << 8) | d.p[off+1];
+}
+
+static unsigned int parse_ether( struct decap &d, unsigned int off, int *next )
+{
+	// skip the addresses. The ethertype is parsed on its own, since
+	// VLAN tags and cooked headers end with one too.
+	*next = HDR_ETHERTYPE;
+	return 2 * ETHER_ADDR_LEN;
+}
+
+static unsigned int parse_ethertype( struct decap &d, unsigned int off, int *next )
+{
+	*next = HDR_NONE;
+	if( !have(d, off, 2) )
+		return 0;
+
+	switch( get16(d, off) )
+	{
+		case ETHERTYPE_VLAN:
+		case ETHERTYPE_QINQ:
+		case ETHERTYPE_QINQ_OLD:
+			// the tag, then another ethertype.
+			*next = HDR_ETHERTYPE;
+			return VLAN_HEADER_LEN;
+		case ETHERTYPE_IP:
+		case ETHERTYPE_IPV6:
+			*next = HDR_IP;
+			return 2;
+		case ETHERTYPE_MPLS:
+		case ETHERTYPE_MPLS_MCAST:
+			*next = HDR_MPLS;
+			return 2;
+	}
+	return 0;
+}
+
+static unsigned int parse_mpls( struct decap &d, unsigned int off, int *next )
+{
+	*next = HDR_NONE;
+	if( !have(d, off, 4) )
+		return 0;
+
+	// after the bottom of the stack there's no type field. HDR_IP
+	// makes sure it looks like IP.
+	*next = ( d.p[off+2] & 1 ) ? HDR_IP : HDR_MPLS;
+	return 4;
+}
+
+static unsigned int parse_ip( struct decap &d, unsigned int off, int *next )
+{
+	*next = HDR_NONE;
+	if( !have(d, off, IP_HEADER_LEN) )
+		return 0;
+
+	unsigned int hlen;
+	u_char proto;
+	bool fragment = false;
+	switch( d.p[off] >> 4 )
+	{
+		case 4:
+			hlen = (d.p[off] & 0x0f) * 4;
+			if( hlen < IP_HEADER_LEN )
+				return 0;
+			proto = d.p[off+9];
+			// anything but the first fragment has no UDP or GRE
+			// header to look at.
+			fragment = ( get16(d, off+6) & 0x1fff ) != 0;
+			break;
+		case 6:
+			if( !have(d, off, IP6_HEADER_LEN) )
+				return 0;
+			hlen = IP6_HEADER_LEN;
+			proto = d.p[off+6];
+			break;
+		default:
+			return 0;
+	}
+
+	// the packet we want, or one check_nl() will turn down.
+	*next = HDR_DONE;
+	if( d.tunnels <= 0 || fragment )
+		return 0;
+
+	if( proto == IPPROTO_UDP && have(d, off+hlen, UDP_HEADER_LEN)
+		&& get16(d, off+hlen+2) == VXLAN_PORT )
+	{
+		--d.tunnels;
+		*next = HDR_VXLAN;
+		return hlen + UDP_HEADER_LEN;
+	}
+	if( proto == IPPROTO_GRE )
+	{
+		--d.tunnels;
+		*next = HDR_GRE;
+		return hlen;
+	}
+	return 0;
+}
+
+static unsigned int parse_gre( struct decap &d, unsigned int off, int *next )
+{
+	*next = HDR_NONE;
+	if( !have(d, off, GRE_HEADER_LEN) )
+		return 0;
+
+	u_char flags = d.p[off];
+	if( (d.p[off+1] & 0x07) != 0 ) // only version 0
+		return 0;
+
+	// checksum, key and sequence number, if present.
+	unsigned int len = GRE_HEADER_LEN;
+	if( flags & 0x80 )
+		len += 4;
+	if( flags & 0x20 )
+		len += 4;
+	if( flags & 0x10 )
+		len += 4;
+
+	switch( get16(d, off+2) )
+	{
+		case ETHERTYPE_IP:
+		case ETHERTYPE_IPV6:
+			*next = HDR_IP;
+			break;
+		case ETHERTYPE_TEB:
+			*next = HDR_ETHER;
+			break;
+		case ETHERTYPE_MPLS:
+			*next = HDR_MPLS;
+			break;
+		case ETHERTYPE_ERSPAN2:
+			*next = HDR_ERSPAN2;
+			break;
+		case ETHERTYPE_ERSPAN3:
+			*next = HDR_ERSPAN3;
+			break;
+	}
+	return len;
+}
+
+static unsigned int parse_vxlan( struct decap &d, unsigned int off, int *next )
+{
+	*next = HDR_NONE;
+	// the I flag says the VNI is valid.
+	if( !have(d, off, VXLAN_HEADER_LEN) || !(d.p[off] & 0x08) )
+		return 0;
+
+	*next = HDR_ETHER;
+	return VXLAN_HEADER_LEN;
+}
+
+static unsigned int parse_erspan2( struct decap &d, unsigned int off, int *next )
+{
+	*next = HDR_ETHER;
+	return ERSPAN2_HEADER_LEN;
+}
+
+static unsigned int parse_erspan3( struct decap &d, unsigned int off, int *next )
+{
+	*next = HDR_NONE;
+	if( !have(d, off, ERSPAN3_HEADER_LEN) )
+		return 0;
+
+	*next = HDR_ETHER;
+	// the O flag says a platform specific subheader follows.
+	if( d.p[off+ERSPAN3_HEADER_LEN-1] & 0x01 )
+		return ERSPAN3_HEADER_LEN + ERSPAN3_SUBHEADER_LEN;
+	return ERSPAN3_HEADER_LEN;
+}
+
+// indexed by HDR_* kind.
+static const decap_fn decap_table[HDR_KINDS] =
+{
+	parse_ether,
+	parse_ethertype,
+	parse_mpls,
+	parse_ip,
+	parse_gre,
+	parse_vxlan,
+	parse_erspan2,
+	parse_erspan3,
+};
+
+int decap_offset( const u_char *p, unsigned int caplen, unsigned int off,
+	int first, int tunnels )
+{
+	struct decap d;
+	d.p = p;
+	d.caplen = caplen;
+	d.tunnels = tunnels;
+
+	int kind = first;
+	for( int step=0; step<DECAP_MAXSTEPS; step++ )
+	{
+		int next;
+		unsigned int len = decap_table[kind]( d, off, &next );
+		if( next == HDR_DONE )
+			return off;
+		if( next == HDR_NONE )
+			return -1;
+		off += len;
+		kind = next;
+	}
+	return -1;
+}
@@ -0,0 +1,183 @@
+/*
+ *  The code in this file is part of tcptrack. For more information see
+ *    http://www.rhythm.cx/~steve/devel/tcptrack
+ *
+ *     Copyright (C) Steve Benson - 2003
+ *
+ *  tcptrack is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your
+ *  option) any later version.
+ *
+ *  tcptrack is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GNU Make; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#ifndef LINKLAYER_H
+#define LINKLAYER_H 1
+
+#include "../config.h"
+#include <sys/types.h>
+#include <netinet/in.h>
+#ifdef HAVE_PCAP_PCAP_H
+#include <pcap/pcap.h>
+#endif
+#ifdef HAVE_PCAP_H
+#include <pcap.h>
+#endif
+#include "headers.h"
+
+/* Packet parsing specialized by link type and IP version. A link type
+ * doesn't change during a capture, so Sniffer picks the capture callback
+ * for it once and the per-packet code never tests dlt. The IP version is
+ * tested once per packet, and each version has its own straight-line
+ * check.
+ */
+
+// where the network layer header starts in a packet from a link of type
+// DLT, or -1 if it isn't IP or there's not enough of it. There is one of
+// these for each supported link type.
+template <int DLT> int link_offset( const u_char *p, unsigned int caplen );
+
+template <> inline int link_offset<DLT_EN10MB>( const u_char *p, unsigned int caplen )
+{
+	if( caplen < ENET_HEADER_LEN+IP_HEADER_LEN )
+		return -1;
+
+	const struct sniff_ethernet *ethernet = (const struct sniff_ethernet *) p;
+	uint16_t ether_type = ntohs(ethernet->ether_type);
+	unsigned int off = ENET_HEADER_LEN;
+
+	if( ether_type == ETHERTYPE_VLAN )
+	{
+		ether_type = ntohs(*((const uint16_t *)(p + ENET_HEADER_LEN + VLAN_HEADER_LEN - 2)));
+		off += VLAN_HEADER_LEN;
+	}
+
+	if( ether_type != ETHERTYPE_IP && ether_type != ETHERTYPE_IPV6 )
+		return -1;
+	return off;
+}
+
+template <> inline int link_offset<DLT_LINUX_SLL>( const u_char *p, unsigned int caplen )
+{
+	return caplen < SLL_HEADER_LEN+IP_HEADER_LEN ? -1 : SLL_HEADER_LEN;
+}
+
+template <> inline int link_offset<DLT_RAW>( const u_char *p, unsigned int caplen )
+{
+	return caplen < IP_HEADER_LEN ? -1 : 0;
+}
+
+template <> inline int link_offset<DLT_NULL>( const u_char *p, unsigned int caplen )
+{
+	return caplen < NULL_HEADER_LEN+IP_HEADER_LEN ? -1 : NULL_HEADER_LEN;
+}
+
+// With -D, packets go through a slower parser that looks inside
+// encapsulations: any number of 802.1Q/802.1ad tags and MPLS labels, and up
+// to a given number of VXLAN and GRE tunnels (including ERSPAN), to find the
+// innermost IP header. It steps through a table of parsers, one per kind of
+// header, each of which says how long its header is and what comes next.
+
+// the kinds of header it knows, which index the table.
+#define HDR_ETHER 0     // Ethernet, starting at the destination address
+#define HDR_ETHERTYPE 1 // an ethertype, and whatever VLAN tag follows it
+#define HDR_MPLS 2      // one MPLS label stack entry
+#define HDR_IP 3        // IPv4 or IPv6
+#define HDR_GRE 4
+#define HDR_VXLAN 5
+#define HDR_ERSPAN2 6   // ERSPAN type II, after GRE
+#define HDR_ERSPAN3 7   // ERSPAN type III, after GRE
+#define HDR_KINDS 8
+// not kinds of header, but what a parser can say comes next.
+#define HDR_NONE -1     // nothing we can use
+#define HDR_DONE -2     // this IP header is the one
+
+// at most this many headers are looked at before giving up.
+#define DECAP_MAXSTEPS 16
+
+// the offset of the innermost IP header in the packet at p, starting with
+// a header of kind first at offset off and entering at most tunnels
+// tunnels, or -1 if there is none.
+int decap_offset( const u_char *p, unsigned int caplen, unsigned int off,
+	int first, int tunnels );
+
+// where the decapsulating parser starts for each link type.
+template <int DLT> int decap_link( const u_char *p, unsigned int caplen, int tunnels );
+
+template <> inline int decap_link<DLT_EN10MB>( const u_char *p, unsigned int caplen, int tunnels )
+{
+	return decap_offset( p, caplen, 0, HDR_ETHER, tunnels );
+}
+
+// a cooked header ends with the ethertype.
+template <> inline int decap_link<DLT_LINUX_SLL>( const u_char *p, unsigned int caplen, int tunnels )
+{
+	return decap_offset( p, caplen, SLL_HEADER_LEN-2, HDR_ETHERTYPE, tunnels );
+}
+
+template <> inline int decap_link<DLT_RAW>( const u_char *p, unsigned int caplen, int tunnels )
+{
+	return decap_offset( p, caplen, 0, HDR_IP, tunnels );
+}
+
+template <> inline int decap_link<DLT_NULL>( const u_char *p, unsigned int caplen, int tunnels )
+{
+	return decap_offset( p, caplen, NULL_HEADER_LEN, HDR_IP, tunnels );
+}
+
+// is the network layer packet at p, len bytes long, a TCP packet we can
+// use? One check for each IP version.
+template <int V> bool check_ip( const u_char *p, unsigned int len );
+
+template <> inline bool check_ip<4>( const u_char *p, unsigned int len )
+{
+	const struct sniff_ip *ip = (const struct sniff_ip *) p;
+	unsigned int ip_header_len = ip->ip_hl * 4;
+
+	// not enough data to do anything with this...
+	if( ip->ip_hl < 5 || len < ip_header_len + TCP_HEADER_LEN )
+		return false;
+	if( ntohs(ip->ip_len) < ip_header_len + TCP_HEADER_LEN )
+		return false;
+	if( ip->ip_p != IPPROTO_TCP )
+		return false;
+
+	const struct sniff_tcp *tcp = (const struct sniff_tcp *) (p + ip_header_len);
+
+	// tcp header is at least 20 bytes long.
+	return tcp->th_off >= 5 && tcp->th_sport != 0 && tcp->th_dport != 0;
+}
+
+template <> inline bool check_ip<6>( const u_char *p, unsigned int len )
+{
+	if( len < IP6_HEADER_LEN + TCP_HEADER_LEN )
+		return false;
+
+	const struct sniff_ip6 *ip6 = (const struct sniff_ip6 *) p;
+	if( ip6->ip_next != IPPROTO_TCP )
+		return false;
+
+	const struct sniff_tcp *tcp = (const struct sniff_tcp *) (p + IP6_HEADER_LEN);
+
+	return tcp->th_off >= 5 && tcp->th_sport != 0 && tcp->th_dport != 0;
+}
+
+inline bool check_nl( const u_char *p, unsigned int len )
+{
+	switch( ((const struct sniff_ip *) p)->ip_v )
+	{
+		case 4: return check_ip<4>( p, len );
+		case 6: return check_ip<6>( p, len );
+	}
+	return false;
+}
+
+#endif
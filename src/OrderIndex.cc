@@ -0,0 +1,227 @@
+/*
+ *  The code in this file is part of tcptrack. For more information see
+ *    http://www.rhythm.cx/~steve/devel/tcptrack
+ *
+ *     Copyright (C) Steve Benson - 2003
+ *
+ *  tcptrack is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your
+ *  option) any later version.
+ *
+ *  tcptrack is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GNU Make; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#include <stdlib.h>
+#include <assert.h>
+#include "OrderIndex.h"
+
+struct oilink
+{
+	OrderIndex::Node *next;
+	// number of level 0 steps this link covers.
+	unsigned int width;
+};
+
+struct OrderIndex::Node
+{
+	uint64_t key;
+	int64_t tie;
+	TCPConnection *c;
+	unsigned int row;
+	int level;
+	struct oilink link[1]; // really [level]
+};
+
+static OrderIndex::Node * alloc_node( int level )
+{
+	OrderIndex::Node *n = (OrderIndex::Node *)
+		malloc( sizeof(OrderIndex::Node) + (level-1)*sizeof(struct oilink) );
+	assert( n != NULL );
+	n->level = level;
+	return n;
+}
+
+// does a come before b?
+static bool node_before( const OrderIndex::Node *a, const OrderIndex::Node *b )
+{
+	if( a->key != b->key )
+		return a->key > b->key;
+	if( a->tie != b->tie )
+		return a->tie > b->tie;
+	return (uintptr_t)a->c < (uintptr_t)b->c;
+}
+
+OrderIndex::OrderIndex()
+{
+	head = alloc_node(OI_MAXLEVEL);
+	for( int l=0; l<OI_MAXLEVEL; l++ )
+	{
+		head->link[l].next = NULL;
+		head->link[l].width = 1;
+	}
+	count = 0;
+	rng = 2463534242U;
+}
+
+OrderIndex::~OrderIndex()
+{
+	Node *n = head->link[0].next;
+	while( n != NULL )
+	{
+		Node *nx = n->link[0].next;
+		free(n);
+		n = nx;
+	}
+	free(head);
+}
+
+int OrderIndex::randomLevel()
+{
+	// xorshift32
+	rng ^= rng << 13;
+	rng ^= rng >> 17;
+	rng ^= rng << 5;
+
+	uint32_t r = rng;
+	int level = 1;
+	while( level < OI_MAXLEVEL && (r & 3) == 0 )
+	{
+		++level;
+		r >>= 2;
+	}
+	return level;
+}
+
+void OrderIndex::insertNode( Node *n )
+{
+	Node *chain[OI_MAXLEVEL];
+	unsigned int steps_at[OI_MAXLEVEL];
+
+	Node *x = head;
+	for( int l=OI_MAXLEVEL-1; l>=0; l-- )
+	{
+		steps_at[l] = 0;
+		while( x->link[l].next != NULL && node_before(x->link[l].next, n) )
+		{
+			steps_at[l] += x->link[l].width;
+			x = x->link[l].next;
+		}
+		chain[l] = x;
+	}
+
+	unsigned int steps = 0;
+	for( int l=0; l<n->level; l++ )
+	{
+		Node *prev = chain[l];
+		n->link[l].next = prev->link[l].next;
+		prev->link[l].next = n;
+		n->link[l].width = prev->link[l].width - steps;
+		prev->link[l].width = steps + 1;
+		steps += steps_at[l];
+	}
+	for( int l=n->level; l<OI_MAXLEVEL; l++ )
+		chain[l]->link[l].width++;
+
+	++count;
+}
+
+void OrderIndex::unlinkNode( Node *n )
+{
+	Node *chain[OI_MAXLEVEL];
+
+	Node *x = head;
+	for( int l=OI_MAXLEVEL-1; l>=0; l-- )
+	{
+		while( x->link[l].next != NULL && node_before(x->link[l].next, n) )
+			x = x->link[l].next;
+		chain[l] = x;
+	}
+	assert( chain[0]->link[0].next == n );
+
+	for( int l=0; l<n->level; l++ )
+	{
+		Node *prev = chain[l];
+		prev->link[l].width += n->link[l].width - 1;
+		prev->link[l].next = n->link[l].next;
+	}
+	for( int l=n->level; l<OI_MAXLEVEL; l++ )
+		chain[l]->link[l].width--;
+
+	--count;
+}
+
+void OrderIndex::update( TCPConnection *c, uint64_t key, int64_t tie,
+	unsigned int row )
+{
+	hash_map<TCPConnection *, Node *, OIHashFunc>::iterator i = nodes.find(c);
+	Node *n;
+
+	if( i == nodes.end() )
+	{
+		n = alloc_node( randomLevel() );
+		n->c = c;
+		n->row = row;
+		nodes[c] = n;
+	}
+	else
+	{
+		n = (*i).second;
+		n->row = row;
+		if( n->key == key && n->tie == tie )
+			return;
+		unlinkNode(n);
+	}
+
+	n->key = key;
+	n->tie = tie;
+	insertNode(n);
+}
+
+void OrderIndex::remove( TCPConnection *c )
+{
+	hash_map<TCPConnection *, Node *, OIHashFunc>::iterator i = nodes.find(c);
+	if( i == nodes.end() )
+		return;
+
+	Node *n = (*i).second;
+	nodes.erase(i);
+	unlinkNode(n);
+	free(n);
+}
+
+OrderIndex::Node * OrderIndex::at( unsigned int rank ) const
+{
+	if( rank >= count )
+		return NULL;
+
+	// the head counts as position 0, entries start at 1.
+	unsigned int pos = rank + 1;
+	Node *x = head;
+	for( int l=OI_MAXLEVEL-1; l>=0; l-- )
+	{
+		while( x->link[l].next != NULL && x->link[l].width <= pos )
+		{
+			pos -= x->link[l].width;
+			x = x->link[l].next;
+		}
+	}
+	return x;
+}
+
+OrderIndex::Node * OrderIndex::next( const Node *n )
+{
+	return n->link[0].next;
+}
+
+unsigned int OrderIndex::row( const Node *n )
+{
+	return n->row;
+}
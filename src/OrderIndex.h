@@ -0,0 +1,95 @@
+/*
+ *  The code in this file is part of tcptrack. For more information see
+ *    http://www.rhythm.cx/~steve/devel/tcptrack
+ *
+ *     Copyright (C) Steve Benson - 2003
+ *
+ *  tcptrack is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your
+ *  option) any later version.
+ *
+ *  tcptrack is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GNU Make; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#ifndef ORDERINDEX_H
+#define ORDERINDEX_H 1
+
+#include "../config.h"
+#include <stdint.h>
+#ifdef HAVE_HASH_MAP
+#include <hash_map>
+#elif HAVE_EXT_HASH_MAP
+#include <ext/hash_map>
+#endif
+
+#ifdef GNU_CXX_NS
+using namespace __gnu_cxx;
+#endif
+
+class TCPConnection;
+
+// with one level per 4 nodes this is plenty for any realistic table.
+#define OI_MAXLEVEL 16
+
+class OIHashFunc
+{
+public:
+	uint32_t operator()( const TCPConnection *c ) const
+	{
+		return (uint32_t)(((uintptr_t)c) >> 4);
+	}
+};
+
+/* OrderIndex keeps connections ordered by a numeric key (largest first)
+ * in an indexable skip list. Every link knows how many entries it skips,
+ * so the entry at a given rank can be found in O(log N) and the list can
+ * be walked from there one entry at a time. Connections are only moved
+ * when their key actually changes.
+ *
+ * The connections are only used to tell entries apart and are never
+ * dereferenced, so an index can be kept up to date from a snapshot after
+ * the connections themselves are gone. Each entry carries the row of its
+ * connection in the latest snapshot.
+ */
+class OrderIndex
+{
+public:
+	struct Node;
+
+	OrderIndex();
+	~OrderIndex();
+
+	// add c to the index, or reposition it if key or tie have changed.
+	// tie breaks equal keys, larger first. row is c's snapshot row.
+	void update( TCPConnection *c, uint64_t key, int64_t tie,
+		unsigned int row );
+	void remove( TCPConnection *c );
+	unsigned int size() const { return count; }
+
+	// the entry at the given rank (0 is the largest key), or NULL.
+	Node * at( unsigned int rank ) const;
+	// the entry after n, or NULL.
+	static Node * next( const Node *n );
+	static unsigned int row( const Node *n );
+
+private:
+	void insertNode( Node *n );
+	void unlinkNode( Node *n );
+	int randomLevel();
+
+	Node *head;
+	unsigned int count;
+	uint32_t rng;
+
+	hash_map<TCPConnection *, Node *, OIHashFunc> nodes;
+};
+
+#endif
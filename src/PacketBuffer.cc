@@ -28,31 +28,41 @@
 #include <pthread.h>
 #include <time.h>
 #include <assert.h>
+#include <sys/time.h>
 #include "headers.h"
 #include "TCContainer.h"
 #include "PacketBuffer.h"
 #include "defs.h"
 #include "TCPPacket.h"
 #include "TCPCapture.h"
+#include "BatchParse.h"
 #include "GenericError.h"
+#include "TCPTrack.h"
+
+extern TCPTrack *app;
+
+// a clock for measuring how busy the threads are, in usec.
+static uint64_t busy_clock()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
 
 PacketBuffer::PacketBuffer()
 {
-	inq = &pq1;
-	outq = &pq2;
 	c=NULL;
 	pthread_initted=false;
+	busy=0;
+	dropped=0;
+	lastlook=busy_clock();
 
 	pthread_mutex_init( &c_lock, NULL );
-	pthread_mutex_init( &inq_lock, NULL );
-	pthread_cond_init( &inq_flag, NULL );
+	pthread_mutex_init( &stats_lock, NULL );
 }
 
-void PacketBuffer::init()
+void PacketBuffer::init( unsigned int nworkers )
 {
-	//
-	// Start up maintenence thread
-	//
 	pthread_attr_t attr;
 	if( pthread_attr_init( &attr ) != 0 )
 		throw GenericError("pthread_attr_init() failed");
@@ -62,6 +72,26 @@ void PacketBuffer::init()
 	// (should return ENOSYS). Should be safe to ignore return val.
 	pthread_attr_setstacksize( &attr, SS_PB );
 
+	//
+	// Start up the parse workers, if any
+	//
+	for( unsigned int i=0; i<nworkers; i++ )
+	{
+		struct pbworker *w = new pbworker;
+		w->pb = this;
+		w->busy = 0;
+		w->dropped = 0;
+		w->started = false;
+		workers.push_back(w);
+		if( pthread_create(&w->tid,&attr,pbparse_thread_func,w) != 0 )
+			throw GenericError("pthread_create() returned an error");
+		w->started = true;
+	}
+	lastbusy.assign( workers.size()+1, 0 );
+
+	//
+	// Start up maintenence thread
+	//
 	if( pthread_create(&maint_thread_tid,&attr,pbmaint_thread_func,this) != 0 )
 		throw GenericError("pthread_create() returned an error");
 
@@ -77,17 +107,23 @@ void PacketBuffer::dest( TCContainer *nc )
 
 PacketBuffer::~PacketBuffer()
 {
+	// if pthread_cancel returns non-zero, this indicates that the thread
+	// is not valid. It may have stopped because of an exception. Don't
+	// bother joining in that case.
 	if( pthread_initted )
 	{
-		// if pthread_cancel returns non-zero, this indicates that
-		// maint_thread_tid is not valid. It may have stopped because of
-		// an exception. Don't bother joining in that case.
 		if( pthread_cancel(maint_thread_tid) == 0 )
 			pthread_join(maint_thread_tid,NULL);
 	}
+	for( unsigned int i=0; i<workers.size(); i++ )
+	{
+		if( workers[i]->started && pthread_cancel(workers[i]->tid) == 0 )
+			pthread_join(workers[i]->tid,NULL);
+		delete workers[i];
+	}
 }
 
-void PacketBuffer::pushPacket( struct nlp *p )
+bool PacketBuffer::pushPacket( struct nlp *p )
 {
 	assert(p!=NULL);
 	assert( pthread_mutex_lock(&c_lock) == 0 );
@@ -96,78 +132,232 @@ void PacketBuffer::pushPacket( struct nlp *p )
 	if( c==NULL )
 	{
 		assert( pthread_mutex_unlock(&c_lock) == 0 );
-		return;
+		return true;
 	}
 
-	assert( pthread_mutex_lock(&inq_lock) == 0 );
-	inq->push(p);
-	// wake up the maint thread if it is sleeping...
-	assert( pthread_cond_signal(&inq_flag) == 0 );
-	assert( pthread_mutex_unlock(&inq_lock) == 0 );
+	// if a stage is that far behind, it won't catch up by being given
+	// more. Drop the packet here rather than let the queue grow until
+	// memory runs out.
+	bool kept = true;
+	if( workers.empty() )
+	{
+		if( pq.depth() < PB_MAXQUEUE )
+			pq.push(p);
+		else
+		{
+			++dropped;
+			kept = false;
+		}
+	}
+	else
+	{
+		// the sampler keeps flows by the low bits of the same hash.
+		// Use the high ones so the kept flows are spread over all
+		// the workers.
+		unsigned int w = (flow_hash(p->p) >> 16) % workers.size();
+		if( tq.depth() >= PB_MAXQUEUE )
+		{
+			++dropped;
+			kept = false;
+		}
+		else if( workers[w]->q.depth() >= PB_MAXQUEUE )
+		{
+			++workers[w]->dropped;
+			kept = false;
+		}
+		else
+			workers[w]->q.push(p);
+	}
 
 	assert( pthread_mutex_unlock(&c_lock) == 0 );
+
+	if( !kept )
+		nlp_free(p);
+	return kept;
+}
+
+// tell the governor how far behind we are, by how long the packet
+// captured at ts has waited and how many are waiting in all.
+static void observe_lag( unsigned int backlog, struct timeval ts )
+{
+	struct timeval now;
+	gettimeofday(&now,NULL);
+	int64_t lag = (int64_t)(now.tv_sec - ts.tv_sec) * 1000000
+		+ (now.tv_usec - ts.tv_usec);
+	app->governor.observe( backlog, lag > 0 ? lag : 0 );
+}
+
+void PacketBuffer::parse( struct nlp **batch, unsigned int n, bool track,
+	std::vector<TCPCapture *> &out )
+{
+	struct pktfields fields[PB_BATCH];
+	parse_batch(batch,n,fields);
+
+	if( track )
+		assert( pthread_mutex_lock(&c_lock) == 0 );
+	if( !track || c != NULL )
+	{
+		for( unsigned int i=0; i<n; i++ )
+		{
+			// The sniffer only hands us TCP packets, so this
+			// shouldn't happen.
+			if( fields[i].version == 0 )
+				continue;
+
+			struct nlp *p=batch[i];
+			TCPPacket *tcp_packet = new TCPPacket(p->p, fields[i]);
+			if( track )
+			{
+				TCPCapture c2 (tcp_packet, p->ts, p->weight, p->iface);
+				c->processPacket( c2 );
+			}
+			else
+				out.push_back( new TCPCapture(tcp_packet, p->ts,
+					p->weight, p->iface) );
+		}
+	}
+	if( track )
+		assert( pthread_mutex_unlock(&c_lock) == 0 );
+
+	for( unsigned int i=0; i<n; i++ )
+		nlp_free(batch[i]);
 }
 
 void PacketBuffer::maint_thread_run()
 {
-	struct nlp *p;
+	std::vector<TCPCapture *> none;
 
 	while(1)
 	{
-		// see if inq is empty.
-		//  if empty: wait on a condition variable set by pushPacket
-		//  if not: process inq as usual.
+		// wait for packets, or when busy polling, spin right here.
+		if( workers.empty() )
+			pq.take( app->busypoll );
+		else
+			tq.take( app->busypoll );
+		uint64_t start = busy_clock();
 
-		assert( pthread_mutex_lock(&inq_lock) == 0 );
+		if( workers.empty() )
+		{
+			if( ! pq.empty() )
+				observe_lag( pq.taken(), pq.front()->ts );
 
-		// if the input queue is empty, sleep until something is deposited.
-		if( inq->empty() )
-			pthread_cond_wait(&inq_flag,&inq_lock);
+			// process what was taken.
+			// Packets are taken PB_BATCH at a time so their headers
+			// can be validated and extracted together.
+			while( ! pq.empty() )
+			{
+				struct nlp *batch[PB_BATCH];
+				unsigned int n=0;
 
-		// swap in & out queues
-		// this allows the input queue to be unlocked ASAP so the Sniffer
-		// won't be delayed for too long.
-		if( inq == &pq1 )
-		{
-			inq = &pq2;
-			outq = &pq1;
+				while( n < PB_BATCH && ! pq.empty() )
+				{
+					batch[n++]=pq.front();
+					pq.pop();
+				}
+
+				parse(batch,n,true,none);
+			}
 		}
 		else
 		{
-			inq = &pq1;
-			outq = &pq2;
+			if( ! tq.empty() )
+			{
+				unsigned int backlog = tq.taken();
+				for( unsigned int i=0; i<workers.size(); i++ )
+					backlog += workers[i]->q.depth();
+				observe_lag( backlog, tq.front()->timestamp() );
+			}
+
+			// the parse workers have done everything but the tracking.
+			while( ! tq.empty() )
+			{
+				assert( pthread_mutex_lock(&c_lock) == 0 );
+				for( unsigned int n=0; n<PB_BATCH && ! tq.empty(); n++ )
+				{
+					TCPCapture *cap = tq.front();
+					tq.pop();
+					if( c != NULL )
+						c->processPacket( *cap );
+					delete cap;
+				}
+				assert( pthread_mutex_unlock(&c_lock) == 0 );
+			}
 		}
-		assert( pthread_mutex_unlock(&inq_lock) == 0 );
-
-		// process outq
-		// outq doesn't need locks because this (pb maint thread) is the
-		//  only thread that should ever access it.
-		p=NULL;
-		int qlen=0;
-		while( ! outq->empty() )
+
+		busy += busy_clock() - start;
+	}
+}
+
+void PacketBuffer::parse_thread_run( struct pbworker *w )
+{
+	std::vector<TCPCapture *> out;
+
+	while(1)
+	{
+		w->q.take( app->busypoll );
+		uint64_t start = busy_clock();
+
+		// parse in batches and pass each batch on as soon as it's done,
+		// so the tracking thread isn't kept waiting for all of them.
+		while( ! w->q.empty() )
 		{
-			++qlen;
-			p=NULL;
-			p=outq->front();
+			struct nlp *batch[PB_BATCH];
+			unsigned int n=0;
 
-			assert( pthread_mutex_lock(&c_lock) == 0 );
-			if( c != NULL )
+			while( n < PB_BATCH && ! w->q.empty() )
 			{
-				// The sniffer only hands us TCP packets
-				TCPPacket *tcp_packet = TCPPacket::newTCPPacket(p->p, p->len);
-				assert ( tcp_packet != NULL );
-
-				TCPCapture c2 (tcp_packet, p->ts);
-				c->processPacket( c2 );
+				batch[n++]=w->q.front();
+				w->q.pop();
 			}
-			assert( pthread_mutex_unlock(&c_lock) == 0 );
 
-			free(p->p);
-			free(p);
-			outq->pop();
+			out.clear();
+			parse(batch,n,false,out);
+			tq.push(out);
 		}
+
+		w->busy += busy_clock() - start;
 	}
+}
+
+void PacketBuffer::stages( std::vector<struct pbstage> &out )
+{
+	out.clear();
+	if( ! pthread_initted )
+		return;
+
+	assert( pthread_mutex_lock(&stats_lock) == 0 );
 
+	uint64_t now = busy_clock();
+	uint64_t span = now - lastlook;
+	lastlook = now;
+
+	struct pbstage st;
+	for( unsigned int i=0; i<workers.size(); i++ )
+	{
+		uint64_t b = workers[i]->busy;
+		st.name = "parse";
+		st.worker = i;
+		st.depth = workers[i]->q.depth();
+		st.util = span ? (b - lastbusy[i]) * 100 / span : 0;
+		st.dropped = workers[i]->dropped;
+		lastbusy[i] = b;
+		out.push_back(st);
+	}
+
+	uint64_t b = busy;
+	st.name = workers.empty() ? "buffer" : "track";
+	st.worker = -1;
+	st.depth = workers.empty() ? pq.depth() : tq.depth();
+	st.util = span ? (b - lastbusy[workers.size()]) * 100 / span : 0;
+	st.dropped = dropped;
+	lastbusy[workers.size()] = b;
+	out.push_back(st);
+
+	assert( pthread_mutex_unlock(&stats_lock) == 0 );
+
+	for( unsigned int i=0; i<out.size(); i++ )
+		if( out[i].util > 100 )
+			out[i].util = 100;
 }
 
 ////////////////////////
@@ -175,6 +365,15 @@ void PacketBuffer::maint_thread_run()
 void *pbmaint_thread_func( void *arg )
 {
 	PacketBuffer *pb = (PacketBuffer *) arg;
+	app->affinity.apply(AFF_BUFFER);
 	pb->maint_thread_run();
 	return NULL;
 }
+
+void *pbparse_thread_func( void *arg )
+{
+	struct pbworker *w = (struct pbworker *) arg;
+	app->affinity.apply(AFF_PARSE);
+	w->pb->parse_thread_run(w);
+	return NULL;
+}
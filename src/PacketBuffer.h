@@ -23,8 +23,147 @@
 #ifndef PACKETBUFFER_H
 #define PACKETBUFFER_H
 #include <queue>
+#include <vector>
+#include <atomic>
+#include <pthread.h>
+#include <assert.h>
 #include "TCContainer.h"
+#include "TCPCapture.h"
+#include "defs.h"
 
+// tell the CPU this is a spin loop, so it doesn't flood the memory bus
+// and a hyperthread sibling gets the core meanwhile.
+static inline void cpu_relax()
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	__builtin_ia32_pause();
+#elif defined(__GNUC__) && defined(__aarch64__)
+	__asm__ __volatile__("yield");
+#endif
+}
+
+/* A SwapQueue hands things from one thread to another. It is really two
+ * queues: the producer pushes onto one, and the consumer swaps them and
+ * works through the other without holding the lock, so the producer is
+ * only ever held up for as long as a push takes.
+ */
+template <class T> class SwapQueue
+{
+public:
+	SwapQueue()
+	{
+		inq = &q1;
+		outq = &q2;
+		inq_len = 0;
+		out_len = 0;
+		pthread_mutex_init( &inq_lock, NULL );
+		pthread_cond_init( &inq_flag, NULL );
+	}
+
+	// producer side.
+	void push( T x )
+	{
+		assert( pthread_mutex_lock(&inq_lock) == 0 );
+		inq->push(x);
+		++inq_len;
+		// wake up the consumer if it is sleeping...
+		assert( pthread_cond_signal(&inq_flag) == 0 );
+		assert( pthread_mutex_unlock(&inq_lock) == 0 );
+	}
+	void push( const std::vector<T> &v )
+	{
+		assert( pthread_mutex_lock(&inq_lock) == 0 );
+		for( unsigned int i=0; i<v.size(); i++ )
+			inq->push(v[i]);
+		inq_len += v.size();
+		assert( pthread_cond_signal(&inq_flag) == 0 );
+		assert( pthread_mutex_unlock(&inq_lock) == 0 );
+	}
+
+	// consumer side. Waits until something has been pushed, then takes
+	// everything pushed so far. When spinning, doesn't sleep while
+	// waiting, unless nothing comes for PB_SPINS tries.
+	void take( bool spin )
+	{
+		if( spin )
+		{
+			for( unsigned int i=0; i<PB_SPINS && inq_len == 0; i++ )
+			{
+				cpu_relax();
+				pthread_testcancel();
+			}
+		}
+
+		assert( pthread_mutex_lock(&inq_lock) == 0 );
+		// if the input queue is empty, sleep until something is deposited.
+		if( inq->empty() )
+			pthread_cond_wait(&inq_flag,&inq_lock);
+		inq_len=0;
+		std::queue<T> *t = inq;
+		inq = outq;
+		outq = t;
+		out_len = outq->size();
+		assert( pthread_mutex_unlock(&inq_lock) == 0 );
+	}
+	bool empty() const { return outq->empty(); }
+	T front() const { return outq->front(); }
+	void pop() { outq->pop(); --out_len; }
+	unsigned int taken() const { return outq->size(); }
+
+	// things waiting, whether taken or not. Any thread may ask.
+	unsigned int depth() const { return inq_len + out_len; }
+
+private:
+	std::queue<T> q1;
+	std::queue<T> q2;
+	// these point to either q1 or q2. They never both point to the
+	// same one. outq is only touched by the consumer.
+	std::queue<T> *inq;
+	std::queue<T> *outq;
+	pthread_mutex_t inq_lock;
+	// when the input queue is empty, the consumer goes to sleep.
+	// when something is added, this cond var is set to wake it up.
+	pthread_cond_t inq_flag;
+	// number of things in the input queue. When spinning, the consumer
+	// waits on this instead of sleeping, without taking the lock.
+	std::atomic<unsigned int> inq_len;
+	// number left in the output queue.
+	std::atomic<unsigned int> out_len;
+};
+
+class PacketBuffer;
+
+// one parse worker. See PacketBuffer.
+struct pbworker
+{
+	PacketBuffer *pb;
+	SwapQueue<struct nlp *> q;
+	std::atomic<uint64_t> busy; // usec spent working
+	std::atomic<uint64_t> dropped; // packets dropped with q full
+	pthread_t tid;
+	bool started;
+};
+
+// what the statistics view shows about a stage of the pipeline.
+struct pbstage
+{
+	const char *name; // "buffer", "parse" or "track"
+	int worker;       // which parse worker, or -1
+	unsigned int depth; // packets waiting for this stage
+	unsigned int util;  // percent of the time it was busy since last asked
+	uint64_t dropped;   // packets dropped because its queue was full
+};
+
+/* PacketBuffer takes packets from the Sniffer, turns them into
+ * TCPCaptures and gives those to the TCContainer, in its own thread so the
+ * capture is never held up by the connection table.
+ *
+ * With parse workers, parsing is split off into a pool of threads of its
+ * own and the PacketBuffer thread only does the tracking. Packets are
+ * handed to a worker by a hash of their connection's endpoints, so every
+ * packet of a connection, in both directions, is parsed by the same
+ * worker and reaches the TCContainer in the order it was captured.
+ */
 class PacketBuffer
 {
 public:
@@ -32,39 +171,56 @@ public:
 	~PacketBuffer();
 	
 	// performs more constructor-like activity, but exceptions can
-	// be thrown from within here.
-	void init();
+	// be thrown from within here. workers is the number of parse
+	// workers to start, 0 to parse in the PacketBuffer thread.
+	void init( unsigned int workers=0 );
 	
 	// tells PacketBuffer where to send its packets. 
 	// if NULL, PB will drop all new packets.
 	void dest( TCContainer *nc = NULL );
 
-	// add a new packet to this buffer for processing. 
-	void pushPacket( struct nlp *p );
+	// add a new packet to this buffer for processing. Returns false if
+	// the packet had to be dropped because too many are waiting
+	// (PB_MAXQUEUE). It is freed then.
+	bool pushPacket( struct nlp *p );
+
+	// queue depth and utilization of each stage, for the statistics
+	// view. Utilization is over the time since the last call.
+	void stages( std::vector<struct pbstage> &out );
 
 	// do not call. only called from pbmaint_thread_func.
 	// the pb processor thread runs in here.
 	void maint_thread_run();
+
+	// do not call. only called from pbparse_thread_func.
+	void parse_thread_run( struct pbworker *w );
 	
 private:
 	// was the thread successfully launched?
 	bool pthread_initted;
 
-	// these are the queues that hold the packets we are given.
-	std::queue<struct nlp *> pq1;
-	std::queue<struct nlp *> pq2;
-	// these point to either pq1 or pq2. They never both point to the 
-	// same pqX queue.
-	std::queue<struct nlp *> *inq;
-	std::queue<struct nlp *> *outq;
-	// mutexes for the input queue (above).
-	// none needed for the output queue since that's only touched 
-	// by the maint thread.
-	pthread_mutex_t inq_lock;
+	// with no workers, the packets we are given.
+	SwapQueue<struct nlp *> pq;
 
-	// when the input queue is empty, the maint thread goes to sleep.
-	// when a packet is added, this cond var is set to wake it up.
-	pthread_cond_t inq_flag;
+	// with workers, what they have parsed, waiting to be tracked.
+	std::vector<struct pbworker *> workers;
+	SwapQueue<TCPCapture *> tq;
+
+	// run the packets in one batch through parse_batch(). If track is
+	// true they're tracked right away, otherwise the TCPCaptures are
+	// added to out. The packets are freed.
+	void parse( struct nlp **batch, unsigned int n, bool track,
+		std::vector<TCPCapture *> &out );
+	void track( TCPCapture &cap );
+
+	// usec spent working by the PacketBuffer thread.
+	std::atomic<uint64_t> busy;
+	// packets dropped because pq, or tq, was full.
+	std::atomic<uint64_t> dropped;
+	// for stages(): what busy was for each stage last time, and when.
+	std::vector<uint64_t> lastbusy;
+	uint64_t lastlook;
+	pthread_mutex_t stats_lock;
 	
 	// packets are sent here.
 	TCContainer *c;
@@ -74,5 +230,6 @@ private:
 };
 
 void *pbmaint_thread_func( void * );
+void *pbparse_thread_func( void * );
 
 #endif
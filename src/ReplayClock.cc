@@ -0,0 +1,232 @@
+/*
+ *  The code in this file is part of tcptrack. For more information see
+ *    http://www.rhythm.cx/~steve/devel/tcptrack
+ *
+ *     Copyright (C) Steve Benson - 2003
+ *
+ *  tcptrack is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your
+ *  option) any later version.
+ *
+ *  tcptrack is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GNU Make; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#include <cassert>
+#include <errno.h>
+#include "ReplayClock.h"
+
+static uint64_t mono_usec()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void unlock_mutex( void *m )
+{
+	pthread_mutex_unlock( (pthread_mutex_t *)m );
+}
+
+ReplayClock::ReplayClock()
+{
+	on=false;
+	started=false;
+	halted=false;
+	rate=0;
+	capbase=0;
+	wallbase=0;
+	last=0;
+	first=0;
+	restarts=0;
+	pthread_mutex_init( &lock, NULL );
+
+	// timed waits go by the monotonic clock, like wallbase.
+	pthread_condattr_t attr;
+	pthread_condattr_init( &attr );
+	pthread_condattr_setclock( &attr, CLOCK_MONOTONIC );
+	pthread_cond_init( &changed, &attr );
+	pthread_condattr_destroy( &attr );
+}
+
+void ReplayClock::start( double speed )
+{
+	rate = speed;
+	on = true;
+}
+
+bool ReplayClock::running()
+{
+	assert( pthread_mutex_lock(&lock)==0 );
+	bool r = on && started;
+	assert( pthread_mutex_unlock(&lock)==0 );
+	return r;
+}
+
+uint64_t ReplayClock::origin()
+{
+	assert( pthread_mutex_lock(&lock)==0 );
+	uint64_t o = first;
+	assert( pthread_mutex_unlock(&lock)==0 );
+	return o;
+}
+
+// the capture time now. Call with the lock held, once started.
+uint64_t ReplayClock::virt()
+{
+	if( halted )
+		return capbase;
+	if( rate == 0 )
+		return last;
+	return capbase + (uint64_t)((mono_usec() - wallbase) * rate);
+}
+
+uint64_t ReplayClock::now()
+{
+	if( on )
+	{
+		assert( pthread_mutex_lock(&lock)==0 );
+		bool s = started;
+		uint64_t v = s ? virt() : 0;
+		assert( pthread_mutex_unlock(&lock)==0 );
+		if( s )
+			return v;
+	}
+
+	struct timeval tv;
+	gettimeofday(&tv,NULL);
+	return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+bool ReplayClock::due( const struct timeval &ts, bool block, int64_t *usec )
+{
+	uint64_t t = (uint64_t)ts.tv_sec * 1000000 + ts.tv_usec;
+	bool ok = false;
+
+	assert( pthread_mutex_lock(&lock)==0 );
+	// the capture thread may be cancelled while it waits.
+	pthread_cleanup_push( unlock_mutex, &lock );
+
+	if( !started )
+	{
+		// the first packet sets the clock.
+		started = true;
+		capbase = last = first = t;
+		wallbase = mono_usec();
+	}
+
+	unsigned long r = restarts;
+	while( true )
+	{
+		uint64_t v = virt();
+		if( t <= v || ( rate == 0 && !halted ) )
+		{
+			if( t > last )
+				last = t;
+			ok = true;
+			break;
+		}
+
+		int64_t wait = halted ? -1 : (int64_t)((t - v) / rate) + 1;
+		if( !block )
+		{
+			if( usec != NULL )
+				*usec = wait;
+			break;
+		}
+		if( wait < 0 )
+			pthread_cond_wait( &changed, &lock );
+		else
+		{
+			uint64_t until = mono_usec() + wait;
+			struct timespec abst;
+			abst.tv_sec = until / 1000000;
+			abst.tv_nsec = (until % 1000000) * 1000;
+			pthread_cond_timedwait( &changed, &lock, &abst );
+		}
+		if( restarts != r )
+			break;
+	}
+
+	pthread_cleanup_pop(1);
+	return ok;
+}
+
+void ReplayClock::restart()
+{
+	assert( pthread_mutex_lock(&lock)==0 );
+	started = false;
+	restarts++;
+	pthread_cond_broadcast( &changed );
+	assert( pthread_mutex_unlock(&lock)==0 );
+}
+
+void ReplayClock::pause( bool p )
+{
+	assert( pthread_mutex_lock(&lock)==0 );
+	if( p && !halted )
+	{
+		if( started )
+			capbase = virt();
+		halted = true;
+	}
+	else if( !p && halted )
+	{
+		// carry on from where the clock stopped.
+		halted = false;
+		wallbase = mono_usec();
+		if( last < capbase )
+			last = capbase;
+	}
+	pthread_cond_broadcast( &changed );
+	assert( pthread_mutex_unlock(&lock)==0 );
+}
+
+bool ReplayClock::paused()
+{
+	assert( pthread_mutex_lock(&lock)==0 );
+	bool p = halted;
+	assert( pthread_mutex_unlock(&lock)==0 );
+	return p;
+}
+
+void ReplayClock::step( uint64_t usec )
+{
+	assert( pthread_mutex_lock(&lock)==0 );
+	if( halted )
+	{
+		capbase += usec;
+		pthread_cond_broadcast( &changed );
+	}
+	assert( pthread_mutex_unlock(&lock)==0 );
+}
+
+void ReplayClock::setSpeed( double s )
+{
+	assert( pthread_mutex_lock(&lock)==0 );
+	if( started && !halted )
+	{
+		capbase = virt();
+		wallbase = mono_usec();
+		if( last < capbase )
+			last = capbase;
+	}
+	rate = s;
+	pthread_cond_broadcast( &changed );
+	assert( pthread_mutex_unlock(&lock)==0 );
+}
+
+double ReplayClock::speed()
+{
+	assert( pthread_mutex_lock(&lock)==0 );
+	double s = rate;
+	assert( pthread_mutex_unlock(&lock)==0 );
+	return s;
+}
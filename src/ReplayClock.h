@@ -0,0 +1,98 @@
+/*
+ *  The code in this file is part of tcptrack. For more information see
+ *    http://www.rhythm.cx/~steve/devel/tcptrack
+ *
+ *     Copyright (C) Steve Benson - 2003
+ *
+ *  tcptrack is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your
+ *  option) any later version.
+ *
+ *  tcptrack is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GNU Make; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#ifndef REPLAYCLOCK_H
+#define REPLAYCLOCK_H 1
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+/* ReplayClock is the time the connection table goes by: when connections
+ * were last active, how long they have been idle, and what rates their
+ * bytes add up to. Live, that is just the wall clock.
+ *
+ * Reading a test file, it is the capture's own time instead. The capture
+ * thread asks due() before handing over each packet, and packets are let
+ * through speed times as fast as they were captured. At speed 0 (max)
+ * they are let through as fast as they can be read, and the clock is the
+ * timestamp of the latest one. Either way, rates and timeouts come out as
+ * they did when the packets were captured.
+ *
+ * The clock can be paused, stepped while paused, and sped up or slowed
+ * down, from any thread.
+ */
+class ReplayClock
+{
+public:
+	ReplayClock();
+
+	// go by the capture's time, at the given speed, 0 for max. Call
+	// before anything is captured.
+	void start( double speed );
+	bool enabled() const { return on; }
+	// has the first packet set it yet?
+	bool running();
+	// the capture time it was set to then, or after the last restart().
+	uint64_t origin();
+
+	// the time, in usec since the epoch. Until the first packet, the
+	// wall clock's.
+	uint64_t now();
+	time_t seconds() { return now() / 1000000; }
+
+	// may the packet captured at ts be handed over yet? If it may not
+	// and block is true, wait until it may, and return false early if a
+	// restart() comes first. Otherwise *usec (if given) is how long until
+	// it may be, or -1 while paused.
+	bool due( const struct timeval &ts, bool block, int64_t *usec=NULL );
+
+	// start over from the next packet, as after a jump in the file.
+	void restart();
+
+	void pause( bool p );
+	bool paused();
+	// while paused, let through the next usec of capture time.
+	void step( uint64_t usec );
+
+	void setSpeed( double s );
+	double speed();
+
+private:
+	uint64_t virt();
+
+	bool on;
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+
+	bool started;      // has the first packet set the clock?
+	bool halted;       // paused?
+	double rate;       // speed, 0 for max
+	uint64_t capbase;  // the capture time at wallbase (usec)
+	uint64_t wallbase; // the monotonic clock when that was (usec)
+	uint64_t last;     // the latest packet let through (usec)
+	uint64_t first;    // the first packet after starting over (usec)
+	unsigned long restarts;
+};
+
+#endif
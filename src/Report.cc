@@ -0,0 +1,302 @@
+/*
+ *  The code in this file is part of tcptrack. For more information see
+ *    http://www.rhythm.cx/~steve/devel/tcptrack
+ *
+ *     Copyright (C) Steve Benson - 2003
+ *
+ *  tcptrack is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your
+ *  option) any later version.
+ *
+ *  tcptrack is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GNU Make; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#include <cassert>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include "Report.h"
+#include "Sniffer.h"
+#include "TCPConnection.h"
+#include "TCPTrack.h"
+#include "AppError.h"
+#include "GenericError.h"
+#include "defs.h"
+
+extern TCPTrack *app;
+
+// the same abbreviations as the display, by TCP_STATE_*.
+static const char *statenames[] = { "", "SYN_SNT", "SYNAKAK", "ESTABLI",
+	"CLOSING", "CLOSED", "RESET" };
+
+// a row of one of the shards' snapshots.
+struct reportrow
+{
+	const TCCSnapshot *s;
+	unsigned int r;
+};
+
+static bool row_bigger( const struct reportrow &a, const struct reportrow &b )
+{
+	return a.s->bytes()[a.r] > b.s->bytes()[b.r];
+}
+
+// totals for one server port.
+struct portstat
+{
+	portnum_t port;
+	unsigned int connections;
+	uint64_t packets;
+	uint64_t bytes;
+};
+
+static bool port_bigger( const struct portstat &a, const struct portstat &b )
+{
+	return a.bytes > b.bytes;
+}
+
+Report::Report()
+{
+	iface=NULL;
+	fexp=NULL;
+	pthread_mutex_init( &init_lock, NULL );
+}
+
+Report::~Report()
+{
+	for( unsigned int i=0; i<shards.size(); i++ )
+	{
+		if( shards[i]->snap != NULL )
+			shards[i]->c->releaseSnapshot( shards[i]->snap );
+		// the connections themselves are left for exit() to clean
+		// up. Taking millions of them apart one at a time would only
+		// hold it up.
+		delete shards[i];
+	}
+}
+
+void Report::run( const std::list<char *> &nfiles, char *niface,
+	char *nfexp, unsigned int workers )
+{
+	files=nfiles;
+	iface=niface;
+	fexp=nfexp;
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for( unsigned int i=0; i<workers; i++ )
+	{
+		struct reportshard *sh = new reportshard;
+		sh->r = this;
+		sh->index = i;
+		sh->c = new TCContainer(false);
+		// everything stays until the end, closed or not.
+		sh->c->purge(false);
+		sh->snap = NULL;
+		shards.push_back(sh);
+	}
+
+	unsigned int started;
+	for( started=0; started<workers; started++ )
+	{
+		if( pthread_create(&shards[started]->tid,NULL,report_thread_func,
+				shards[started]) != 0 )
+			break;
+	}
+	for( unsigned int i=0; i<started; i++ )
+		pthread_join(shards[i]->tid,NULL);
+	if( started < workers )
+		throw GenericError("pthread_create() failed.");
+
+	for( unsigned int i=0; i<shards.size(); i++ )
+	{
+		if( shards[i]->err != "" )
+			throw GenericError(shards[i]->err);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	print( (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9 );
+}
+
+// this runs in each worker thread.
+void Report::shardRun( struct reportshard *sh )
+{
+	for( std::list<char *>::iterator i=files.begin(); i!=files.end(); i++ )
+	{
+		Sniffer s;
+		s.shard( sh->index, shards.size() );
+		s.direct( sh->c );
+		try
+		{
+			assert( pthread_mutex_lock(&init_lock)==0 );
+			try
+			{
+				s.init( iface, fexp, *i, false );
+			}
+			catch( const AppError &e )
+			{
+				assert( pthread_mutex_unlock(&init_lock)==0 );
+				throw;
+			}
+			assert( pthread_mutex_unlock(&init_lock)==0 );
+
+			while( s.dispatch() != -1 )
+				;
+		}
+		catch( const AppError &e )
+		{
+			sh->err = string(*i) + ": " + e.msg();
+			s.direct();
+			break;
+		}
+		s.direct();
+	}
+
+	// the rates are meaningless here, but this also publishes the
+	// snapshot the report is made from.
+	sh->c->maintain();
+	sh->snap = sh->c->acquireSnapshot();
+}
+
+void Report::print( double elapsed )
+{
+	// the shards' totals add up, as no connection is in two of them.
+	struct tcctotals t;
+	memset( &t, 0, sizeof(t) );
+	std::vector<struct reportrow> rows;
+	for( unsigned int i=0; i<shards.size(); i++ )
+	{
+		const TCCSnapshot *s = shards[i]->snap;
+		t.bytes += s->totals.bytes;
+		t.packets += s->totals.packets;
+		t.connections += s->totals.connections;
+		for( int st=0; st<8; st++ )
+			t.states[st] += s->totals.states[st];
+		for( unsigned int r=0; r<s->size(); r++ )
+		{
+			struct reportrow row = { s, r };
+			rows.push_back(row);
+		}
+	}
+
+	uint64_t filebytes = 0;
+	for( std::list<char *>::iterator i=files.begin(); i!=files.end(); i++ )
+	{
+		struct stat st;
+		if( stat(*i, &st) == 0 )
+			filebytes += st.st_size;
+	}
+
+	printf("%u file%s, %.1f MB in %.2f seconds (%.1f MB/s), %u worker%s\n",
+		(unsigned int)files.size(), files.size() == 1 ? "" : "s",
+		filebytes / 1e6, elapsed,
+		elapsed > 0 ? filebytes / 1e6 / elapsed : 0.0,
+		(unsigned int)shards.size(), shards.size() == 1 ? "" : "s");
+	printf("%llu packets, %llu bytes in %u connections\n",
+		(unsigned long long)t.packets, (unsigned long long)t.bytes,
+		t.connections);
+	printf("by state:");
+	for( int st=TCP_STATE_SYN_SYNACK; st<=TCP_STATE_RESET; st++ )
+		printf(" %s %u", statenames[st], t.states[st]);
+	printf("\n");
+
+	//
+	// the biggest connections
+	//
+	unsigned int top = std::min( (unsigned int)rows.size(), (unsigned int)REPORT_TOP );
+	std::partial_sort( rows.begin(), rows.begin()+top, rows.end(), row_bigger );
+
+	printf("\nTop %u connections by bytes\n", top);
+	printf("%-39s %5s %-39s %5s %-7s %12s %15s %12s %15s\n", "Client",
+		"Port", "Server", "Port", "State", "Packets", "Bytes",
+		"Duration (s)", "Rate (B/s)");
+	for( unsigned int i=0; i<top; i++ )
+	{
+		const TCCSnapshot *s = rows[i].s;
+		unsigned int r = rows[i].r;
+		const struct tcckey &k = s->keys()[r];
+		// addrStr()'s buffer is reused, so one address at a time.
+		printf("%-39s %5d ", TCCSnapshot::addrStr(k.family, k.srcaddr),
+			k.srcport);
+		printf("%-39s %5d ", TCCSnapshot::addrStr(k.family, k.dstaddr),
+			k.dstport);
+		uint64_t usec = s->lastCaptures()[r] - s->firstCaptures()[r];
+		printf("%-7s %12llu %15llu %12.3f %15llu\n",
+			statenames[s->states()[r]],
+			(unsigned long long)s->packets()[r],
+			(unsigned long long)s->bytes()[r], usec / 1e6,
+			(unsigned long long)rate_per_sec( s->bytes()[r], usec ));
+	}
+
+	//
+	// the busiest server ports, and how long connections lasted
+	//
+	std::vector<struct portstat> ports(65536);
+	for( unsigned int p=0; p<ports.size(); p++ )
+	{
+		memset( &ports[p], 0, sizeof(ports[p]) );
+		ports[p].port = p;
+	}
+	static const uint64_t durlimit[] = { 1, 10, 60, 600, 3600 };
+	static const char *durname[] = { "< 1s", "< 10s", "< 1m", "< 10m", "< 1h",
+		">= 1h" };
+	const int ndur = sizeof(durlimit)/sizeof(durlimit[0]);
+	unsigned int durcount[ndur+1] = { 0 };
+
+	for( unsigned int i=0; i<rows.size(); i++ )
+	{
+		const TCCSnapshot *s = rows[i].s;
+		unsigned int r = rows[i].r;
+		struct portstat &ps = ports[ s->keys()[r].dstport ];
+		ps.connections++;
+		ps.packets += s->packets()[r];
+		ps.bytes += s->bytes()[r];
+
+		uint64_t dur = s->lastCaptures()[r] - s->firstCaptures()[r];
+		int d = 0;
+		while( d < ndur && dur >= durlimit[d]*1000000 )
+			d++;
+		durcount[d]++;
+	}
+
+	unsigned int nports = 0;
+	for( unsigned int p=0; p<ports.size(); p++ )
+	{
+		if( ports[p].connections > 0 )
+			ports[nports++] = ports[p];
+	}
+	top = std::min( nports, (unsigned int)REPORT_TOP );
+	std::partial_sort( ports.begin(), ports.begin()+top,
+		ports.begin()+nports, port_bigger );
+
+	printf("\nTop %u server ports by bytes\n", top);
+	printf("%5s %12s %12s %15s\n", "Port", "Connections", "Packets", "Bytes");
+	for( unsigned int i=0; i<top; i++ )
+		printf("%5d %12u %12llu %15llu\n", ports[i].port,
+			ports[i].connections, (unsigned long long)ports[i].packets,
+			(unsigned long long)ports[i].bytes);
+
+	printf("\nConnection durations\n");
+	for( int d=0; d<=ndur; d++ )
+		printf("%-6s %12u\n", durname[d], durcount[d]);
+}
+
+// callback for pthread_create, gets executed in a newly created thread.
+void *report_thread_func( void *arg )
+{
+	struct reportshard *sh = (struct reportshard *) arg;
+	app->affinity.apply(AFF_PARSE);
+	sh->r->shardRun(sh);
+	return NULL;
+}
@@ -0,0 +1,91 @@
+/*
+ *  The code in this file is part of tcptrack. For more information see
+ *    http://www.rhythm.cx/~steve/devel/tcptrack
+ *
+ *     Copyright (C) Steve Benson - 2003
+ *
+ *  tcptrack is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your
+ *  option) any later version.
+ *
+ *  tcptrack is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GNU Make; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#ifndef REPORT_H
+#define REPORT_H 1
+
+#include <pthread.h>
+#include <list>
+#include <string>
+#include <vector>
+#include "TCContainer.h"
+#include "TCCSnapshot.h"
+
+using namespace std;
+
+class Report;
+
+// one worker's share of the connections.
+struct reportshard
+{
+	Report *r;
+	unsigned int index;
+	pthread_t tid;
+	TCContainer *c;
+	TCCSnapshot *snap; // the final state of c
+	string err;        // why it stopped early, if it did
+};
+
+/* Report reads one or more capture files as fast as all the cores can,
+ * and prints a summary of what was in them instead of running the
+ * display: the biggest connections, the busiest server ports, and how
+ * long connections lasted.
+ *
+ * Connections are split between the workers by a hash of their endpoints.
+ * Every worker reads all of the files, in order, and tracks only its own
+ * share in a TCContainer of its own, so nothing is shared while they run.
+ * The files are mapped into memory, so they are only read from disk once.
+ * Since the shards are disjoint, merging them is just putting their final
+ * snapshots side by side.
+ */
+class Report
+{
+public:
+	Report();
+	~Report();
+
+	// track everything in files with the given number of workers and
+	// print the report to stdout. iface is only used to look up the
+	// netmask for the filter and may be NULL. Throws an AppError if a
+	// file can't be read.
+	void run( const std::list<char *> &files, char *iface, char *fexp,
+		unsigned int workers );
+
+	// do not call. only called from report_thread_func.
+	void shardRun( struct reportshard *sh );
+
+private:
+	void print( double elapsed );
+
+	std::list<char *> files;
+	char *iface;
+	char *fexp;
+	std::vector<struct reportshard *> shards;
+
+	// pcap_compile() isn't thread safe in older libpcaps, so the
+	// workers open their files one at a time.
+	pthread_mutex_t init_lock;
+};
+
+// worker thread main function.
+void *report_thread_func( void *arg );
+
+#endif
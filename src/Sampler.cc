@@ -0,0 +1,62 @@
+/*
+ *  The code in this file is part of tcptrack. For more information see
+ *    http://www.rhythm.cx/~steve/devel/tcptrack
+ *
+ *     Copyright (C) Steve Benson - 2003
+ *
+ *  tcptrack is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your
+ *  option) any later version.
+ *
+ *  tcptrack is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GNU Make; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#include "../config.h"
+#include <string.h>
+#include <netinet/in.h>
+#include "Sampler.h"
+#include "headers.h"
+#include "util.h"
+
+Sampler::Sampler()
+{
+	prate = 1;
+	frate = 1;
+}
+
+unsigned int Sampler::weigh( const u_char *p, uint32_t &rng )
+{
+	unsigned int pn = prate;
+	unsigned int fn = frate;
+	if( pn <= 1 && fn <= 1 )
+		return 1;
+
+	if( fn > 1 && flow_hash(p) % fn != 0 )
+		return 0;
+
+	const struct sniff_ip *ip = (const struct sniff_ip *) p;
+	const struct sniff_tcp *tcp;
+	if( ip->ip_v == 6 )
+		tcp = (const struct sniff_tcp *) (p + IP6_HEADER_LEN);
+	else
+		tcp = (const struct sniff_tcp *) (p + ip->ip_hl*4);
+
+	if( pn <= 1 || (tcp->th_flags & (TH_SYN|TH_FIN|TH_RST)) )
+		return 1;
+
+	// xorshift32
+	rng ^= rng << 13;
+	rng ^= rng >> 17;
+	rng ^= rng << 5;
+	if( rng % pn != 0 )
+		return 0;
+	return pn;
+}
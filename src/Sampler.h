@@ -0,0 +1,75 @@
+/*
+ *  The code in this file is part of tcptrack. For more information see
+ *    http://www.rhythm.cx/~steve/devel/tcptrack
+ *
+ *     Copyright (C) Steve Benson - 2003
+ *
+ *  tcptrack is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your
+ *  option) any later version.
+ *
+ *  tcptrack is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GNU Make; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#ifndef SAMPLER_H
+#define SAMPLER_H 1
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <atomic>
+
+/* Sampler decides which captured packets are looked at at all, before
+ * anything is copied or parsed. There are two ways to sample, and they can
+ * be combined:
+ *
+ * Packet sampling (-s N) keeps 1 in N data packets, picked at random, and
+ * counts each one as N packets. Packets with SYN, FIN or RST set are always
+ * kept and count as one, so connections still open and close as they
+ * should. Every rate and byte count is then an estimate.
+ *
+ * Flow sampling (-S N) keeps every packet of 1 in N connections and none of
+ * the others. The connections are picked by a hash of their endpoints, so
+ * it is always the same ones. Their numbers are exact; the totals are
+ * scaled up by N to estimate the whole link.
+ *
+ * There is one Sampler for all the capture threads, so the random number
+ * generator's state belongs to the caller: each capture thread keeps its
+ * own and passes it to weigh(). The rates can be changed from any thread.
+ */
+class Sampler
+{
+public:
+	Sampler();
+
+	// sample 1 in n packets or connections. 1 turns sampling off.
+	void packets( unsigned int n ) { prate = n ? n : 1; }
+	void flows( unsigned int n ) { frate = n ? n : 1; }
+	unsigned int packetRate() const { return prate; }
+	unsigned int flowRate() const { return frate; }
+
+	// are per-connection numbers estimates? are the totals?
+	bool estimatingRows() const { return prate > 1; }
+	bool estimatingTotals() const { return prate > 1 || frate > 1; }
+
+	// how many packets the network layer packet at p stands for, or 0 if
+	// it should be dropped. It must have passed check_nl(). rng is the
+	// caller's random number generator state, seeded with seed().
+	unsigned int weigh( const u_char *p, uint32_t &rng );
+
+	// a starting state for weigh()'s rng. Never 0.
+	static uint32_t seed( unsigned int n ) { return 2463534242U + n; }
+
+private:
+	std::atomic<unsigned int> prate;
+	std::atomic<unsigned int> frate;
+};
+
+#endif
@@ -25,6 +25,11 @@
 #define _REENTRANT
 #include <pthread.h>
 #include <cassert>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <poll.h>
 #ifdef HAVE_PCAP_PCAP_H
 #include <pcap/pcap.h>
 #elif HAVE_PCAP_H
@@ -37,14 +42,42 @@
 #include "AppError.h"
 #include "PcapError.h"
 #include "TCPTrack.h"
+#include "TCPPacket.h"
+#include "TCPCapture.h"
+#include "LinkLayer.h"
+#include "CapFile.h"
 
 extern TCPTrack *app;
 
-Sniffer::Sniffer()
+Sniffer::Sniffer( unsigned int nifindex )
 {
+	ifindex=nifindex;
+	samplerng=Sampler::seed(nifindex);
+	shardidx=0;
+	shardcnt=1;
 	pb=NULL;
+	c=NULL;
+	fc=NULL;
+	fcdest=NULL;
+	cached=false;
+	lagcheck=false;
+	nanots=false;
+	statsec=0;
+	memset( &laststat, 0, sizeof(laststat) );
+	received=0;
+	dropped=0;
+	ifdropped=0;
+	ourdrops=0;
+	offline=false;
 	pcap_initted=false;
 	pthread_initted=false;
+	capfile=NULL;
+	capfiltered=false;
+	jumpreq=0;
+	pending=false;
+	pendd=NULL;
+	pendwait=0;
+	capend=false;
 	pthread_mutex_init( &pb_mutex, NULL );
 }
 
@@ -55,7 +88,96 @@ void Sniffer::dest( PacketBuffer *npb )
 	assert( pthread_mutex_unlock(&pb_mutex)==0 );
 }
 
-void Sniffer::init(char *iface, char *fexp, char *test_file)
+// open iface for a live capture with the kernel buffer size, snap length,
+// immediate mode and timestamp precision asked for. Returns NULL and fills
+// in errbuf on error.
+static pcap_t * open_live( char *iface, char *errbuf )
+{
+	pcap_t *h = pcap_create(iface, errbuf);
+	if( !h )
+		return NULL;
+
+	int snaplen = app->decap >= 0 ? DECAP_SNAPLEN : SNAPLEN;
+	if( app->snaplen > 0 )
+		snaplen = app->snaplen;
+	pcap_set_snaplen(h, snaplen);
+	pcap_set_promisc(h, app->promisc ? 1 : 0);
+	pcap_set_timeout(h, PCAP_DELAY*1000);
+	if( app->capbuf > 0 )
+		pcap_set_buffer_size(h, app->capbuf);
+	// packets are handed over as soon as they arrive, rather than after
+	// PCAP_DELAY. Busy polling is pointless without it.
+	if( app->immediate || app->busypoll )
+		pcap_set_immediate_mode(h, 1);
+	// not every platform can do it. Then the timestamps stay in usec.
+	if( app->nanots )
+		pcap_set_tstamp_precision(h, PCAP_TSTAMP_PRECISION_NANO);
+
+	int rv = pcap_activate(h);
+	if( rv < 0 )
+	{
+		if( rv == PCAP_ERROR )
+			snprintf(errbuf, PCAP_ERRBUF_SIZE, "%s", pcap_geterr(h));
+		else
+			snprintf(errbuf, PCAP_ERRBUF_SIZE, "%s", pcap_statustostr(rv));
+		pcap_close(h);
+		return NULL;
+	}
+	return h;
+}
+
+void Sniffer::direct( TCContainer *nc )
+{
+	assert( pthread_mutex_lock(&pb_mutex)==0 );
+	c=nc;
+	assert( pthread_mutex_unlock(&pb_mutex)==0 );
+}
+
+void Sniffer::flowcache( TCContainer *nc )
+{
+	assert( pthread_mutex_lock(&pb_mutex)==0 );
+	if( nc != NULL && fc == NULL )
+		fc = new FlowCache();
+	fcdest=nc;
+	assert( pthread_mutex_unlock(&pb_mutex)==0 );
+}
+
+void Sniffer::flush()
+{
+	assert( pthread_mutex_lock(&pb_mutex)==0 );
+	if( cached && fcdest != NULL )
+		fc->flush(fcdest,ifindex);
+	assert( pthread_mutex_unlock(&pb_mutex)==0 );
+}
+
+void Sniffer::shard( unsigned int index, unsigned int count )
+{
+	assert( count > 0 && index < count );
+	shardidx=index;
+	shardcnt=count;
+}
+
+void Sniffer::flushIfDue()
+{
+	if( cached && fc->due() )
+		flush();
+}
+
+// the pcap_loop callback for link type dlt, or NULL if it isn't supported.
+template <bool DECAP>
+static pcap_handler pick_callback( int dlt )
+{
+	switch( dlt )
+	{
+		case DLT_EN10MB: return handle_packet<DLT_EN10MB,DECAP>;
+		case DLT_LINUX_SLL: return handle_packet<DLT_LINUX_SLL,DECAP>;
+		case DLT_RAW: return handle_packet<DLT_RAW,DECAP>;
+		case DLT_NULL: return handle_packet<DLT_NULL,DECAP>;
+	}
+	return NULL;
+}
+
+void Sniffer::init(char *iface, char *fexp, char *test_file, bool threaded)
 {
 	assert(pcap_initted==false);
 	assert(pthread_initted==false);
@@ -67,21 +189,57 @@ void Sniffer::init(char *iface, char *fexp, char *test_file)
 	//
 	if( test_file == NULL )
 	{
-		if( app->promisc )
-			handle = pcap_open_live(iface, SNAPLEN, 1, PCAP_DELAY*1000, errbuf);
-		else
-			handle = pcap_open_live(iface, SNAPLEN, 0, PCAP_DELAY*1000, errbuf);
+		handle = open_live(iface, errbuf);
+		if( !handle )
+			throw PcapError("pcap_activate",errbuf);
+		nanots = ( pcap_get_tstamp_precision(handle)
+			== PCAP_TSTAMP_PRECISION_NANO );
 	}
 	else
 	{
-		handle = pcap_open_offline(test_file, errbuf);
+		offline = true;
+		// read it ourselves if we can. libpcap is left for whatever
+		// CapFile doesn't understand.
+		capfile = new CapFile();
+		if( capfile->open(test_file, errbuf) )
+		{
+			// only needed to compile the filter.
+			handle = pcap_open_dead(capfile->linktype(), 65535);
+			if( !handle )
+				throw GenericError("pcap_open_dead() failed.");
+		}
+		else
+		{
+			delete capfile;
+			capfile = NULL;
+			handle = pcap_open_offline(test_file, errbuf);
+			if( !handle )
+				throw PcapError("pcap_open_offline",errbuf);
+			// it's read at full speed. The clock never starts and
+			// stays the wall clock, as before.
+			if( app->rclock.enabled() && app->rclock.speed() != 0 )
+				throw GenericError("-x needs a pcap or pcapng file.");
+		}
+
+		if( app->startat != NULL )
+		{
+			// libpcap can't seek by time.
+			if( capfile == NULL )
+				throw GenericError("-t needs a pcap or pcapng file.");
+			time_t t;
+			if( !parse_when(app->startat, capfile->startTime(), &t) )
+				throw GenericError("Bad -t time.");
+			capfile->seek(t);
+		}
 	}
-		
-	if( !handle )
-		throw PcapError("pcap_open_live",errbuf);
 	
+	// the link type doesn't change, so pick the packet parser for it now.
 	dlt = pcap_datalink(handle);
-	if( dlt!=DLT_EN10MB  &&  dlt!=DLT_LINUX_SLL && dlt!=DLT_RAW && dlt!=DLT_NULL) 
+	if( app->decap >= 0 )
+		callback = pick_callback<true>(dlt);
+	else
+		callback = pick_callback<false>(dlt);
+	if( callback == NULL )
 		throw GenericError("The specified interface type is not supported yet.");
 	//if( dlt==DLT_LINUX_SLL )
 	//	cerr << "this is a LINUX_SLL interface\n";
@@ -107,16 +265,47 @@ void Sniffer::init(char *iface, char *fexp, char *test_file)
 		pcap_close(handle);
 		throw PcapError("pcap_compile",pcap_geterr(handle));
 	}
-	if( pcap_setfilter(handle, &filter) ) // apply filter to sniffer
+	if( capfile != NULL )
 	{
-		pcap_freecode(&filter);
-		pcap_close(handle);
-		throw PcapError("pcap_setfilter",pcap_geterr(handle));
+		// the filter is run by readFile(), when there is one.
+		capfilter = filter;
+		capfiltered = ( filter_app[strspn(filter_app," ")] != 0 );
+	}
+	else
+	{
+		if( pcap_setfilter(handle, &filter) ) // apply filter to sniffer
+		{
+			pcap_freecode(&filter);
+			pcap_close(handle);
+			throw PcapError("pcap_setfilter",pcap_geterr(handle));
+		}
+		pcap_freecode(&filter); // filter code not needed after setfilter
 	}
-	pcap_freecode(&filter); // filter code not needed after setfilter
 	
 	pcap_initted=true;
 
+	cached = ( fc != NULL && !offline );
+
+	// the capture thread has to wake up to flush the FlowCache even
+	// when no packets come.
+	if( !offline && ( !threaded || app->busypoll || cached ) )
+	{
+		if( pcap_setnonblock(handle, 1, errbuf) == -1 )
+			throw PcapError("pcap_setnonblock",errbuf);
+	}
+
+#ifdef SO_BUSY_POLL
+	// let the kernel poll the device queue too. This needs
+	// CAP_NET_ADMIN; without it we just spin in user space.
+	if( !offline && app->busypoll && fd() != -1 )
+	{
+		int usec = BUSY_POLL_USEC;
+		setsockopt(fd(), SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec));
+	}
+#endif
+
+	if( !threaded )
+		return;
 
 	pthread_attr_t attr;
 
@@ -143,7 +332,13 @@ Sniffer::~Sniffer()
 			pthread_join(sniffer_tid,NULL);
 	}
 	if( pcap_initted )
+	{
+		if( capfile != NULL )
+			pcap_freecode(&capfilter);
 		pcap_close(handle);
+	}
+	delete capfile;
+	delete fc;
 }
 
 // this method gets run in a new thread.
@@ -153,7 +348,39 @@ void Sniffer::run()
 {
 	u_char *other = (u_char *) this;
 
-	if( pcap_loop(handle, -1, handle_packet, other) == -1 )
+	if( app->busypoll && !offline )
+	{
+		// spin instead of sleeping in the kernel until packets come.
+		while( true )
+		{
+			if( pcap_dispatch(handle, -1, callback, other) == -1 )
+				throw PcapError("pcap_dispatch",pcap_geterr(handle));
+			flushIfDue();
+			pollStats( time(NULL) );
+			pthread_testcancel();
+		}
+	}
+
+	if( cached )
+	{
+		// like pcap_loop, but waking up every FLOWCACHE_FLUSH usec.
+		struct pollfd pfd;
+		pfd.fd = fd();
+		pfd.events = POLLIN;
+		while( true )
+		{
+			poll(&pfd, 1, FLOWCACHE_FLUSH/1000);
+			if( pcap_dispatch(handle, -1, callback, other) == -1 )
+				throw PcapError("pcap_dispatch",pcap_geterr(handle));
+			flushIfDue();
+			pollStats( time(NULL) );
+			pthread_testcancel();
+		}
+	}
+
+	if( capfile != NULL )
+		readFile(-1, true);
+	else if( pcap_loop(handle, -1, callback, other) == -1 )
 		throw PcapError("pcap_loop",pcap_geterr(handle));
 
 	// Kill the program when the loop ends.
@@ -161,37 +388,224 @@ void Sniffer::run()
 	exit(0);
 }
 
+int Sniffer::fd()
+{
+	if( capfile != NULL )
+		return -1;
+	return pcap_get_selectable_fd(handle);
+}
+
+void Sniffer::pollStats( time_t now )
+{
+	if( now == statsec || offline )
+		return;
+	statsec = now;
+
+	struct pcap_stat ps;
+	if( pcap_stats(handle, &ps) != 0 )
+		return;
+	// unsigned subtraction gets the difference right across a wrap.
+	received += (u_int)(ps.ps_recv - laststat.ps_recv);
+	dropped += (u_int)(ps.ps_drop - laststat.ps_drop);
+	ifdropped += (u_int)(ps.ps_ifdrop - laststat.ps_ifdrop);
+	laststat = ps;
+}
+
+void Sniffer::stats( struct capstats *st )
+{
+	st->live = !offline;
+	st->received = received;
+	st->dropped = dropped;
+	st->ifdropped = ifdropped;
+	st->ours = ourdrops;
+}
+
+bool Sniffer::jump( int secs )
+{
+	if( capfile == NULL )
+		return false;
+	jumpreq += secs;
+	// in case the capture thread is waiting for a packet to be due.
+	app->rclock.restart();
+	return true;
+}
+
+// hand up to cnt (or all, if -1) packets from the CapFile to the callback,
+// in place, as they come due on the replay clock. If block is false, stop
+// at the first one that isn't due yet. Returns how many records were
+// read.
+int Sniffer::readFile( int cnt, bool block )
+{
+	bool paced = app->rclock.enabled();
+	int n = 0;
+	while( cnt < 0 || n < cnt )
+	{
+		if( jumpreq.load(std::memory_order_relaxed) != 0 )
+		{
+			int d = jumpreq.exchange(0);
+			capfile->seek( app->rclock.seconds() + d );
+			pending = false;
+			app->rclock.restart();
+		}
+
+		if( !pending )
+		{
+			if( !capfile->next(&pendh, &pendd) )
+			{
+				capend = true;
+				break;
+			}
+			pending = true;
+		}
+		if( paced && !app->rclock.due(pendh.ts, block, &pendwait) )
+		{
+			if( block )
+				continue;
+			break;
+		}
+		pending = false;
+		pendwait = 0;
+
+		n++;
+		if( capfiltered && pcap_offline_filter(&capfilter, &pendh, pendd) == 0 )
+			continue;
+		callback( (u_char *) this, &pendh, pendd );
+	}
+	return n;
+}
+
+int Sniffer::idle()
+{
+	if( !pending )
+		return 0;
+	if( pendwait < 0 )
+		return -1;
+	return (pendwait + 999) / 1000;
+}
+
+int Sniffer::dispatch()
+{
+	// a live capture hands over one buffer at a time. A test file would
+	// be read to the end in one go, so read it in batches.
+	int cnt = offline ? OFFLINE_BATCH : -1;
+	lagcheck = !offline;
+	int n;
+	if( capfile != NULL )
+		n = readFile(cnt, false);
+	else
+		n = pcap_dispatch(handle, cnt, callback, (u_char *) this);
+	if( n == -1 )
+		throw PcapError("pcap_dispatch",pcap_geterr(handle));
+	flushIfDue();
+	// when no packets come, the counters still have to be read.
+	pollStats( time(NULL) );
+
+	// a test file reads 0 packets only once it has run out, unless
+	// they just aren't due yet.
+	if( n == 0 && offline && ( capfile == NULL || capend ) )
+		return -1;
+	return n;
+}
+
+template <int DLT, bool DECAP>
 void Sniffer::processPacket( const pcap_pkthdr *header, const u_char *packet )
 {
+	// everything after this expects usec.
+	struct pcap_pkthdr usech;
+	if( nanots )
+	{
+		usech = *header;
+		usech.ts.tv_usec /= 1000;
+		header = &usech;
+	}
+	pollStats( header->ts.tv_sec );
+
+	// without a PacketBuffer, how late the first packet of each batch
+	// is processed is the only measure of being behind.
+	if( lagcheck )
+	{
+		lagcheck = false;
+		struct timeval now;
+		gettimeofday(&now,NULL);
+		int64_t lag = (int64_t)(now.tv_sec - header->ts.tv_sec) * 1000000
+			+ (now.tv_usec - header->ts.tv_usec);
+		app->governor.observe( 0, lag > 0 ? lag : 0 );
+	}
+
+	// find the network layer header and make sure this is a TCP packet
+	// we can use, once, before anything else is done with it.
+	int off;
+	if( DECAP )
+		off = decap_link<DLT>( packet, header->caplen, app->decap );
+	else
+		off = link_offset<DLT>( packet, header->caplen );
+	if( off < 0 )
+		return;
+	const u_char *nl = packet+off;
+	unsigned int len = header->caplen-off;
+	if( ! check_nl(nl,len) )
+		return;
+	// the capture may be longer than usual, to make room for tunnel
+	// headers or because of -L. Only the usual length is needed from here
+	// on.
+	if( len > SNAPLEN )
+		len = SNAPLEN;
+
+	// another Sniffer is tracking this one. The low bits of the hash are
+	// left to flow sampling, like PacketBuffer does.
+	if( shardcnt > 1 && (flow_hash(nl)>>16) % shardcnt != shardidx )
+		return;
+
+	// packets that aren't sampled are dropped right away.
+	unsigned int weight = app->sampler.weigh(nl,samplerng);
+	if( weight == 0 )
+		return;
+
 	assert( pthread_mutex_lock(&pb_mutex)==0 );
 
-	if( pb==NULL ) 
+	if( pb==NULL && c==NULL ) 
+	{
+		++ourdrops;
+		assert( pthread_mutex_unlock(&pb_mutex) == 0 );
+		return;
+	}
+
+	// most packets only need counting.
+	if( cached && fcdest != NULL && fc->absorb(nl,header->ts,weight) )
 	{
 		assert( pthread_mutex_unlock(&pb_mutex) == 0 );
 		return;
 	}
 
-	// getnlp parses the link level header. n.p will point to the network
-	// layer header.
-	struct nlp *n = getnlp(packet,dlt,header);
+	// n.p will point to the network layer header.
+	struct nlp *n = copynlp(nl,len,header->ts);
 	if( ! n )
 	{
+		++ourdrops;
 		assert( pthread_mutex_unlock(&pb_mutex) == 0 );
 		return;
 	}
-	
-	if( ! checknlp(n) )
+	n->weight = weight;
+	n->iface = ifindex;
+
+	if( c != NULL )
 	{
-		if( n->p != NULL )
-			free(n->p);
-		free(n);
+		// no PacketBuffer thread in between. Do what it would do.
+		TCPPacket *tcp_packet = TCPPacket::newTCPPacket(n->p, n->len);
+		assert( tcp_packet != NULL );
+
+		TCPCapture c2 (tcp_packet, n->ts, n->weight, n->iface);
+		c->processPacket( c2 );
+
+		nlp_free(n);
 		assert( pthread_mutex_unlock(&pb_mutex) == 0 );
 		return;
 	}
 
 	// TODO: if this throws exceptions, unlock pb_mutex before rethrow.
 	// So far, PacketBuffer doesn't throw any exceptions here.
-	pb->pushPacket(n);
+	if( ! pb->pushPacket(n) )
+		++ourdrops;
 	
 	assert( pthread_mutex_unlock(&pb_mutex) == 0 );
 }
@@ -203,6 +617,7 @@ void Sniffer::processPacket( const pcap_pkthdr *header, const u_char *packet )
 void *sniffer_thread_func(void *arg)
 {
 	Sniffer *sniffer = (Sniffer *) arg;
+	app->affinity.apply(AFF_CAPTURE);
 	try 
 	{
 		sniffer->run();
@@ -215,9 +630,10 @@ void *sniffer_thread_func(void *arg)
 }
 
 // callback function called by pcap_loop every time it receives a packet
+template <int DLT, bool DECAP>
 void handle_packet(u_char *other, const struct pcap_pkthdr *header, const u_char *packet)
 {
 	Sniffer *sniffer = (Sniffer *) other;
-	sniffer->processPacket(header,packet);
+	sniffer->processPacket<DLT,DECAP>(header,packet);
 }
 
@@ -33,24 +33,83 @@
 #include <pcap.h>
 #endif
 #include <pthread.h>
+#include <atomic>
 #include "PacketBuffer.h"
+#include "TCContainer.h"
+#include "FlowCache.h"
+
+class CapFile;
+
+// capture counters, for the status line.
+struct capstats
+{
+	bool live;          // false for a test file, which has no kernel counters
+	uint64_t received;  // packets the kernel passed the filter
+	uint64_t dropped;   // dropped by the kernel for lack of buffer space
+	uint64_t ifdropped; // dropped by the interface or its driver
+	uint64_t ours;      // dropped by tcptrack
+};
 
 class Sniffer
 {
 public:
-	Sniffer();
+	// ifindex tags everything captured, for telling interfaces apart
+	// when there are several -i. It's the position of this one.
+	Sniffer( unsigned int ifindex=0 );
 	~Sniffer();
 
 	// init performs some constructor-like activity. It is separate
 	// so that exceptions don't have to be thrown in the constructor.
-	void init(char *iface, char *fexp, char *test_file);
+	// if threaded is false, no capture thread is started. The pcap
+	// handle is made non-blocking and the caller has to call
+	// dispatch() whenever fd() is readable.
+	void init(char *iface, char *fexp, char *test_file, bool threaded=true);
 
 	// set the place where sniffed packets are sent for further 
 	// processing. If NULL, packets are just dropped.
 	void dest( PacketBuffer *pb=NULL );
 
+	// hand packets straight to c instead, in the calling thread.
+	// Only makes sense without a capture thread.
+	void direct( TCContainer *c=NULL );
+
+	// count packets of established connections in a FlowCache and hand
+	// the counts to c, instead of sending every packet on. Call before
+	// init(). Test files always take the full path.
+	void flowcache( TCContainer *c=NULL );
+	// hand whatever the FlowCache has collected over now.
+	void flush();
+
+	// only pass on the connections that fall in shard index of count,
+	// by a hash of their endpoints. Several Sniffers reading the same
+	// file can then each track a disjoint part of it. Call before init().
+	void shard( unsigned int index, unsigned int count );
+
+	// a descriptor to wait on for packets, or -1 if there is none.
+	int fd();
+	// process the packets that are waiting. Returns how many, or -1 at
+	// the end of a test file.
+	int dispatch();
+	// for a paced test file: how many msec until dispatch() has the next
+	// packet to process, or -1 while the replay is paused.
+	int idle();
+	// reading a test file rather than a live capture?
+	bool isFile() const { return offline; }
+
+	// the kernel's counters as of the last poll (once a second), and
+	// our own. Any thread may ask.
+	void stats( struct capstats *st );
+
+	// move secs seconds of capture time forward (back, if negative) from
+	// where the replay of the test file is. Any thread may ask; it
+	// happens before the next packet is read. Returns false if the file
+	// isn't one that can be seeked in.
+	bool jump( int secs );
+
 	
-	// do not call. called only from the pcap_loop loopback function. 
+	// do not call. called only from the pcap_loop callback for link
+	// type DLT, with or without looking inside encapsulations.
+	template <int DLT, bool DECAP>
 	void processPacket(const pcap_pkthdr *header, const u_char *packet);
 
 	// do not call. called only from sniffer_thread_func
@@ -60,21 +119,76 @@ private:
 	pthread_t sniffer_tid; // thread id of sniffer thread
 	pcap_t *handle;        // device handle, for net dev we're sniffing
 	PacketBuffer *pb;      // send packets here. may be NULL.
+	TCContainer *c;        // or straight here. may be NULL.
 	pthread_mutex_t pb_mutex;
 
+	FlowCache *fc;         // NULL unless flowcache() was called.
+	TCContainer *fcdest;   // where fc's counts go. may be NULL.
+	bool cached;           // using fc for this capture?
+	void flushIfDue();
+
+	unsigned int ifindex;
+
+	// this capture thread's state for Sampler::weigh().
+	uint32_t samplerng;
+
+	// see shard(). shardcnt is 1 if everything is passed on.
+	unsigned int shardidx;
+	unsigned int shardcnt;
+
+	// measure the lag of the next packet for the Governor?
+	bool lagcheck;
+
+	// timestamps come in nanoseconds and have to be converted?
+	bool nanots;
+
+	// read the kernel's counters if the second has changed since the
+	// last time. Only the capture thread calls it, as pcap_stats()
+	// isn't safe to call alongside pcap_dispatch().
+	void pollStats( time_t now );
+	time_t statsec;
+	// pcap's counters are 32 bits and wrap. These are the last values
+	// read, and the 64 bit totals built from them.
+	struct pcap_stat laststat;
+	std::atomic<uint64_t> received;
+	std::atomic<uint64_t> dropped;
+	std::atomic<uint64_t> ifdropped;
+	// packets we had to drop ourselves.
+	std::atomic<uint64_t> ourdrops;
+
 	// these are true if these parts were successfully initialzised, 
 	// and thus would need to be cleaned up in the constructor.
 	// also used to make sure init() isn't called more than once.
 	bool pcap_initted;
 	bool pthread_initted;
 
+	// reading a test file rather than a live interface?
+	bool offline;
+
+	// the test file, when it's read without libpcap. handle is then
+	// only used to compile the filter, which readFile() runs.
+	CapFile *capfile;
+	struct bpf_program capfilter;
+	bool capfiltered; // is there a filter expression?
+	int readFile( int cnt, bool block );
+	std::atomic<int> jumpreq; // seconds to jump, 0 for none
+	// the packet read from the file that isn't due yet, if pending.
+	bool pending;
+	struct pcap_pkthdr pendh;
+	const u_char *pendd;
+	int64_t pendwait; // usec until it's due, -1 while paused
+	bool capend;      // has the file been read to the end?
+
 	// the data link type. set to one of the DLT_* values in 
 	// net/bpf.h. Specifies what type of link layer this is 
 	// (ethernet, ppp, raw IP...)
 	int dlt;
+	// the pcap_loop callback that parses dlt's packets. Set by init().
+	pcap_handler callback;
 };
 
-// pcap_loop calls this function
+// pcap_loop calls one of these, the one for the link type and -D.
+template <int DLT, bool DECAP>
 void handle_packet(u_char *other, const struct pcap_pkthdr *header, const u_char *packet);
 
 // main function for sniffer thread
@@ -23,148 +23,169 @@
 #define _BSD_SOURCE 1
 #define _REENTRANT
 #include <stdlib.h>
-#include <list>
+#include <algorithm>
 #include "SortedIterator.h"
-#include "TCContainer.h"
+#include "TCCSnapshot.h"
 
-SortedIterator::SortedIterator( TCContainer *c ) 
-{
-	numcons = c->numConnections();
-	cons = (TCPConnection **) malloc(numcons*sizeof(TCPConnection *));
-
-	// fill up the array with pointers to the connections
-	int index=0;
-	for( tccmap::iterator i=c->conhash2.begin(); i!=c->conhash2.end(); i++ )
-	{
-		cons[index]=(*i).second;
-		++index;
-	}
+// when getNext() runs past the sorted part of the list, at least this many
+// more rows are put in order at once.
+#define SORT_CHUNK 64
 
+SortedIterator::SortedIterator( const TCCSnapshot *s ) 
+{
+	snap = s;
+	numrows = s->size();
 	cur=0;
+	sort_type=SORT_UN;
+	page=NULL;
+	pagefirst=0;
+	keyed=false;
+	nsorted=0;
 }
 
 // this method does the actual work of sorting
 // it should be called from a thread that can afford to do that work.
-void SortedIterator::sort( int sort_type )
+//
+// TCContainer ranks connections by rate and bytes, and hands out the page
+// that was asked for with the snapshot. If that's where the caller reads,
+// nothing needs sorting at all. Otherwise the keys are pulled out of the
+// rows once, into a contiguous array, and only the first nvisible of them
+// are selected and sorted. Idle time is compared via the last packet
+// timestamp so no time() calls are needed.
+void SortedIterator::sort( int nsort_type, unsigned int nvisible )
 {
-	if( numcons > 1 ) {
-		if( sort_type == SORT_RATE )
-			qsort(cons,numcons,sizeof(TCPConnection *),compare_rate);
-		else if( sort_type == SORT_BYTES )
-			qsort(cons,numcons,sizeof(TCPConnection *),compare_bytes);
-		else if( sort_type == SORT_IDLE )
-			qsort(cons,numcons,sizeof(TCPConnection *),compare_idle);
-		else if( sort_type == SORT_ACTIVE )
-			qsort(cons,numcons,sizeof(TCPConnection *),compare_active);
+	sort_type=nsort_type;
+	keyed=false;
+	nsorted=0;
+	page=NULL;
+
+	if( numrows <= 1 || sort_type == SORT_UN )
+		return;
+
+	if( snap->pageSort() == sort_type )
+	{
+		page = &snap->page();
+		pagefirst = snap->pageFirst();
+		return;
 	}
+
+	makeKeys(nvisible);
 }
 
-// get the next connection and advance our current location.
-// returns NULL if there are no more connections.
-TCPConnection * SortedIterator::getNext()
+// pull the sort keys out of the rows and put the first n in order.
+void SortedIterator::makeKeys( unsigned int n )
 {
-	if( cur >= numcons ) 
-		return NULL;
+	const time_t *ts = &snap->lastPktTimes()[0];
+	const uint64_t *k = NULL;
+	if( sort_type == SORT_RATE )
+		k = &snap->rates()[0];
+	else if( sort_type == SORT_BYTES )
+		k = &snap->bytes()[0];
+
+	keys.resize(numrows);
+	if( k != NULL )
+	{
+		// ties go the same way as in TCContainer's indexes, so reading
+		// on past the end of the page doesn't repeat or skip a row.
+		const std::vector<TCPConnection *> &conn = snap->conncol;
+		for( unsigned int i=0; i<numrows; i++ )
+		{
+			keys[i].k1 = (int64_t)k[i];
+			keys[i].k2 = (int64_t)ts[i];
+			keys[i].k3 = (uintptr_t)conn[i];
+			keys[i].idx = i;
+		}
+	}
 	else
-		return cons[cur++];
-}
+	{
+		// only the timestamp column is touched here.
+		int64_t sign = ( sort_type == SORT_IDLE ) ? -1 : 1; // most idle first
+		for( unsigned int i=0; i<numrows; i++ )
+		{
+			keys[i].k1 = sign * (int64_t)ts[i];
+			keys[i].k2 = 0;
+			keys[i].k3 = 0;
+			keys[i].idx = i;
+		}
+	}
 
-void SortedIterator::rewind()
-{
-	cur=0;
+	keyed=true;
+	nsorted=0;
+	sortMore(n);
 }
 
-SortedIterator::~SortedIterator()
+// put the next n keys after the already sorted ones in order.
+void SortedIterator::sortMore( unsigned int n )
 {
-	free(cons); 
-}
+	unsigned int end = ( n > numrows - nsorted ) ? numrows : nsorted + n;
 
-/////////////////////////////////////////////
-
-// this is a callback function used from qsort in sort(). 
-// it performs the comparison of the TCPConnection objects based on current throughput.
-int compare_rate(const void *c1, const void *c2)
-{
-	TCPConnection * con1;
-	TCPConnection * con2;
+	std::vector<sortkey>::iterator first = keys.begin() + nsorted;
+	std::vector<sortkey>::iterator middle = keys.begin() + end;
 
-	con1=* (TCPConnection **) c1;
-	con2=* (TCPConnection **) c2;
+	if( end < numrows )
+		std::nth_element(first, middle, keys.end(), sortkey_before);
+	std::sort(first, middle, sortkey_before);
 
-
-	if( con1->getAllBytesPerSecond() > con2->getAllBytesPerSecond() )
-		return -1;
-	else if( con1->getAllBytesPerSecond() < con2->getAllBytesPerSecond() )
-		return 1;
-	else
-	{
-		if( con1->getIdleSeconds() < con2->getIdleSeconds() )
-			return -1;
-		else if( con1->getIdleSeconds() > con2->getIdleSeconds() )
-			return 1;
-		else
-			return 0;
-	}
+	nsorted = end;
 }
 
-// this is a callback function used from qsort in sort(). 
-// it performs the comparison of the TCPConnection objects based on total byte count.
-int compare_bytes(const void *c1, const void *c2)
+// get the next row number and advance our current location.
+// returns false if there are no more rows.
+bool SortedIterator::getNext( unsigned int *row )
 {
-	TCPConnection * con1;
-	TCPConnection * con2;
-
-	con1=* (TCPConnection **) c1;
-	con2=* (TCPConnection **) c2;
+	if( cur >= numrows ) 
+		return false;
 
+	if( page != NULL )
+	{
+		if( cur >= pagefirst && cur - pagefirst < page->size() )
+		{
+			*row = (*page)[cur - pagefirst];
+			++cur;
+			return true;
+		}
+		// off the page. Sort after all.
+		page = NULL;
+		makeKeys( cur + SORT_CHUNK );
+	}
 
-	if( con1->getTotalByteCount() > con2->getTotalByteCount() )
-		return -1;
-	else if( con1->getTotalByteCount() < con2->getTotalByteCount() )
-		return 1;
-	else
+	if( keyed )
 	{
-		if( con1->getIdleSeconds() < con2->getIdleSeconds() )
-			return -1;
-		else if( con1->getIdleSeconds() > con2->getIdleSeconds() )
-			return 1;
-		else
-			return 0;
+		if( cur >= nsorted )
+			sortMore( nsorted > SORT_CHUNK ? nsorted : SORT_CHUNK );
+		*row = keys[cur++].idx;
 	}
+	else
+		*row = cur++;
+
+	return true;
 }
 
-// this is a callback function used from qsort in sort().
-// it performs the comparison of the TCPConnection objects based on the idle time.
-int compare_idle(const void *c1, const void *c2)
+void SortedIterator::rewind()
 {
-	TCPConnection * con1;
-	TCPConnection * con2;
-
-	con1=* (TCPConnection **) c1;
-	con2=* (TCPConnection **) c2;
+	cur=0;
+}
 
-	if( con1->getIdleSeconds() < con2->getIdleSeconds() )
-		return 1;
-	else if( con1->getIdleSeconds() > con2->getIdleSeconds() )
-		return -1;
-	else
-		return 0;
+void SortedIterator::seek( unsigned int n )
+{
+	cur=n;
+	if( keyed )
+		while( cur > nsorted && nsorted < numrows )
+			sortMore( cur - nsorted );
 }
 
-// this is a callback function used from qsort in sort().
-// it performs the comparison of the TCPConnection objects based on the inverse of idle time.
-int compare_active(const void *c1, const void *c2)
+SortedIterator::~SortedIterator()
 {
-	TCPConnection * con1;
-	TCPConnection * con2;
+}
 
-	con1=* (TCPConnection **) c1;
-	con2=* (TCPConnection **) c2;
+/////////////////////////////////////////////
 
-	if( con1->getIdleSeconds() < con2->getIdleSeconds() )
-		return -1;
-	else if( con1->getIdleSeconds() > con2->getIdleSeconds() )
-		return 1;
-	else
-		return 0;
+// ordering used by sort(): larger keys come first.
+bool sortkey_before( const sortkey &a, const sortkey &b )
+{
+	if( a.k1 != b.k1 )
+		return a.k1 > b.k1;
+	if( a.k2 != b.k2 )
+		return a.k2 > b.k2;
+	return a.k3 < b.k3;
 }
@@ -28,26 +28,60 @@
 #define SORT_IDLE 4
 #define SORT_ACTIVE 5
 
-class TCContainer;
-class TCPConnection;
+#include <stdint.h>
+#include <limits.h>
+#include <vector>
+#include "TCCSnapshot.h"
 
-int compare_rate(const void *, const void *);
-int compare_bytes(const void *, const void *);
-int compare_idle(const void *, const void *);
-int compare_active(const void *, const void *);
+// a sort key extracted from a snapshot row once per sort, so comparisons
+// only ever look at this array.
+struct sortkey
+{
+	int64_t k1;       // primary key. larger values sort first.
+	int64_t k2;       // tie breaker. larger values sort first.
+	uintptr_t k3;     // last tie breaker. smaller values sort first.
+	unsigned int idx; // row number in the snapshot
+};
 
+bool sortkey_before( const sortkey &a, const sortkey &b );
+
+// iterates over the rows of a TCCSnapshot, optionally sorted.
 class SortedIterator
 {
 public:
-	SortedIterator( TCContainer *c );
+	SortedIterator( const TCCSnapshot *s );
 	~SortedIterator();
-	TCPConnection * getNext();
-	void sort( int sort_type );
+	// puts the next row number in *row. returns false if there are no
+	// more rows.
+	bool getNext( unsigned int *row );
+
+	// nvisible is how many rows the caller expects to look at.
+	// only that many are put in order up front, the rest are ordered
+	// lazily by getNext() if the caller reads past them.
+	void sort( int sort_type, unsigned int nvisible = UINT_MAX );
 	void rewind();
+
+	// skip ahead so the next getNext() returns the n'th row.
+	void seek( unsigned int n );
 private:
-	TCPConnection **cons;
-	unsigned int numcons;
+	void makeKeys( unsigned int n );
+	void sortMore( unsigned int n );
+
+	const TCCSnapshot *snap;
+	unsigned int numrows;
 	unsigned int cur;
+	int sort_type;
+
+	// the page of the rate or byte order the snapshot came with, if it
+	// is in the order asked for. page[0] is row pagefirst.
+	const std::vector<unsigned int> *page;
+	unsigned int pagefirst;
+
+	// other sorts, and rows off the page, walk keys.
+	std::vector<sortkey> keys;
+	bool keyed;
+	// keys[0..nsorted) are in their final order.
+	unsigned int nsorted;
 };
 
 #endif
@@ -0,0 +1,154 @@
+/*
+ *  The code in this file is part of tcptrack. For more information see
+ *    http://www.rhythm.cx/~steve/devel/tcptrack
+ *
+ *     Copyright (C) Steve Benson - 2003
+ *
+ *  tcptrack is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your
+ *  option) any later version.
+ *
+ *  tcptrack is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GNU Make; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#include <string.h>
+#include <sys/socket.h>
+#include "TCCSnapshot.h"
+#include "TCPConnection.h"
+#include "IPv4Address.h"
+#include "IPv6Address.h"
+
+TCCSnapshot::TCCSnapshot()
+{
+	refs=0;
+	generation=0;
+	clear();
+}
+
+void TCCSnapshot::clear()
+{
+	keycol.clear();
+	statecol.clear();
+	bytecol.clear();
+	pktcol.clear();
+	ratecol.clear();
+	tscol.clear();
+	activecol.clear();
+	namecol.clear();
+	ifcol.clear();
+	firstcol.clear();
+	lastcol.clear();
+	pagesort=0;
+	pagefirst=0;
+	pagerows.clear();
+	conncol.clear();
+	namepool.clear();
+	// offset 0 is the empty string.
+	namepool.push_back(0);
+	memset( &totals, 0, sizeof(totals) );
+}
+
+// make room for n rows so the columns don't grow while they're filled.
+void TCCSnapshot::reserve( unsigned int n )
+{
+	keycol.reserve(n);
+	statecol.reserve(n);
+	bytecol.reserve(n);
+	pktcol.reserve(n);
+	ratecol.reserve(n);
+	tscol.reserve(n);
+	activecol.reserve(n);
+	namecol.reserve(n);
+	ifcol.reserve(n);
+	firstcol.reserve(n);
+	lastcol.reserve(n);
+	conncol.reserve(n);
+}
+
+unsigned int TCCSnapshot::addName( const char *s )
+{
+	if( s[0] == 0 )
+		return 0;
+
+	unsigned int off = namepool.size();
+	namepool.insert( namepool.end(), s, s+strlen(s)+1 );
+	return off;
+}
+
+// copy the address out of an IPAddress, whatever kind it is.
+static void copy_addr( const IPAddress &a, struct in6_addr *dst )
+{
+	struct sockaddr_storage ss;
+	socklen_t len = sizeof(ss);
+
+	memset( dst, 0, sizeof(*dst) );
+	a.GetSockAddr( (sockaddr *)&ss, &len );
+	if( ss.ss_family == AF_INET )
+		memcpy( dst, &((sockaddr_in *)&ss)->sin_addr, sizeof(struct in_addr) );
+	else
+		memcpy( dst, &((sockaddr_in6 *)&ss)->sin6_addr, sizeof(struct in6_addr) );
+}
+
+// add a row for c. Returns its row number.
+unsigned int TCCSnapshot::add( TCPConnection *c )
+{
+	struct tcckey k;
+	copy_addr( c->srcAddr(), &k.srcaddr );
+	copy_addr( c->dstAddr(), &k.dstaddr );
+	k.srcport = c->srcPort();
+	k.dstport = c->dstPort();
+	k.family = c->srcAddr().GetType();
+	keycol.push_back(k);
+
+	statecol.push_back( c->getState() );
+	bytecol.push_back( c->getTotalByteCount() );
+	pktcol.push_back( c->getPacketCount() );
+	ratecol.push_back( c->getAllBytesPerSecond() );
+	tscol.push_back( c->getLastPktTimestamp() );
+	activecol.push_back( c->activityToggle() );
+	ifcol.push_back( c->seenOnMask() );
+	conncol.push_back( c );
+	const struct timeval &fc = c->firstCapture();
+	const struct timeval &lc = c->lastCapture();
+	firstcol.push_back( (uint64_t)fc.tv_sec * 1000000 + fc.tv_usec );
+	lastcol.push_back( (uint64_t)lc.tv_sec * 1000000 + lc.tv_usec );
+
+	// the name lookup thread fills in the host first. If it isn't
+	// there yet, show the address.
+	struct tccnames n;
+	if( c->srcHost[0] != 0 )
+	{
+		n.srchost = addName( c->srcHost );
+		n.srcserv = addName( c->srcService );
+	}
+	else
+		n.srchost = n.srcserv = 0;
+	if( c->dstHost[0] != 0 )
+	{
+		n.dsthost = addName( c->dstHost );
+		n.dstserv = addName( c->dstService );
+	}
+	else
+		n.dsthost = n.dstserv = 0;
+	namecol.push_back(n);
+
+	return keycol.size()-1;
+}
+
+char * TCCSnapshot::addrStr( unsigned char family, const struct in6_addr &a )
+{
+	if( family == 6 )
+		return IPv6Address(a).ptr();
+
+	struct in_addr a4;
+	memcpy( &a4, &a, sizeof(a4) );
+	return IPv4Address(a4).ptr();
+}
@@ -0,0 +1,146 @@
+/*
+ *  The code in this file is part of tcptrack. For more information see
+ *    http://www.rhythm.cx/~steve/devel/tcptrack
+ *
+ *     Copyright (C) Steve Benson - 2003
+ *
+ *  tcptrack is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your
+ *  option) any later version.
+ *
+ *  tcptrack is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GNU Make; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#ifndef TCCSNAPSHOT_H
+#define TCCSNAPSHOT_H 1
+
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <time.h>
+#include <vector>
+#include <atomic>
+#include "TCPHeader.h"
+#include "util.h"
+
+class TCPConnection;
+
+// identifies a connection's endpoints in a snapshot.
+struct tcckey
+{
+	struct in6_addr srcaddr; // IPv4 addresses use the first 4 bytes
+	struct in6_addr dstaddr;
+	portnum_t srcport;
+	portnum_t dstport;
+	unsigned char family; // 4 or 6, like IPAddress::GetType()
+};
+
+// offsets of a connection's resolved names in the snapshot's name pool.
+// 0 (an empty string) if the names haven't been looked up.
+struct tccnames
+{
+	unsigned int srchost;
+	unsigned int srcserv;
+	unsigned int dsthost;
+	unsigned int dstserv;
+};
+
+/* A TCCSnapshot is an immutable copy of everything the display needs to
+ * know about the connection table. The TCContainer maintenance thread
+ * builds one every refresh interval and publishes it, so readers never
+ * have to take the connection table lock, and any number of readers can
+ * share the same one.
+ *
+ * It is stored by column: row n of the table is element n of every
+ * column. Anything that only looks at one or two fields (totals, filters,
+ * sort keys) can then run a plain loop over contiguous arrays instead of
+ * chasing pointers.
+ *
+ * Snapshots are reused by TCContainer. Get one with
+ * TCContainer::acquireSnapshot() and give it back with releaseSnapshot().
+ */
+class TCCSnapshot
+{
+	friend class TCContainer;
+	friend class SortedIterator;
+public:
+	TCCSnapshot();
+
+	unsigned int size() const { return keycol.size(); }
+
+	// the columns
+	const std::vector<struct tcckey> & keys() const { return keycol; }
+	const std::vector<unsigned char> & states() const { return statecol; }
+	const std::vector<uint64_t> & bytes() const { return bytecol; }
+	const std::vector<uint64_t> & packets() const { return pktcol; }
+	const std::vector<uint64_t> & rates() const { return ratecol; }
+	const std::vector<time_t> & lastPktTimes() const { return tscol; }
+	// non-zero if a packet was seen since the last snapshot.
+	const std::vector<unsigned char> & active() const { return activecol; }
+	const std::vector<struct tccnames> & names() const { return namecol; }
+	// the interfaces packets were seen on, one bit for each -i.
+	const std::vector<unsigned char> & ifaces() const { return ifcol; }
+	// capture timestamps of the first and last packets, in usec.
+	const std::vector<uint64_t> & firstCaptures() const { return firstcol; }
+	const std::vector<uint64_t> & lastCaptures() const { return lastcol; }
+
+	// the page of the table asked for with TCContainer::view(), in
+	// order: row numbers of the connections ranked pageFirst() on, by
+	// pageSort() (SORT_RATE or SORT_BYTES). pageSort() is 0 if there is
+	// no page.
+	int pageSort() const { return pagesort; }
+	unsigned int pageFirst() const { return pagefirst; }
+	const std::vector<unsigned int> & page() const { return pagerows; }
+
+	const char * name( unsigned int off ) const { return &namepool[off]; }
+
+	// formats an address the same way IPAddress::ptr() does. The
+	// result is in a static buffer.
+	static char * addrStr( unsigned char family, const struct in6_addr &a );
+
+	// the container's totals when this snapshot was taken.
+	struct tcctotals totals;
+
+	// bumped every time the container publishes a new snapshot.
+	unsigned long generation;
+
+private:
+	void clear();
+	void reserve( unsigned int n );
+	unsigned int add( TCPConnection *c );
+	unsigned int addName( const char *s );
+
+	std::vector<struct tcckey> keycol;
+	std::vector<unsigned char> statecol;
+	std::vector<uint64_t> bytecol;
+	std::vector<uint64_t> pktcol;
+	std::vector<uint64_t> ratecol;
+	std::vector<time_t> tscol;
+	std::vector<unsigned char> activecol;
+	std::vector<struct tccnames> namecol;
+	std::vector<unsigned char> ifcol;
+	std::vector<uint64_t> firstcol;
+	std::vector<uint64_t> lastcol;
+
+	int pagesort;
+	unsigned int pagefirst;
+	std::vector<unsigned int> pagerows;
+	std::vector<char> namepool;
+
+	// the connection each row was copied from, for TCContainer to keep
+	// its order indexes with and for SortedIterator to break ties the
+	// same way. Not to be dereferenced: it may be gone.
+	std::vector<TCPConnection *> conncol;
+
+	// number of readers holding this snapshot.
+	std::atomic<int> refs;
+};
+
+#endif
@@ -26,31 +26,67 @@
 #include <stdio.h>
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 #include "TCPConnection.h"
 #include "Collector.h"
 #include "TCContainer.h"
-#include "SortedIterator.h"
+#include "TCCSnapshot.h"
 #include "defs.h"
 #include "util.h"
 #include "Guesser.h"
 //#include "IPv4Packet.h"
 #include "SocketPair.h"
+#include "FlowCache.h"
+#include "IPv4Address.h"
+#include "IPv6Address.h"
 #include "TCPTrack.h"
 #include "GenericError.h"
+#include "SortedIterator.h"
 
 extern TCPTrack *app;
 
-TCContainer::TCContainer()
+TCContainer::TCContainer( bool threaded )
 {
 	//
 	// Start up maintenence thread
 	//
 	state=TSTATE_IDLE;
 
+	memset( &totals, 0, sizeof(totals) );
+	latency_sum=0;
+	latency_count=0;
+	latency_max=0;
+	removals=0;
+	viewsort=0;
+	viewfirst=0;
+	viewcount=0;
+	memset( lastifbytes, 0, sizeof(lastifbytes) );
+	struct timeval now;
+	gettimeofday(&now,NULL);
+	lastiftime = (uint64_t)now.tv_sec * 1000000 + now.tv_usec;
+
 	pthread_attr_t attr;
 
 	pthread_mutex_init( &conlist_lock, NULL );
 	pthread_mutex_init( &state_mutex, NULL );
+	pthread_mutex_init( &snap_lock, NULL );
+	pthread_cond_init( &snap_flag, NULL );
+
+	// readers always have something to look at, even before the first
+	// maintenance run.
+	published = NULL;
+	publishSnapshot( freeSnapshot() );
+
+	state=TSTATE_RUNNING;
+	purgeflag=true;
+	run_maint_thread=threaded;
+
+	// without threads, the Collector just deletes connections as they
+	// are purged.
+	if( !run_maint_thread )
+		return;
+
+	collector.init();
 
 	if( pthread_attr_init( &attr ) != 0 )
 		throw GenericError("pthread_attr_init() failed");
@@ -59,9 +95,6 @@ TCContainer::TCContainer()
 
 	if( pthread_create(&maint_thread_tid,&attr,maint_thread_func,this) != 0 )
 		throw GenericError("pthread_create() failed.");
-
-	state=TSTATE_RUNNING;
-	purgeflag=true;
 }
 
 // remove closed connections?
@@ -84,7 +117,8 @@ void TCContainer::stop()
 
 	// maint thread will notice that state is no longer RUNNING and
 	// will exit. just wait for it...
-	pthread_join(maint_thread_tid,NULL);	
+	if( run_maint_thread )
+		pthread_join(maint_thread_tid,NULL);	
 
 	state=TSTATE_DONE;
 }
@@ -92,19 +126,174 @@ void TCContainer::stop()
 TCContainer::~TCContainer()
 {
 	stop();
+	removeAll();
+
+	// whoever acquired snapshots should have released them by now.
+	for( unsigned int i=0; i<snappool.size(); i++ )
+		delete snappool[i];
+}
+
+void TCContainer::clear()
+{
+	lock();
+	removeAll();
+	unlock();
+}
+
+void TCContainer::removeAll()
+{
 	for( tccmap::iterator i=conhash2.begin(); i!=conhash2.end(); )
 	{
 		TCPConnection *rm = (*i).second;
 		tccmap::iterator tmp_i = i;
 		i++;
 		conhash2.erase(tmp_i);
+		gone.push_back(rm);
+		account(rm,-1);
 		collector.collect(rm);
+		++removals;
+	}
+}
+
+void TCContainer::view( int sort, unsigned int first, unsigned int count )
+{
+	viewsort = sort;
+	viewfirst = first;
+	viewcount = count;
+}
+
+// bring the order index being looked at up to date with snap, and give
+// snap the page of it that was asked for. dead are connections removed
+// since the last time.
+void TCContainer::rank( TCCSnapshot *snap,
+	const std::vector<TCPConnection *> &dead )
+{
+	// the dead go first: a new connection may have been given the
+	// address of one of them.
+	for( unsigned int i=0; i<dead.size(); i++ )
+	{
+		byrate.remove(dead[i]);
+		bybytes.remove(dead[i]);
+	}
+
+	// the other index isn't kept up while nobody looks at it. Every row
+	// is updated anyway, so it catches up as soon as it's wanted.
+	int sort = viewsort;
+	OrderIndex *idx;
+	const std::vector<uint64_t> *keys;
+	if( sort == SORT_RATE )
+	{
+		idx = &byrate;
+		keys = &snap->rates();
+	}
+	else if( sort == SORT_BYTES )
+	{
+		idx = &bybytes;
+		keys = &snap->bytes();
+	}
+	else
+		return;
+
+	const std::vector<time_t> &ts = snap->lastPktTimes();
+	for( unsigned int r=0; r<snap->size(); r++ )
+		idx->update( snap->conncol[r], (*keys)[r], ts[r], r );
+
+	unsigned int first = viewfirst;
+	unsigned int count = viewcount;
+	snap->pagesort = sort;
+	snap->pagefirst = first;
+	for( OrderIndex::Node *n=idx->at(first);
+			n!=NULL && snap->pagerows.size()<count; n=OrderIndex::next(n) )
+		snap->pagerows.push_back( OrderIndex::row(n) );
+}
+
+void TCContainer::account( TCPConnection *c, int sign )
+{
+	if( sign > 0 )
+	{
+		totals.bytes += c->getTotalByteCount();
+		totals.packets += c->getPacketCount();
+		totals.bps += c->getAllBytesPerSecond();
+		totals.connections++;
+		totals.states[c->getState()]++;
+	}
+	else
+	{
+		totals.bytes -= c->getTotalByteCount();
+		totals.packets -= c->getPacketCount();
+		totals.bps -= c->getAllBytesPerSecond();
+		totals.connections--;
+		totals.states[c->getState()]--;
+	}
+}
+
+TCCSnapshot * TCContainer::acquireSnapshot()
+{
+	while( true )
+	{
+		TCCSnapshot *s = published;
+		++s->refs;
+		// if it was swapped out before we got our reference in, the
+		// maint thread may already be refilling it. Try again.
+		if( s == published )
+			return s;
+		--s->refs;
+	}
+}
+
+void TCContainer::releaseSnapshot( TCCSnapshot *s )
+{
+	--s->refs;
+}
+
+bool TCContainer::waitSnapshot( unsigned long gen, unsigned int usec )
+{
+	struct timespec timeout;
+	clock_gettime(CLOCK_REALTIME, &timeout);
+	timeout.tv_sec += usec / 1000000;
+	timeout.tv_nsec += (usec % 1000000) * 1000;
+	if( timeout.tv_nsec >= 1000000000 )
+	{
+		timeout.tv_sec++;
+		timeout.tv_nsec -= 1000000000;
+	}
+
+	pthread_mutex_lock(&snap_lock);
+	while( published.load()->generation <= gen )
+	{
+		if( pthread_cond_timedwait(&snap_flag, &snap_lock, &timeout) != 0 )
+			break;
+	}
+	bool r = published.load()->generation > gen;
+	pthread_mutex_unlock(&snap_lock);
+	return r;
+}
+
+// find a snapshot that no reader holds, to be filled in.
+// only called from the maint thread (and the constructor).
+TCCSnapshot * TCContainer::freeSnapshot()
+{
+	for( unsigned int i=0; i<snappool.size(); i++ )
+	{
+		TCCSnapshot *s = snappool[i];
+		if( s != published && s->refs == 0 )
+			return s;
 	}
+
+	TCCSnapshot *s = new TCCSnapshot();
+	snappool.push_back(s);
+	return s;
 }
 
-SortedIterator * TCContainer::getSortedIteratorPtr()
+void TCContainer::publishSnapshot( TCCSnapshot *s )
 {
-	return new SortedIterator(this);
+	TCCSnapshot *old = published;
+	s->generation = ( old == NULL ) ? 1 : old->generation + 1;
+
+	pthread_mutex_lock(&snap_lock);
+	published = s;
+	pthread_cond_broadcast(&snap_flag);
+	pthread_mutex_unlock(&snap_lock);
 }
 
 // the sniffer (or PacketBuffer rather) hands us packets via this method.
@@ -124,9 +313,18 @@ bool TCContainer::processPacket( TCPCapture &p )
 	for( tccmap::const_iterator i = pr.first; i!=pr.second; i++ )
 	{
 		TCPConnection *ic = (*i).second;
+		int ostate = ic->getState();
 		if( ic->acceptPacket( p ) )
 		{
 			found=true;
+			ic->seenOn( p.iface() );
+			totals.bytes += (uint64_t)p.GetPacket().totalLen() * p.weight();
+			totals.packets += p.weight();
+			if( ic->getState() != ostate )
+			{
+				totals.states[ostate]--;
+				totals.states[ic->getState()]++;
+			}
 		}
 	}
 
@@ -136,6 +334,7 @@ bool TCContainer::processPacket( TCPCapture &p )
 		TCPConnection *newcon = new TCPConnection( p );
 		found = true;
 		conhash2.insert(tccmap::value_type(sp,newcon));
+		account(newcon,1);
 	}
 
 	// a stray packet. Feed it to guesser. Guesser tries to learn about
@@ -144,7 +343,35 @@ bool TCContainer::processPacket( TCPCapture &p )
 	{
 		TCPConnection *newcon = guesser.addPacket(p);
 		if( newcon != NULL )
+		{
+			newcon->seenOn( p.iface() );
 			conhash2.insert(tccmap::value_type(sp,newcon));
+			account(newcon,1);
+			// the connection may have been built from the stray packet
+			// before this one. This packet's interface gets what
+			// account() put in the totals, so the two still add up.
+			totals.ifbytes[p.iface()] += newcon->getTotalByteCount();
+		}
+	}
+
+	if( found )
+		totals.ifbytes[p.iface()] +=
+			(uint64_t)p.GetPacket().totalLen() * p.weight();
+
+	// how long since the kernel timestamped this packet?
+	if( app->busypoll )
+	{
+		struct timeval now;
+		gettimeofday(&now,NULL);
+		struct timeval ts = p.timestamp();
+		int64_t usec = (int64_t)(now.tv_sec - ts.tv_sec) * 1000000
+			+ (now.tv_usec - ts.tv_usec);
+		if( usec < 0 )
+			usec = 0;
+		latency_sum += usec;
+		latency_count++;
+		if( (uint64_t)usec > latency_max )
+			latency_max = usec;
 	}
 
 	unlock();
@@ -152,6 +379,74 @@ bool TCContainer::processPacket( TCPCapture &p )
 	return found;
 }
 
+// the connection a FlowCache key belongs to, or NULL.
+TCPConnection * TCContainer::find( const struct tcckey &k )
+{
+	tccmap::iterator c;
+	if( k.family == 6 )
+	{
+		IPv6Address src(k.srcaddr), dst(k.dstaddr);
+		c = conhash2.find( SocketPair(src, k.srcport, dst, k.dstport) );
+	}
+	else
+	{
+		struct in_addr a;
+		memcpy( &a, &k.srcaddr, sizeof(a) );
+		IPv4Address src(a);
+		memcpy( &a, &k.dstaddr, sizeof(a) );
+		IPv4Address dst(a);
+		c = conhash2.find( SocketPair(src, k.srcport, dst, k.dstport) );
+	}
+	return c == conhash2.end() ? NULL : (*c).second;
+}
+
+void TCContainer::applyFlows( struct flowent *flows, unsigned int n,
+	unsigned int iface )
+{
+	lock();
+	for( unsigned int i=0; i<n; i++ )
+	{
+		struct flowent *e = &flows[i];
+		// an established flow with nothing to hand over is left alone.
+		if( !e->used || (e->established && e->packets == 0) )
+			continue;
+
+		// the connection found last time is still there unless
+		// something has been removed since.
+		if( e->conn == NULL || e->conngen != removals )
+		{
+			e->conn = find( e->key );
+			e->conngen = removals;
+		}
+
+		TCPConnection *ic = e->conn;
+		if( ic == NULL )
+		{
+			// gone. Whatever was counted since goes with it, as a
+			// packet for an unknown connection would have.
+			e->established = false;
+			continue;
+		}
+
+		if( e->packets > 0 )
+		{
+			ic->addCounts( e->bytes, e->packets, e->last );
+			totals.bytes += e->bytes;
+			totals.packets += e->packets;
+			totals.ifbytes[iface] += e->bytes;
+			ic->seenOn(iface);
+		}
+
+		// a flow waiting on a FIN stays out until the FIN has been
+		// seen here. Before that, the connection is still up.
+		bool up = ( ic->getState() == TCP_STATE_UP );
+		if( e->closing && !up )
+			e->closing = false;
+		e->established = up && !e->closing;
+	}
+	unlock();
+}
+
 unsigned int TCContainer::numConnections()
 {
 	return conhash2.size();
@@ -165,7 +460,8 @@ void TCContainer::maint_thread_run()
 		struct timeval now;
 		gettimeofday(&now,NULL);
 		uint64_t tmp1 = now.tv_sec * 1000000 + now.tv_usec;
-		uint32_t tmp2 = app->refresh_intvl - (tmp1 % app->refresh_intvl);
+		unsigned int intvl = app->refresh_intvl;
+		uint32_t tmp2 = intvl - (tmp1 % intvl);
 
 		struct timespec ts;
 		ts.tv_sec=tmp2 / 1000000;
@@ -173,38 +469,99 @@ void TCContainer::maint_thread_run()
 
 		nanosleep(&ts,NULL);
 
-		lock();
+		maintain();
+	}
+}
+
+void TCContainer::maintain()
+{
+	lock();
+
+	TCCSnapshot *snap = freeSnapshot();
+	snap->clear();
+	snap->reserve( conhash2.size() );
+
+	// how long this interval was. The display refreshes by the wall
+	// clock, but a replay's clock can run faster or slower than that, or
+	// stand still while paused. Then the rates stay as they were.
+	uint64_t nowus = app->rclock.now();
+	uint64_t from = lastiftime;
+	// count from where the replay clock last started over, if that was
+	// since the last pass.
+	if( app->rclock.running() )
+	{
+		uint64_t o = app->rclock.origin();
+		if( from < o || from > nowus )
+			from = o;
+	}
+	uint64_t span = nowus > from ? nowus - from : 0;
+	uint64_t intvl = app->rclock.enabled() ? span : app->refresh_intvl.load();
 
-		for( tccmap::iterator i=conhash2.begin(); i!=conhash2.end(); )
+	for( tccmap::iterator i=conhash2.begin(); i!=conhash2.end(); )
+	{
+		TCPConnection *ic=(*i).second;
+		if( intvl > 0 )
 		{
-			TCPConnection *ic=(*i).second;
-				ic->updateCounters();
+			ic->updateCounters(intvl);
+			totals.bps -= ic->getAllBytesPerSecond();
+			ic->recalcAvg();
+			totals.bps += ic->getAllBytesPerSecond();
+		}
 
-			// remove closed or stale connections.
-			if( purgeflag==true )
-			{
-				if(    ( ic->isFinished() && ic->getIdleSeconds() > app->remto )
-						|| ( ic->getState()==TCP_STATE_SYN_SYNACK && ic->getIdleSeconds()>SYN_SYNACK_WAIT )
-						|| ( ic->getState()==TCP_STATE_FIN_FINACK && ic->getIdleSeconds()>FIN_FINACK_WAIT )
-					)
-				{
-					TCPConnection *rm = ic;
-					tccmap::iterator tmp_i = i;
-					i++;
-					conhash2.erase(tmp_i);
-					collector.collect(rm);
-				}
-				else
-					i++;
-			}
-			else
+		// remove closed or stale connections.
+		if( purgeflag==true )
+		{
+			if(    ( ic->isFinished() && ic->getIdleSeconds() > app->remto )
+					|| ( ic->getState()==TCP_STATE_SYN_SYNACK && ic->getIdleSeconds()>SYN_SYNACK_WAIT )
+					|| ( ic->getState()==TCP_STATE_FIN_FINACK && ic->getIdleSeconds()>FIN_FINACK_WAIT )
+				)
 			{
+				TCPConnection *rm = ic;
+				tccmap::iterator tmp_i = i;
 				i++;
+				conhash2.erase(tmp_i);
+				gone.push_back(rm);
+				account(rm,-1);
+				collector.collect(rm);
+				++removals;
+				continue;
 			}
 		}
 
-		unlock();		
+		snap->add(ic);
+		i++;
+	}
+
+	totals.latency_avg = latency_count ? latency_sum / latency_count : 0;
+	totals.latency_max = latency_max;
+	latency_sum = latency_count = latency_max = 0;
+
+	if( span > 0 )
+	{
+		for( int i=0; i<MAX_IFACES; i++ )
+		{
+			totals.ifbps[i] = rate_per_sec(
+				totals.ifbytes[i] - lastifbytes[i], span );
+			lastifbytes[i] = totals.ifbytes[i];
+		}
 	}
+	lastiftime = nowus;
+
+	snap->totals = totals;
+
+	std::vector<TCPConnection *> dead;
+	dead.swap(gone);
+
+	unlock();
+
+	// ranking can take a while with a big table. The packet path
+	// doesn't need to wait for it.
+	rank( snap, dead );
+
+	publishSnapshot(snap);
+
+	// shed or restore load for the next interval.
+	app->governor.step();
 }
 
 
@@ -233,6 +590,7 @@ void TCContainer::unlock()
 void *maint_thread_func( void * arg )
 {
 	TCContainer *c = (TCContainer *) arg;
+	app->affinity.apply(AFF_MAINT);
 	try
 	{
 		c->maint_thread_run();
@@ -38,10 +38,12 @@
 #include "Guesser.h"
 #include "Collector.h"
 #include "TCPConnection.h"
-#include "SortedIterator.h"
+#include "OrderIndex.h"
+#include "TCCSnapshot.h"
 #include "util.h"
 #include "TCPCapture.h"
 #include "SocketPair.h"
+#include "HugeMem.h"
 
 #define TSTATE_IDLE 1
 #define TSTATE_RUNNING 2
@@ -77,23 +79,36 @@ public:
 	}
 };
 
-typedef hash_map<SocketPair, TCPConnection *, TCCHashFunc, TCCEqFunc> tccmap;
+typedef hash_map<SocketPair, TCPConnection *, TCCHashFunc, TCCEqFunc,
+	HugeAllocator<TCPConnection *> > tccmap;
 
 ////
 
-
+struct flowent;
+struct tcckey;
 
 class TCContainer
 {
-	friend class SortedIterator;
 	friend class TCCSnapshot;
 public:
-	TCContainer();
+	// if threaded is false, nothing runs in the background and the
+	// caller has to call maintain() once every refresh interval.
+	TCContainer( bool threaded=true );
 	~TCContainer();
 
 	bool processPacket( TCPCapture &p );
+
+	// take the counts a FlowCache has collected on interface iface.
+	// Marks the flows that belong to established connections so the
+	// cache keeps counting them.
+	void applyFlows( struct flowent *flows, unsigned int n,
+		unsigned int iface=0 );
 	unsigned int numConnections();
 
+	// forget every connection, as when a test file jumps to another
+	// time.
+	void clear();
+
 	void stop();
 
 	void lock();
@@ -102,14 +117,31 @@ public:
 	// do not call. only called from maint_thread_func.
 	void maint_thread_run();
 
-	SortedIterator * getSortedIteratorPtr();
+	// update averages, remove expired connections and publish a new
+	// snapshot. The maint thread does this once per refresh interval.
+	void maintain();
+
+	// get the most recently published snapshot of the connection table.
+	// This never waits for the connection table lock. Every snapshot
+	// acquired must be given back with releaseSnapshot().
+	TCCSnapshot * acquireSnapshot();
+	void releaseSnapshot( TCCSnapshot *s );
+
+	// wait up to usec microseconds for a snapshot newer than generation
+	// gen to be published. Returns true if there is one.
+	bool waitSnapshot( unsigned long gen, unsigned int usec );
 
 	// remove closed connections?
 	void purge(bool npurgeflag);
+
+	// the rows a reader is about to show: count connections from rank
+	// first on, sorted by sort. With SORT_RATE or SORT_BYTES the next
+	// snapshots carry that page of the order. See TCCSnapshot::page().
+	void view( int sort, unsigned int first, unsigned int count );
 private:
-	// this Collector thing gets closed connections after a certain 
-	// delay. Right now it just deletes them. It could log their stats
-	// or something...
+	// connections removed from conhash2 are handed to the Collector,
+	// which deletes them in its own thread. It's declared first so it
+	// is destroyed last, after everything has been handed over.
 	Collector collector;
 
 	// this is a hash table that stores all the connections we're 
@@ -117,10 +149,45 @@ private:
 	tccmap conhash2;	
 	pthread_mutex_t conlist_lock; 
 
+	// the same connections ordered by rate and by total bytes, so a page
+	// of the order can be handed out without sorting everything. Only
+	// maintain() touches them, from the snapshot it has just filled and
+	// after letting go of the lock. Connections removed in the meantime
+	// wait in gone, which is guarded by the lock, to be taken out.
+	OrderIndex byrate;
+	OrderIndex bybytes;
+	std::vector<TCPConnection *> gone;
+	void rank( TCCSnapshot *snap, const std::vector<TCPConnection *> &dead );
+	std::atomic<int> viewsort;
+	std::atomic<unsigned int> viewfirst;
+	std::atomic<unsigned int> viewcount;
+	// clear() without the lock.
+	void removeAll();
+	TCPConnection * find( const struct tcckey &k );
+	// bumped whenever a connection is removed, so a FlowCache knows
+	// when the connections it remembers may be gone.
+	unsigned long removals;
+
+	// running totals over all connections in conhash2.
+	struct tcctotals totals;
+	// add (sign 1) or remove (sign -1) c's contribution to totals.
+	void account( TCPConnection *c, int sign );
+
+	// capture to accounting latency of packets since the last
+	// maintenance pass, in usec. Only kept when busy polling.
+	uint64_t latency_sum;
+	uint64_t latency_count;
+	uint64_t latency_max;
+
+	// totals.ifbytes at the last maintenance pass, and when that was
+	// (usec), for the per interface rates.
+	uint64_t lastifbytes[MAX_IFACES];
+	uint64_t lastiftime;
+
 	// this is for the maintenence thread, which runs regularly to
 	// recalculate averages and anything else like that.
 	pthread_t maint_thread_tid;
-	bool run_maint_thread;
+	bool run_maint_thread; // false if the caller calls maintain() itself
 
 	// This thing takes stray packets (TCP packets for connections that
 	// we're not tracking) and keeps track of them and tries to determine
@@ -130,6 +197,18 @@ private:
 	// track of it as usual.
 	Guesser guesser;
 
+	// snapshots for readers. The maint thread fills one that nobody is
+	// reading and then swaps it in as the published one. With one reader
+	// this settles down to three buffers.
+	// snappool is only touched by the maint thread.
+	TCCSnapshot * freeSnapshot();
+	void publishSnapshot( TCCSnapshot *s );
+	std::vector<TCCSnapshot *> snappool;
+	std::atomic<TCCSnapshot *> published;
+	// waitSnapshot() sleeps on this. It isn't needed to read snapshots.
+	pthread_mutex_t snap_lock;
+	pthread_cond_t snap_flag;
+
 	// for starting up, shutting down the maint thread.
 	int state;
 	pthread_mutex_t state_mutex;
@@ -8,16 +8,20 @@
 #include "util.h"
 
 TCPCapture::TCPCapture( TCPPacket *tcp_packet,
-		struct timeval nts )
+		struct timeval nts, unsigned int nweight, unsigned int niface )
 {
 	m_packet = tcp_packet;
 	m_ts = nts;
+	m_weight = nweight;
+	m_iface = niface;
 }
 
 TCPCapture::TCPCapture( const TCPCapture & orig )
 {
 	m_packet = new TCPPacket( *orig.m_packet );
 	m_ts = orig.m_ts;
+	m_weight = orig.m_weight;
+	m_iface = orig.m_iface;
 }
 
 TCPCapture::~TCPCapture()
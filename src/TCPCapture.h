@@ -10,15 +10,22 @@
 class TCPCapture
 {
 public:
+	// weight is how many packets this one stands for, if sampling.
+	// iface is the -i interface it was captured on.
 	TCPCapture( TCPPacket* tcp_packet,
-			struct timeval nts );
+			struct timeval nts, unsigned int nweight=1,
+			unsigned int niface=0 );
 	TCPCapture( const TCPCapture &orig );
 	~TCPCapture();
 	TCPPacket & GetPacket() const;
 	struct timeval timestamp() const { return m_ts; };
+	unsigned int weight() const { return m_weight; };
+	unsigned int iface() const { return m_iface; };
 private:
 	TCPPacket *m_packet;	
 	struct timeval m_ts;
+	unsigned int m_weight;
+	unsigned int m_iface;
 };
 
 #endif
@@ -41,9 +41,25 @@
 
 extern TCPTrack *app;
 
+static SlabPool connpool( sizeof(TCPConnection) );
+
+void * TCPConnection::operator new( size_t n )
+{
+	void *p = connpool.alloc();
+	if( p == NULL )
+		throw std::bad_alloc();
+	return p;
+}
+
+void TCPConnection::operator delete( void *p )
+{
+	connpool.free(p);
+}
+
 TCPConnection::~TCPConnection()
 {
-	pthread_join(lookup_thread_tid, NULL);
+	if( lookup_started )
+		pthread_join(lookup_thread_tid, NULL);
 
 	delete srcaddr;
 	delete dstaddr;
@@ -77,12 +93,12 @@ portnum_t TCPConnection::dstPort()
 	return dstport;
 }
 
-int TCPConnection::getPacketCount()
+uint64_t TCPConnection::getPacketCount()
 {
 	return packet_count;
 }
 
-long TCPConnection::getTotalByteCount()
+uint64_t TCPConnection::getTotalByteCount()
 {
 	return total_byte_count;
 }
@@ -99,19 +115,20 @@ TCPConnection::TCPConnection( TCPCapture &p )
 	srcport = p.GetPacket().tcp().srcPort();
 	dstport = p.GetPacket().tcp().dstPort();
 
-	packet_count=1;
+	packet_count=p.weight();
 	if( p.GetPacket().tcp().syn() )
 		state = TCP_STATE_SYN_SYNACK;
 	else
 		state = TCP_STATE_UP;
 
 	// init per-second stats counters
-	last_pkt_ts = time(NULL);
+	last_pkt_ts = app->rclock.seconds();
+	first_cap = last_cap = p.timestamp();
 	activity_toggle=true;
 
 	//payload_byte_count = p.GetPacket().payloadLen()-p.GetPacket().tcp().headerLen();
-	total_byte_count = p.GetPacket().totalLen();
-	total_bytes_this_interval = p.GetPacket().totalLen();
+	total_byte_count = (uint64_t)p.GetPacket().totalLen() * p.weight();
+	total_bytes_this_interval = total_byte_count;
 
 	avg_bps=0;
 
@@ -122,27 +139,27 @@ TCPConnection::TCPConnection( TCPCapture &p )
 
 	endpts = new SocketPair( *srcaddr, srcport, *dstaddr, dstport);
 
+	ifmask = 1 << p.iface();
+
 	srcHost[0] = 0;
 	dstHost[0] = 0;
 	srcService[0] = 0;
 	dstService[0] = 0;
 
 	// Start thread to resolve addresses
+	lookup_started = false;
 	if ( app->names )
 		startNameLookup();
 }
 
 void TCPConnection::purgeAvgStack()
 {
-	struct timeval now;
-	gettimeofday(&now,NULL);
-
 	// Keep 3 seconds of statistics
 	uint64_t limit;
-	limit = now.tv_sec * 1000000 + now.tv_usec;
+	limit = app->rclock.now();
 	limit -= 3 * 1000000;
 
-	list<struct avgstat>::iterator i;
+	avglist::iterator i;
 	for( i=avgstack.begin(); i!=avgstack.end(); i++ )
 	{
 		if( i->ts <= limit )
@@ -155,16 +172,14 @@ void TCPConnection::purgeAvgStack()
 
 // updates the byte counters
 // must be called once per UI refresh interval
-void TCPConnection::updateCounters()
+void TCPConnection::updateCounters( uint64_t intvl )
 {
 	purgeAvgStack();
 
-	struct timeval now;
-	gettimeofday(&now,NULL);
-
 	struct avgstat s;
-	s.ts = now.tv_sec * 1000000 + now.tv_usec;
+	s.ts = app->rclock.now();
 	s.size = total_bytes_this_interval;
+	s.len = intvl;
 	avgstack.push_front(s);
 
 	total_bytes_this_interval = 0;
@@ -173,28 +188,24 @@ void TCPConnection::updateCounters()
 // recalculate packets/bytes per second counters
 void TCPConnection::recalcAvg()
 {
-	unsigned int total_bytes = 0;
+	uint64_t total_bytes = 0;
 	uint64_t time1 = 0;
 	uint64_t time2 = 0;
+	uint64_t len1 = 0;
 
-	list<struct avgstat>::iterator i;
+	avglist::iterator i;
 	for( i=avgstack.begin(); i!=avgstack.end(); i++ )
 	{
 		total_bytes += i->size;
 		time1 = i->ts;
+		len1 = i->len;
 		if (time2 == 0)
 			time2 = i->ts;
 	}
 
-	uint64_t time_interval = time2 - time1 + app->refresh_intvl;
-	if (time_interval > 0)
-	{
-		avg_bps = total_bytes / (time_interval / 1000000.0);
-	}
-	else
-	{
-		avg_bps = 0;
-	}
+	// from the start of the oldest interval to the end of the newest.
+	uint64_t time_interval = time2 - time1 + len1;
+	avg_bps = rate_per_sec( total_bytes, time_interval );
 }
 
 time_t TCPConnection::getLastPktTimestamp()
@@ -216,15 +227,16 @@ bool TCPConnection::match( IPAddress &sa, IPAddress &da, portnum_t sp, portnum_t
 
 time_t TCPConnection::getIdleSeconds()
 {
-	return time(NULL) - getLastPktTimestamp();
+	return app->rclock.seconds() - getLastPktTimestamp();
 }
 
 void TCPConnection::updateCountersForPacket( TCPCapture &p )
 {
 	// TODO add an option for payload-based counters
 	//payload_bytes = p.GetPacket().payloadLen() - p.GetPacket().tcp().headerLen();
-	total_bytes_this_interval += p.GetPacket().totalLen();
-	total_byte_count += p.GetPacket().totalLen();
+	uint64_t len = (uint64_t)p.GetPacket().totalLen() * p.weight();
+	total_bytes_this_interval += len;
+	total_byte_count += len;
 }
 
 bool TCPConnection::acceptPacket( TCPCapture &cap )
@@ -238,7 +250,7 @@ bool TCPConnection::acceptPacket( TCPCapture &cap )
 	if(  match(p->srcAddr(), p->dstAddr(), p->tcp().srcPort(), p->tcp().dstPort())
 		|| match(p->dstAddr(), p->srcAddr(), p->tcp().dstPort(), p->tcp().srcPort()) )
 	{
-		++packet_count;
+		packet_count += cap.weight();
 		activity_toggle=true;
 
 		// recalculate packets/bytes per second counters
@@ -298,7 +310,11 @@ bool TCPConnection::acceptPacket( TCPCapture &cap )
 		if( p->tcp().rst() )
 			state = TCP_STATE_RESET;
 
-		last_pkt_ts = time(NULL);
+		last_pkt_ts = app->rclock.seconds();
+		// with several interfaces, packets can be a little out of order.
+		struct timeval ts = cap.timestamp();
+		if( timercmp(&ts, &last_cap, >) )
+			last_cap = ts;
 
 		return true;
 	}
@@ -306,7 +322,21 @@ bool TCPConnection::acceptPacket( TCPCapture &cap )
 	return false;
 }
 
-int TCPConnection::getAllBytesPerSecond()
+void TCPConnection::addCounts( uint64_t bytes, uint64_t packets,
+	const struct timeval &last )
+{
+	packet_count += packets;
+	total_bytes_this_interval += bytes;
+	total_byte_count += bytes;
+	activity_toggle=true;
+	// both times move on as acceptPacket() moves them for a packet.
+	if( last.tv_sec > last_pkt_ts )
+		last_pkt_ts = last.tv_sec;
+	if( timercmp(&last, &last_cap, >) )
+		last_cap = last;
+}
+
+uint64_t TCPConnection::getAllBytesPerSecond()
 {
 	return avg_bps;
 }
@@ -338,6 +368,7 @@ void TCPConnection::startNameLookup()
 
 	if( pthread_create(&lookup_thread_tid, &attr, NameLookup_thread, this) != 0 )
 		throw GenericError("pthread_create() failed.");
+	lookup_started = true;
 }
 
 void TCPConnection::doNameLookup()
@@ -404,6 +435,7 @@ void TCPConnection::doNameLookup()
 void *NameLookup_thread( void * arg )
 {
 	TCPConnection *c = (TCPConnection *) arg;
+	app->affinity.apply(AFF_NAMES);
 	c->doNameLookup();
 
 	return NULL;
@@ -31,6 +31,7 @@
 #include "TCPHeader.h"
 #include "TCPCapture.h"
 #include "SocketPair.h"
+#include "HugeMem.h"
 
 #define TCP_STATE_SYN_SYNACK    1 // initial SYN sent, waiting for SYN ACK
 #define TCP_STATE_SYNACK_ACK 2 // SYN&ACK response sent, waiting for ACK
@@ -50,6 +51,11 @@ public:
 	TCPConnection( TCPCapture &p );
 	~TCPConnection();
 
+	// connections come out of a SlabPool, so with -H they sit in huge
+	// pages.
+	static void * operator new( size_t n );
+	static void operator delete( void *p );
+
 	// returns true if the given addresses/ports are relevant to this
 	// connection.
 	bool match(IPAddress &sa, IPAddress &da, portnum_t sp, portnum_t dp);
@@ -59,6 +65,11 @@ public:
 	// state will be changed to reflect the new packet.
 	bool acceptPacket( TCPCapture &p );
 
+	// count packets that a FlowCache absorbed for this connection. They
+	// are ones acceptPacket() would only have counted.
+	void addCounts( uint64_t bytes, uint64_t packets,
+		const struct timeval &last );
+
 	// get the addresses/ports which are the endpoints for this
 	// connection.
 	IPAddress & srcAddr();
@@ -84,9 +95,15 @@ public:
 	// number of seconds since last packet sent either way
 	time_t getIdleSeconds();
 
+	// capture timestamps of the first and last packets, rather than
+	// when they were seen. They only differ for a test file.
+	const struct timeval & firstCapture() const { return first_cap; }
+	const struct timeval & lastCapture() const { return last_cap; }
+
 	// called to perform internal updates to counters and stuff.
-	// should be called exactly once per refresh interval.
-	void updateCounters();
+	// should be called exactly once per refresh interval. intvl is how
+	// long the interval was, in usec.
+	void updateCounters( uint64_t intvl );
 
 	// called to recalculate averages
 	void recalcAvg();
@@ -97,14 +114,14 @@ public:
 	bool activityToggle();
 
 	// number of packets sent either way in total for this connection
-	int getPacketCount();
+	uint64_t getPacketCount();
 
 	// number of bytes sent either way in total for this connection
-	long getTotalByteCount();
+	uint64_t getTotalByteCount();
 
 	// average number of bytes per second this connection is doing
 	// this counts the tcp and ip headers (but not link layer header)
-	int getAllBytesPerSecond();
+	uint64_t getAllBytesPerSecond();
 
 	// a SocketPair is two IPAddresses and two TCP port numbers.
 	// The pair of each represents this connections src/dst addrs & ports.
@@ -112,6 +129,11 @@ public:
 
 	void doNameLookup();
 
+	// remember that a packet of this connection came in on interface i.
+	void seenOn( unsigned int i ) { ifmask |= 1 << i; }
+	// which interfaces packets came in on, one bit for each -i.
+	unsigned int seenOnMask() const { return ifmask; }
+
 private:
 	void purgeAvgStack();
 	void updateCountersForPacket( TCPCapture &p );
@@ -131,19 +153,25 @@ private:
 	int state;
 
 	time_t last_pkt_ts;
+	struct timeval first_cap;
+	struct timeval last_cap;
 
-	int packet_count;
+	uint64_t packet_count;
 
-	long total_byte_count;
+	uint64_t total_byte_count;
 
 	bool activity_toggle;
 
-	list<struct avgstat> avgstack;	
-	int avg_bps; // bytes per second
+	unsigned char ifmask;
+
+	typedef list<struct avgstat, HugeAllocator<struct avgstat> > avglist;
+	avglist avgstack;	
+	uint64_t avg_bps; // bytes per second
 
-	unsigned int total_bytes_this_interval;
+	uint64_t total_bytes_this_interval;
 
 	pthread_t lookup_thread_tid;
+	bool lookup_started;
 
 	void startNameLookup();
 };
@@ -3,6 +3,7 @@
 #include <unistd.h>
 #include "TCPHeader.h"
 #include "headers.h"
+#include "BatchParse.h"
 
 TCPHeader::TCPHeader( const u_char *data, unsigned int data_len )
 {
@@ -19,6 +20,16 @@ TCPHeader::TCPHeader( const u_char *data, unsigned int data_len )
 	header_len=tcp->th_off*4;
 }
 
+TCPHeader::TCPHeader( const struct pktfields &f )
+{
+	src = f.sport;
+	dst = f.dport;
+	seqn = f.seq;
+	ackn = f.ack;
+	flags = f.flags;
+	header_len = (f.tcpoff >> 4) * 4;
+}
+
 TCPHeader::TCPHeader( TCPHeader & orig )
 {
 	seqn = orig.seqn;
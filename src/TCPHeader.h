@@ -4,6 +4,8 @@
 
 #include <netinet/in.h>
 
+struct pktfields;
+
 typedef unsigned short portnum_t;
 typedef unsigned int   seq_t;
 
@@ -20,6 +22,8 @@ class TCPHeader
 {
 public:
 	TCPHeader( const u_char *data, unsigned int data_len );
+	// from fields parse_batch() has already extracted.
+	TCPHeader( const struct pktfields &f );
 	TCPHeader( TCPHeader & orig );
 	seq_t getSeq() const;
 	seq_t getAck() const;
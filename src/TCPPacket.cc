@@ -6,6 +6,7 @@
 #include "TCPPacket.h"
 #include "headers.h"
 #include "util.h"
+#include "BatchParse.h"
 
 TCPPacket::TCPPacket( const u_char *data, unsigned int data_len )
 {
@@ -44,6 +45,29 @@ TCPPacket::TCPPacket( const u_char *data, unsigned int data_len )
 	m_socketpair = new SocketPair(*m_src, m_tcp_header->srcPort(), *m_dst, m_tcp_header->dstPort());
 }
 
+TCPPacket::TCPPacket( const u_char *data, const struct pktfields &f )
+{
+	assert( f.version != 0 );
+
+	total_len = f.total_len;
+	header_len = f.iphl;
+	if( f.version == 4 )
+	{
+		struct sniff_ip *ip = (struct sniff_ip *)data;
+		m_src = new IPv4Address(ip->ip_src);
+		m_dst = new IPv4Address(ip->ip_dst);
+	}
+	else
+	{
+		struct sniff_ip6 *ip6 = (struct sniff_ip6 *)data;
+		m_src = new IPv6Address(ip6->ip_src);
+		m_dst = new IPv6Address(ip6->ip_dst);
+	}
+
+	m_tcp_header = new TCPHeader(f);
+	m_socketpair = new SocketPair(*m_src, f.sport, *m_dst, f.dport);
+}
+
 TCPPacket::TCPPacket( const TCPPacket &orig )
 {
 	m_src = orig.srcAddr().Clone();
@@ -17,6 +17,8 @@ public:
 	 *  verify checksum
 	 */
 	TCPPacket( const u_char *data, unsigned int data_len );
+	// the same, with the header fields parse_batch() has extracted.
+	TCPPacket( const u_char *data, const struct pktfields &f );
 	TCPPacket( const TCPPacket &orig );
 	~TCPPacket();
 	unsigned int totalLen() const;
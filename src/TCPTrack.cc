@@ -8,6 +8,9 @@
 #include "PcapError.h"
 #include "GenericError.h"
 #include "defs.h"
+#include "EventLoop.h"
+#include "HugeMem.h"
+#include "Report.h"
 
 TCPTrack *app=NULL;
 
@@ -20,6 +23,14 @@ TCPTrack::TCPTrack()
 	ferr="";
 	remto=2;
 	refresh_intvl=1000000;
+	busypoll=false;
+	decap=-1;
+	capbuf=0;
+	snaplen=0;
+	immediate=false;
+	nanots=false;
+	startat=NULL;
+	quit=false;
 	pthread_mutex_init( &ferr_lock, NULL );
 }
 
@@ -31,29 +42,131 @@ void TCPTrack::run( int argc, char **argv )
 	detect=cf.detect;
 	names=cf.names;
 	promisc=cf.promisc;
+	busypoll=cf.busypoll;
+	decap=cf.decap;
+	capbuf=cf.capbuf*1024;
+	snaplen=cf.snaplen;
+	immediate=cf.immediate;
+	nanots=cf.nanots;
+	startat=cf.startat;
+	sampler.packets(cf.sample_packets);
+	sampler.flows(cf.sample_flows);
+	// a test file is read as fast as it can be, and its timestamps are
+	// old. There's nothing to shed.
+	if( !cf.governor || cf.test_file != NULL )
+		governor.disable();
+	// a report counts every packet; it isn't short of time to make up
+	// for with estimates. Names would only slow it down.
+	if( cf.report )
+	{
+		sampler.packets(1);
+		names=false;
+	}
+
+	for( std::list<char *>::iterator i=cf.affinity.begin(); i!=cf.affinity.end(); i++ )
+	{
+		if( !affinity.set(*i) )
+		{
+			printf("Bad CPU placement: %s\n", *i);
+			exit(1);
+		}
+	}
+	// everything allocated from here on, in any thread, prefers the
+	// capture thread's NUMA node.
+	affinity.placeMemory();
+
+	// before the connection table exists.
+	huge_setup(cf.hugepages);
 
-	c = new TCContainer();
+	if( cf.report )
+	{
+		unsigned int workers = cf.parse_workers;
+		if( workers == 0 )
+		{
+			long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+			workers = ncpus > 0 ? ncpus : 1;
+			if( workers > REPORT_MAXWORKERS )
+				workers = REPORT_MAXWORKERS;
+		}
+		try
+		{
+			Report r;
+			r.run(cf.test_files,cf.iface,cf.fexp,workers);
+		}
+		catch( const AppError &e )
+		{
+			cout << e.msg() <<endl;
+			exit(1);
+		}
+		return;
+	}
+
+	// a test file is tracked by its own timestamps.
+	if( cf.test_file != NULL )
+		rclock.start( cf.speed > 0 ? cf.speed : 0 );
+
+	c = new TCContainer( !cf.single );
 	pb = new PacketBuffer();
-	s = new Sniffer();
+	// one Sniffer for each interface, or one for the test file. With a
+	// test file, the first -i is only used to look up the netmask for the
+	// filter, as before.
+	if( cf.test_file != NULL )
+		cf.ifaces.clear();
+	if( cf.ifaces.empty() )
+		cf.ifaces.push_back(cf.iface);
+	for( std::list<char *>::iterator i=cf.ifaces.begin(); i!=cf.ifaces.end(); i++ )
+	{
+		ifnames.push_back(*i);
+		s.push_back( new Sniffer(s.size()) );
+	}
 	ui = new TextUI(c);
 
 	try
 	{
-		s->dest(pb); // sniffer, send your packets to PacketBuffer
-		pb->dest(c); // PacketBuffer, send your packets to the TCContainer
-		
-		// init() on these objects performs constructor-like actions,
-		// only they may throw exceptions. Constructors don't.
-		ui->init();
-		s->init(cf.iface,cf.fexp,cf.test_file);
-		pb->init();
-
-		// now let these objects run the application.
-		// just sit here until someone calls shutdown(),
-		// which sets the quitflag condition variable.
-		pthread_mutex_lock(&quitflag_mutex);
-		pthread_cond_wait(&quitflag,&quitflag_mutex);
-		pthread_mutex_unlock(&quitflag_mutex);
+		if( cf.single )
+		{
+			// everything runs right here. The PacketBuffer isn't used.
+			affinity.apply(AFF_CAPTURE);
+			ui->init(false);
+			for( unsigned int i=0; i<s.size(); i++ )
+			{
+				s[i]->direct(c);
+				if( cf.flowcache )
+					s[i]->flowcache(c);
+				s[i]->init(ifnames[i],cf.fexp,cf.test_file,false);
+			}
+
+			EventLoop loop(s,c,ui);
+			loop.init();
+			loop.run();
+		}
+		else
+		{
+			pb->dest(c); // PacketBuffer, send your packets to the TCContainer
+			for( unsigned int i=0; i<s.size(); i++ )
+			{
+				s[i]->dest(pb); // sniffers, send your packets to PacketBuffer
+				if( cf.flowcache ) // except for the ones that only need counting
+					s[i]->flowcache(c);
+			}
+
+			// init() on these objects performs constructor-like actions,
+			// only they may throw exceptions. Constructors don't.
+			// The PacketBuffer has to be ready before the Sniffers
+			// start handing it packets.
+			ui->init();
+			pb->init(cf.parse_workers);
+			for( unsigned int i=0; i<s.size(); i++ )
+				s[i]->init(ifnames[i],cf.fexp,cf.test_file);
+
+			// now let these objects run the application.
+			// just sit here until someone calls shutdown(),
+			// which sets the quitflag condition variable.
+			pthread_mutex_lock(&quitflag_mutex);
+			if( !quit )
+				pthread_cond_wait(&quitflag,&quitflag_mutex);
+			pthread_mutex_unlock(&quitflag_mutex);
+		}
 		
 		// if an exception happened in another thread, it will be passed
 		// to us via the fatal() method, which puts the error in string
@@ -65,11 +178,13 @@ void TCPTrack::run( int argc, char **argv )
 	
 		// shut everything down cleanly.
 		ui->stop();
-		s->dest();
+		detach();
 		pb->dest();
 		c->stop();
 		
-		delete s;
+		for( unsigned int i=0; i<s.size(); i++ )
+			delete s[i];
+		s.clear();
 	}
 	catch( const AppError &e )
 	{
@@ -77,12 +192,14 @@ void TCPTrack::run( int argc, char **argv )
 		// other threads may be running after a delete and may follow a
 		// bad pointer to a just deleted object otherwise.
 		ui->stop();
-		s->dest();
+		detach();
 		pb->dest();
 		c->stop();
 		
 		delete ui;
-		delete s;
+		for( unsigned int i=0; i<s.size(); i++ )
+			delete s[i];
+		s.clear();
 		delete pb;
 		delete c;
 		
@@ -94,10 +211,32 @@ void TCPTrack::run( int argc, char **argv )
 	}
 }
 
+// tell the sniffers to stop sending packets anywhere.
+void TCPTrack::detach()
+{
+	for( unsigned int i=0; i<s.size(); i++ )
+	{
+		s[i]->dest();
+		s[i]->direct();
+		s[i]->flowcache();
+	}
+}
+
+bool TCPTrack::jump( int secs )
+{
+	if( s.size() != 1 || !s[0]->jump(secs) )
+		return false;
+	// the packets from before the jump don't belong with the ones after
+	// it. A few read just before it may still get through.
+	c->clear();
+	return true;
+}
+
 // quit tcptrack
 void TCPTrack::shutdown()
 {
 	pthread_mutex_lock(&quitflag_mutex);
+	quit=true;
 	pthread_cond_signal(&quitflag);
 	pthread_mutex_unlock(&quitflag_mutex);
 }
@@ -122,7 +261,7 @@ void TCPTrack::fatal( string msg )
 
 void printusage(int argc,char **argv)
 {
-	printf("Usage: %s [-dfhnpv] [-r <seconds>] -i <interface> | -T <pcap file> [<filter expression>]\n", argv[0]);
+	printf("Usage: %s [-bCdefGhHmnNpRv] [-r <seconds>] [-B <KiB>] [-L <snaplen>] [-t <time>] [-x <speed>|max] [-s <n>] [-S <n>] [-D <depth>] [-P <n>] [-A <stage>=<cpus>] -i <interface> [-i <interface> ...] | -T <pcap file> | -R -T <pcap file> [-T <pcap file> ...] [<filter expression>]\n", argv[0]);
 }
 
 struct config parseopts(int argc, char **argv)
@@ -134,10 +273,26 @@ struct config parseopts(int argc, char **argv)
 	cf.promisc=true;
 	cf.detect=true;
 	cf.test_file=NULL;
+	cf.report=false;
+	cf.startat=NULL;
+	cf.speed=-1;
+	cf.single=false;
+	cf.busypoll=false;
+	cf.hugepages=false;
+	cf.sample_packets=1;
+	cf.sample_flows=1;
+	cf.governor=true;
+	cf.flowcache=true;
+	cf.decap=-1;
+	cf.parse_workers=0;
+	cf.capbuf=0;
+	cf.snaplen=0;
+	cf.immediate=false;
+	cf.nanots=false;
 	cf.iface = NULL;
 	bool got_iface=false;
 
-	while( (o=getopt(argc,argv,"dhnpvi:r:T:")) > 0 )
+	while( (o=getopt(argc,argv,"bCdeGhHmnNpRvi:r:s:t:x:A:B:D:L:P:S:T:")) > 0 )
 	{
 		if( o=='h' )
 		{
@@ -151,20 +306,118 @@ struct config parseopts(int argc, char **argv)
 		}
 		if( o=='i' )
 		{
-			cf.iface = optarg;
+			if( cf.ifaces.size() == MAX_IFACES )
+			{
+				printf("At most %d interfaces can be given.\n", MAX_IFACES);
+				exit(1);
+			}
+			if( cf.iface == NULL )
+				cf.iface = optarg;
+			cf.ifaces.push_back(optarg);
 			got_iface=true;
 		}
 		if( o=='r' )
 			cf.remto = atoi(optarg);
+		if( o=='t' )
+		{
+			time_t t;
+			if( !parse_when(optarg, 0, &t) )
+			{
+				printf("Bad -t time: %s\n", optarg);
+				exit(1);
+			}
+			cf.startat = optarg;
+		}
+		if( o=='x' )
+		{
+			if( strcmp(optarg, "max") == 0 )
+				cf.speed = 0;
+			else
+			{
+				cf.speed = atof(optarg);
+				if( cf.speed <= 0 || cf.speed > REPLAY_MAXSPEED )
+				{
+					printusage(argc,argv);
+					exit(1);
+				}
+			}
+		}
+		if( o=='s' || o=='S' )
+		{
+			int n = atoi(optarg);
+			if( n < 1 )
+			{
+				printusage(argc,argv);
+				exit(1);
+			}
+			if( o=='s' )
+				cf.sample_packets = n;
+			else
+				cf.sample_flows = n;
+		}
+		if( o=='D' )
+		{
+			cf.decap = atoi(optarg);
+			if( cf.decap < 0 )
+			{
+				printusage(argc,argv);
+				exit(1);
+			}
+		}
+		if( o=='B' || o=='L' )
+		{
+			int n = atoi(optarg);
+			if( n < 1 || (o=='L' && n > 65535) || (o=='B' && n > 4194304) )
+			{
+				printusage(argc,argv);
+				exit(1);
+			}
+			if( o=='B' )
+				cf.capbuf = n;
+			else
+				cf.snaplen = n;
+		}
+		if( o=='P' )
+		{
+			// how many are allowed depends on -R, which may come
+			// later.
+			int n = atoi(optarg);
+			if( n < 0 || n > REPORT_MAXWORKERS )
+			{
+				printusage(argc,argv);
+				exit(1);
+			}
+			cf.parse_workers = n;
+		}
+		if( o=='A' )
+			cf.affinity.push_back(optarg);
+		if( o=='b' )
+			cf.busypoll=true;
+		if( o=='C' )
+			cf.flowcache=false;
 		if( o=='d' )
 			cf.detect=false;
+		if( o=='e' )
+			cf.single=true;
+		if( o=='m' )
+			cf.immediate=true;
 		if( o=='n' )
 			cf.names=false;
+		if( o=='N' )
+			cf.nanots=true;
+		if( o=='G' )
+			cf.governor=false;
+		if( o=='H' )
+			cf.hugepages=true;
 		if( o=='p' )
 			cf.promisc=false;
+		if( o=='R' )
+			cf.report=true;
 		if( o=='T' )
 		{
-			cf.test_file=optarg;
+			if( cf.test_file == NULL )
+				cf.test_file=optarg;
+			cf.test_files.push_back(optarg);
 			got_iface=true; // Don't complain if we don't get an interface. A test file is OK too.
 		}
 	}
@@ -173,6 +426,26 @@ struct config parseopts(int argc, char **argv)
 		printusage(argc,argv);
 		exit(1);
 	}
+	if( cf.report && cf.test_file == NULL )
+	{
+		printf("-R needs at least one -T file.\n");
+		exit(1);
+	}
+	if( !cf.report && cf.test_files.size() > 1 )
+	{
+		printf("Only one -T file can be given without -R.\n");
+		exit(1);
+	}
+	if( (cf.startat != NULL || cf.speed >= 0) && cf.test_file == NULL )
+	{
+		printf("-t and -x need a -T file.\n");
+		exit(1);
+	}
+	if( !cf.report && cf.parse_workers > PB_MAXWORKERS )
+	{
+		printusage(argc,argv);
+		exit(1);
+	}
 	
 	std::string fexp;
 	for( int i=optind; i<argc; i++ ) {
@@ -3,11 +3,17 @@
 
 #include <pthread.h>
 #include <string>
+#include <vector>
+#include <atomic>
 #include "util.h"
 #include "Sniffer.h"
 #include "TextUI.h"
 #include "PacketBuffer.h"
 #include "TCContainer.h"
+#include "Affinity.h"
+#include "Sampler.h"
+#include "Governor.h"
+#include "ReplayClock.h"
 
 using namespace std;
 
@@ -17,26 +23,59 @@ public:
 	TCPTrack();
 	void run( int argc, char **argv ); // run tcptrack
 	void shutdown(); // quit tcptrack
+	bool quitting() { return quit; } // has shutdown() been called?
 
 	// general tcptrack configuration settings
 	// should probably move these later
 	time_t remto; // closed connection removal timeout
-	bool detect; // detect pre-existing connections?
-	bool names;  // Convert addresses/ports to names?
+	// detect and names are changed by the Governor from the maintenance
+	// thread while the capture and parse threads read them.
+	std::atomic<bool> detect; // detect pre-existing connections?
+	std::atomic<bool> names;  // Convert addresses/ports to names?
 	bool promisc; // enable promisc mode?
-	unsigned int refresh_intvl; // How often are we refreshing the UI (usec)
+	bool busypoll; // spin on the capture instead of sleeping?
+	int decap; // tunnels to look inside with -D, or -1 without -D
+	unsigned int capbuf; // -B: kernel capture buffer in bytes, 0 for default
+	int snaplen; // -L: capture length, 0 for the default
+	bool immediate; // -m: hand packets over as soon as they arrive?
+	bool nanots; // -N: ask for nanosecond timestamps?
+	char *startat; // -t: where to start in the test file, or NULL
+	// the refresh interval is changed by the Governor from the
+	// maintenance thread and with +/- from the display thread.
+	std::atomic<unsigned int> refresh_intvl; // How often are we refreshing the UI (usec)
+	Affinity affinity; // which CPUs each thread runs on
+	Sampler sampler; // which packets are looked at
+	Governor governor; // sheds load when packets come in too fast
+	ReplayClock rclock; // the time connections are tracked by
+
+	// for the statistics view.
+	PacketBuffer * packetBuffer() { return pb; }
+	// one for each -i, in the order given, or one for the test file.
+	// The name may be NULL with a test file.
+	unsigned int numIfaces() { return s.size(); }
+	Sniffer * sniffer( unsigned int i ) { return s[i]; }
+	const char * ifaceName( unsigned int i ) { return ifnames[i]; }
+
+	// jump secs seconds forward or back in the test file, starting the
+	// connection table over. Returns false if there's no test file or
+	// it can't be seeked in.
+	bool jump( int secs );
 
 	// other threads call this when they have an unhandled exception.
 	// shuts tcptrack down abruptly and prints the error.
 	void fatal( string msg );
 private:
-	Sniffer *s;
+	std::vector<Sniffer *> s;
+	std::vector<char *> ifnames;
+	void detach();
 	TextUI *ui;
 	PacketBuffer *pb;
 	TCContainer *c;
 	
 	string ferr; // fatal error message sent from another thread
 	pthread_mutex_t ferr_lock;
+
+	volatile bool quit;
 };
 
 void printusage(int argc, char **argv);
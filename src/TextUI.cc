@@ -24,31 +24,34 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <signal.h>
 #include <iostream>
 #include "util.h"
 #include "defs.h"
 #include "TCPTrack.h"
 #include "GenericError.h"
+#include "HugeMem.h"
 
 extern TCPTrack *app;
 
 TextUI::TextUI( TCContainer *c )
 {
 	container = c;
-	iter=NULL;
+	snap=NULL;
 
 	doffset=0;
 
 	state=USTATE_IDLE;
 
 	paused=false;
+	showinfo=false;
 	sort_type=SORT_UN;
 
 	pthread_mutex_init( &state_mutex, NULL );
 }
 
-void TextUI::init()
+void TextUI::init( bool threaded )
 {
 	//
 	// Initialize ncurses.
@@ -78,7 +81,15 @@ void TextUI::init()
 	// Set up and run the displayer thread.
 	//
 
-	run_displayer = true;
+	run_displayer = threaded;
+
+	if( !run_displayer )
+	{
+		// the caller drives us with input() and update().
+		snap=container->acquireSnapshot();
+		state=USTATE_RUNNING;
+		return;
+	}
 
 	pthread_attr_t attr;
 	if( pthread_attr_init( &attr ) != 0 )
@@ -106,7 +117,14 @@ void TextUI::stop()
 
 	// now that state is set to USTATE_STOPPING,
 	// the display draw loop will see this and exit. just wait for it.
-	pthread_join(displayer_tid,NULL);
+	if( run_displayer )
+		pthread_join(displayer_tid,NULL);
+	else
+	{
+		container->releaseSnapshot(snap);
+		snap=NULL;
+		endwin();
+	}
 
 	state=USTATE_DONE;
 
@@ -129,13 +147,14 @@ void TextUI::displayer_run()
 	uint64_t tmp1;
 	uint32_t tmp2;
 
-	iter=container->getSortedIteratorPtr();
+	snap=container->acquireSnapshot();
 
 	while( state==USTATE_RUNNING || state==USTATE_IDLE )
 	{
 		gettimeofday(&now,NULL);
 		tmp1 = now.tv_sec * 1000000 + now.tv_usec;
-		tmp2 = app->refresh_intvl - (tmp1 % app->refresh_intvl);
+		unsigned int intvl = app->refresh_intvl;
+		tmp2 = intvl - (tmp1 % intvl);
 
 		FD_ZERO(&fdset);
 		FD_SET(0,&fdset);
@@ -145,119 +164,168 @@ void TextUI::displayer_run()
 		rv=select(1,&fdset,NULL,NULL,&tv);
 		if( rv )
 		{
-			int c = getch();
-			if( c==KEY_DOWN )
-			{
-				++doffset;
-				// this is checked for sanity later
-			}
-			else if( c==KEY_NPAGE )
-			{
-				doffset += (size_y - 4);
-				// this is checked for sanity later
-			}
-			else if( c==KEY_UP )
-			{
-				if( doffset>0 )
-					--doffset;
-			}
-			else if( c==KEY_PPAGE )
-			{
-				if( (int)doffset > (size_y - 4))
-					doffset -= (size_y - 4);
-				else
-					doffset = 0;
-			}
-			else if( c=='+' )
-			{
-				app->refresh_intvl /= 2;
-				if (app->refresh_intvl < 31250)
-					app->refresh_intvl = 31250;
-			}
-			else if( c=='-' )
-			{
-				app->refresh_intvl *= 2;
-				if (app->refresh_intvl > 32000000)
-					app->refresh_intvl = 32000000;
-			}
-			else if( c=='q' )
-			{
-				app->shutdown();
-			}
-			else if( c=='s' )
-			{
-				switch( sort_type )
-				{
-					case SORT_UN:
-						sort_type=SORT_RATE;
-						break;
-					case SORT_RATE:
-						sort_type=SORT_BYTES;
-						break;
-					case SORT_BYTES:
-						sort_type=SORT_IDLE;
-						break;
-					case SORT_IDLE:
-						sort_type=SORT_ACTIVE;
-						break;
-					case SORT_ACTIVE:
-						sort_type=SORT_UN;
-						break;
-				}
-			}
-			else if( c=='p' )
-			{
-				if( paused==true )
-				{
-					// going from paused to unpaused
-					paused=false;
-					container->purge(true);
-				}
-				else
-				{
-					// going from unpaused to paused
-					paused=true;
-					container->purge(false);
-				}
-			}
+			input( getch() );
+		}
+		else if( paused==false )
+		{
+			// this is a refresh. The maintenance thread wakes up at
+			// the same time we do, give it a moment to publish.
+			container->waitSnapshot( snap->generation, app->refresh_intvl/4 );
 		}
 
-		container->lock();
+		update();
+	}
 
-		// check the offset into the container for sanity.
+	container->releaseSnapshot(snap);
+	snap=NULL;
+	endwin();
+}
+
+// handle a key press.
+// halve or double the refresh interval. The Governor may change it at the
+// same time from the maintenance thread.
+static void scale_refresh( bool faster )
+{
+	unsigned int r = app->refresh_intvl;
+	unsigned int n;
+	do
+	{
+		n = faster ? r/2 : r*2;
+		if( n < 31250 )
+			n = 31250;
+		if( n > 32000000 )
+			n = 32000000;
+	} while( !app->refresh_intvl.compare_exchange_weak(r, n) );
+}
+
+void TextUI::input( int c )
+{
+	if( c==KEY_DOWN )
+	{
+		++doffset;
+		// this is checked for sanity later
+	}
+	else if( c==KEY_NPAGE )
+	{
+		doffset += (size_y - 4);
+		// this is checked for sanity later
+	}
+	else if( c==KEY_UP )
+	{
 		if( doffset>0 )
+			--doffset;
+	}
+	else if( c==KEY_PPAGE )
+	{
+		if( (int)doffset > (size_y - 4))
+			doffset -= (size_y - 4);
+		else
+			doffset = 0;
+	}
+	else if( c=='+' )
+	{
+		scale_refresh(true);
+	}
+	else if( c=='-' )
+	{
+		scale_refresh(false);
+	}
+	else if( c=='q' )
+	{
+		app->shutdown();
+	}
+	else if( c=='s' )
+	{
+		switch( sort_type )
 		{
-			if( container->numConnections()>0 )
-			{
-				if( doffset >= container->numConnections() )
-					doffset = container->numConnections()-1;
-			}
-			else
-			{
-				doffset=0;
-			}
+			case SORT_UN:
+				sort_type=SORT_RATE;
+				break;
+			case SORT_RATE:
+				sort_type=SORT_BYTES;
+				break;
+			case SORT_BYTES:
+				sort_type=SORT_IDLE;
+				break;
+			case SORT_IDLE:
+				sort_type=SORT_ACTIVE;
+				break;
+			case SORT_ACTIVE:
+				sort_type=SORT_UN;
+				break;
 		}
+	}
+	else if( c=='p' )
+	{
+		// while paused we just keep showing the snapshot
+		// we have.
+		paused = !paused;
+	}
+	else if( c=='i' )
+	{
+		showinfo = !showinfo;
+	}
+	else if( c=='[' )
+	{
+		app->jump(-REPLAY_JUMP);
+	}
+	else if( c==']' )
+	{
+		app->jump(REPLAY_JUMP);
+	}
+	else if( c==' ' && app->rclock.enabled() )
+	{
+		app->rclock.pause( !app->rclock.paused() );
+	}
+	else if( c=='n' && app->rclock.enabled() )
+	{
+		// one refresh interval of capture time at a time.
+		app->rclock.pause(true);
+		app->rclock.step( app->refresh_intvl );
+	}
+	else if( (c=='<' || c=='>') && app->rclock.enabled() )
+	{
+		// halve or double the speed. Max is past the fastest.
+		double sp = app->rclock.speed();
+		if( c=='>' )
+			sp = ( sp == 0 || sp*2 > REPLAY_MAXSPEED ) ? 0 : sp*2;
+		else if( sp == 0 )
+			sp = REPLAY_MAXSPEED;
+		else if( sp/2 >= 1.0/REPLAY_MAXSPEED )
+			sp = sp/2;
+		app->rclock.setSpeed(sp);
+	}
+}
 
-		// if we aren't reusing an old iterator (ie, if unpaused),
-		// get a fresh one.		
-		if( iter==NULL )
-			iter=container->getSortedIteratorPtr();
-
-		drawui();
+// show the latest snapshot, unless paused, and redraw the screen.
+void TextUI::update()
+{
+	// unless paused, show the latest snapshot.
+	if( paused==false )
+	{
+		TCCSnapshot *latest = container->acquireSnapshot();
+		container->releaseSnapshot(snap);
+		snap=latest;
+	}
 
-		if( paused==false )
+	// check the offset into the snapshot for sanity.
+	if( doffset>0 )
+	{
+		if( snap->size()>0 )
 		{
-			// gonna get a new one next time if not paused...
-			// so can this one.
-			delete iter;
-			iter=NULL;
+			if( doffset >= snap->size() )
+				doffset = snap->size()-1;
 		}
+		else
+		{
+			doffset=0;
+		}
+	}
 
-		container->unlock();
-
+	// have the container rank the rows the screen shows next time.
+	container->view( sort_type, doffset, size_y );
 
-	}
-	endwin();
+	drawui();
 }
 
 void TextUI::drawui()
@@ -311,6 +379,12 @@ void TextUI::drawui()
 
 	erase();
 
+	if( showinfo )
+	{
+		drawinfo();
+		return;
+	}
+
 	attron(A_REVERSE);
 	move(0,0);
 	printw("%*.*s", size_x, size_x, " ");
@@ -339,112 +413,124 @@ void TextUI::drawui()
 
 	move(1,0);
 
-	SortedIterator * i=iter;
+	SortedIterator i(snap);
 
-	i->rewind();
+	uint64_t Bps_total=snap->totals.bps; // the total speed
+	uint64_t Byt_total=snap->totals.bytes; // the total bytes
 
-	int Bps_total=0; // the total speed
-	int Byt_total=0; // the total bytes
-	while( TCPConnection *ic=i->getNext() )
-	{
-		ic->recalcAvg();
-		Bps_total+=ic->getAllBytesPerSecond();
-		Byt_total+=ic->getTotalByteCount();
-	}
-
-	i->rewind();
+	// with flow sampling only 1 in flowRate() connections are seen, so
+	// scale the totals up to the whole link. Packet sampling is already
+	// scaled up per packet.
+	Bps_total *= app->sampler.flowRate();
+	Byt_total *= app->sampler.flowRate();
+	// mark numbers that are estimates with a ~.
+	bool est_rows = app->sampler.estimatingRows();
+	bool est_totals = app->sampler.estimatingTotals();
 
+	// only the rows up to the bottom of the screen need to be in order.
 	if( sort_type != SORT_UN )
-		i->sort( sort_type );
-
-	unsigned int ic_i=0; // for scrolling
-	while( TCPConnection *ic=i->getNext() )
+		i.sort( sort_type, doffset + size_y );
+
+	time_t now = app->rclock.seconds();
+
+	// start the listing at the scroll offset.
+	i.seek( doffset );
+	unsigned int ic_i=doffset; // for scrolling
+	const std::vector<struct tcckey> &keys = snap->keys();
+	const std::vector<unsigned char> &states = snap->states();
+	const std::vector<time_t> &lastts = snap->lastPktTimes();
+	const std::vector<struct tccnames> &names = snap->names();
+	unsigned int r;
+	while( i.getNext(&r) )
 	{
+		const struct tcckey &k = keys[r];
+		const struct tccnames &n = names[r];
+		unsigned char state = states[r];
 
 		if( row == size_y-2 )
 			break;
 
 		++ic_i;
-		if( ic_i <= doffset )
-			continue;
 
-
-		if( paused==false &&  (ic->getState() == TCP_STATE_CLOSED || ic->getState() == TCP_STATE_RESET)
-				&& time(NULL) - ic->getLastPktTimestamp() > app->remto )
+		if( paused==false &&  (state == TCP_STATE_CLOSED || state == TCP_STATE_RESET)
+				&& now - lastts[r] > app->remto )
 		{
 			continue;
 		}
 
 		move(row,c_client);
-		if (ic->srcHost[0] != 0)
+		if (n.srchost != 0)
 		{
-			int len = strlen(ic->srcHost);
+			const char *host = snap->name(n.srchost);
+			int len = strlen(host);
 			int ind = (len > c_client_l) ? (len - c_client_l) : 0;
 			printw("%*.*s %-5.5s", c_client_l, c_client_l,
-				ic->srcHost+ind, ic->srcService );
+				host+ind, snap->name(n.srcserv) );
 		}
 		else
 			printw("%-*.*s %5d", c_client_l, c_client_l,
-				ic->srcAddr().ptr(), ic->srcPort() );
-		if( ic->srcAddr().GetType() == 6 )
+				TCCSnapshot::addrStr(k.family, k.srcaddr), k.srcport );
+		if( k.family == 6 )
 			row++;
 
 		move(row,c_server);
-		if (ic->dstHost[0] != 0)
+		if (n.dsthost != 0)
 		{
-			int len = strlen(ic->dstHost);
+			const char *host = snap->name(n.dsthost);
+			int len = strlen(host);
 			int ind = (len > c_server_l) ? (len - c_server_l) : 0;
 			printw("%*.*s %-5.5s", c_server_l, c_server_l,
-				ic->dstHost+ind, ic->dstService );
+				host+ind, snap->name(n.dstserv) );
 		}
 		else
 			printw("%-*.*s %5d", c_server_l, c_server_l,
-				ic->dstAddr().ptr(), ic->dstPort());
-		if( ic->srcAddr().GetType() == 6 )
+				TCCSnapshot::addrStr(k.family, k.dstaddr), k.dstport);
+		if( k.family == 6 )
 			row--;
 
 		move(row,c_state);
 		printw("             ");
 		move(row,c_state);
-		if( ic->getState() == TCP_STATE_SYN_SYNACK )
+		if( state == TCP_STATE_SYN_SYNACK )
 			printw("%-*.*s", c_state_l, c_state_l, "SYN_SNT");
-		else if( ic->getState() == TCP_STATE_SYNACK_ACK )
+		else if( state == TCP_STATE_SYNACK_ACK )
 			printw("%-*.*s", c_state_l, c_state_l, "SYNAKAK");
-		else if( ic->getState() == TCP_STATE_UP )
+		else if( state == TCP_STATE_UP )
 			printw("%-*.*s", c_state_l, c_state_l, "ESTABLI");
-		else if( ic->getState() == TCP_STATE_FIN_FINACK )
+		else if( state == TCP_STATE_FIN_FINACK )
 			printw("%-*.*s", c_state_l, c_state_l, "CLOSING");
-		else if( ic->getState() == TCP_STATE_CLOSED )
+		else if( state == TCP_STATE_CLOSED )
 			printw("%-*.*s", c_state_l, c_state_l, "CLOSED");
-		else if( ic->getState() == TCP_STATE_RESET )
+		else if( state == TCP_STATE_RESET )
 			printw("%-*.*s", c_state_l, c_state_l, "RESET");
 
 		move(row,c_idle);
-		if( ic->getIdleSeconds() < 60 )
-			printw("%2ds",(int)ic->getIdleSeconds());
-		else if( ic->getIdleSeconds() < 3600 )
-			printw("%2dm",(int)(ic->getIdleSeconds()/60));
+		time_t idle = now - lastts[r];
+		if( idle < 60 )
+			printw("%2ds",(int)idle);
+		else if( idle < 3600 )
+			printw("%2dm",(int)(idle/60));
 		else
-			printw("%2dh",(int)(ic->getIdleSeconds()/3600));
+			printw("%2dh",(int)(idle/3600));
 
 		move(row,c_act);
-		if( ic->activityToggle() )
+		if( snap->active()[r] )
 			printw("*");
 		else
 			printw(" ");
 
-		move(row,c_speed);
-		unsigned int Bps = ic->getAllBytesPerSecond();
-		print_bps(Bps);
+		move(row,c_speed-1);
+		printw( est_rows ? "~" : " " );
+		print_bps( snap->rates()[r] );
 
 		if (size_x >= c_bytes + c_bytes_l)
 		{
-			move(row,c_bytes);
-			unsigned int Bytes = ic->getTotalByteCount();
-			print_bps(Bytes);
+			move(row,c_bytes-1);
+			printw( est_rows ? "~" : " " );
+			print_bps( snap->bytes()[r] );
 		}
 
-		if( ic->srcAddr().GetType() == 6 )
+		if( k.family == 6 )
 			row++;
 		row++;
 	}
@@ -457,13 +543,83 @@ void TextUI::drawui()
 	move(bottom-2,1);
 	printw("Refresh %5.3f sec", app->refresh_intvl/1000000.0);
 
+	if( app->busypoll )
+	{
+		move(bottom-2,20);
+		printw("Latency %llu/%llu us",
+			(unsigned long long)snap->totals.latency_avg,
+			(unsigned long long)snap->totals.latency_max);
+	}
+
+	if( est_totals )
+	{
+		// after the latency, if that's shown.
+		move(bottom-2, app->busypoll ? 40 : 20);
+		if( app->sampler.packetRate() > 1 && app->sampler.flowRate() > 1 )
+			printw("Sample 1/%u 1/%u", app->sampler.packetRate(),
+				app->sampler.flowRate());
+		else if( app->sampler.packetRate() > 1 )
+			printw("Sample 1/%u", app->sampler.packetRate());
+		else
+			printw("Sample 1/%u", app->sampler.flowRate());
+	}
+
+	// drops, in the next free place, if there have been any.
+	struct capstats cs;
+	capture_stats(&cs);
+	if( cs.live && cs.dropped + cs.ifdropped + cs.ours > 0 )
+	{
+		int col = 20;
+		if( app->busypoll )
+			col += 20;
+		if( est_totals )
+			col += 20;
+		// "Drop " and three counts of up to 5 columns.
+		if( col + 22 < c_speed-6 )
+		{
+			move(bottom-2,col);
+			printw("Drop ");
+			print_count(cs.dropped);
+			printw("/");
+			print_count(cs.ifdropped);
+			printw("/");
+			print_count(cs.ours);
+		}
+	}
+
+	// where a test file's replay is up to, and how fast it's going, in
+	// the same place.
+	if( app->rclock.running() )
+	{
+		int col = 20;
+		if( app->busypoll )
+			col += 20;
+		if( est_totals )
+			col += 20;
+		time_t rt = app->rclock.seconds();
+		struct tm tm;
+		if( col + 23 < c_speed-6 && localtime_r(&rt, &tm) != NULL )
+		{
+			move(bottom-2,col);
+			printw("Replay %02d:%02d:%02d ", tm.tm_hour, tm.tm_min, tm.tm_sec);
+			if( app->rclock.paused() )
+				printw("paused");
+			else if( app->rclock.speed() == 0 )
+				printw("max");
+			else
+				printw("%gx", app->rclock.speed());
+		}
+	}
+
 	move(bottom-2,c_speed-6);
 	printw("TOTAL");
-	move(bottom-2,c_speed);
+	move(bottom-2,c_speed-1);
+	printw( est_totals ? "~" : " " );
 	print_bps(Bps_total);
 	if (size_x >= c_bytes + c_bytes_l)
 	{
-		move(bottom-2,c_bytes);
+		move(bottom-2,c_bytes-1);
+		printw( est_totals ? "~" : " " );
 		print_bps(Byt_total);
 	}
 
@@ -471,11 +627,17 @@ void TextUI::drawui()
 	printw("%*.*s", size_x, size_x, " ");
 
 	move(bottom-1,1);
-	if( container->numConnections() > 0 )
-		printw("Connections %d-%d of %d",doffset+1,ic_i,container->numConnections());
+	if( snap->size() > 0 )
+		printw("Connections %d-%d of %d",doffset+1,ic_i,snap->size());
 	else
 		printw("Connections 0-0 of 0");
 
+	if( app->governor.level() != GOV_NORMAL )
+	{
+		move(bottom-1,35);
+		printw("Overload %d", app->governor.level());
+	}
+
 	move(bottom-1,46);
 	if( paused==true )
 	{
@@ -535,11 +697,182 @@ void TextUI::drawui()
 	refresh();
 }
 
+// the statistics view. It only needs the screen to have been erase()d.
+void TextUI::drawinfo()
+{
+	attron(A_REVERSE);
+	move(0,0);
+	printw("%*.*s", size_x, size_x, " ");
+	move(0,1);
+	printw("Statistics");
+	attroff(A_REVERSE);
+
+	int row=2;
+
+	move(row++,1);
+	printw("Thread placement");
+	for( int st=0; st<AFF_NSTAGES && row<bottom-2; st++ )
+	{
+		move(row++,3);
+		printw("%-10s CPUs %-16s", Affinity::stageName(st),
+			app->affinity.cpus(st).c_str());
+		int n = app->affinity.node(st);
+		if( n >= 0 )
+			printw(" node %d", n);
+	}
+	if( row<bottom-2 )
+	{
+		move(row++,3);
+		if( app->affinity.memNode() >= 0 )
+			printw("memory     node %d preferred", app->affinity.memNode());
+		else
+			printw("memory     default placement");
+	}
+
+	row++;
+	struct hugestats hs = huge_stats();
+	if( row<bottom-2 )
+	{
+		move(row++,1);
+		if( hs.enabled )
+			printw("Huge pages");
+		else
+			printw("Huge pages off (see -H)");
+	}
+	if( hs.enabled && row<bottom-4 )
+	{
+		move(row++,3);
+		printw("hugetlb    %llu MB", (unsigned long long)(hs.hugetlb>>20));
+		move(row++,3);
+		printw("THP        %llu MB", (unsigned long long)(hs.thp>>20));
+		move(row++,3);
+		printw("normal     %llu MB", (unsigned long long)(hs.plain>>20));
+	}
+
+	row++;
+	if( row<bottom-2 )
+	{
+		move(row++,1);
+		if( app->sampler.estimatingTotals() )
+			printw("Sampling");
+		else
+			printw("Sampling off (see -s, -S)");
+	}
+	if( app->sampler.estimatingTotals() && row<bottom-3 )
+	{
+		move(row++,3);
+		printw("packets    1 in %u", app->sampler.packetRate());
+		move(row++,3);
+		printw("flows      1 in %u", app->sampler.flowRate());
+	}
+
+	row++;
+	struct capstats cs;
+	capture_stats(&cs);
+	if( cs.live && row<bottom-6 )
+	{
+		move(row++,1);
+		printw("Capture");
+		move(row++,3);
+		printw("received   %llu", (unsigned long long)cs.received);
+		move(row++,3);
+		printw("dropped    %llu by the kernel", (unsigned long long)cs.dropped);
+		move(row++,3);
+		printw("           %llu by the interface",
+			(unsigned long long)cs.ifdropped);
+		move(row++,3);
+		printw("           %llu by tcptrack", (unsigned long long)cs.ours);
+		row++;
+	}
+
+	// traffic of the tracked connections by interface. A connection
+	// whose two directions take different paths counts on both.
+	if( cs.live && row<bottom-3 )
+	{
+		unsigned int conns[MAX_IFACES];
+		unsigned int multi = 0;
+		memset( conns, 0, sizeof(conns) );
+		const std::vector<unsigned char> &ifc = snap->ifaces();
+		for( unsigned int r=0; r<ifc.size(); r++ )
+		{
+			for( unsigned int i=0; i<app->numIfaces(); i++ )
+				if( ifc[r] & (1 << i) )
+					conns[i]++;
+			if( ifc[r] & (ifc[r]-1) )
+				multi++;
+		}
+
+		move(row++,1);
+		printw("Interfaces");
+		for( unsigned int i=0; i<app->numIfaces() && row<bottom-2; i++ )
+		{
+			move(row++,3);
+			printw("%-10.10s", app->ifaceName(i));
+			print_bps(snap->totals.ifbps[i]);
+			printw("/s ");
+			print_bps(snap->totals.ifbytes[i]);
+			printw("  %u connections", conns[i]);
+		}
+		if( app->numIfaces() > 1 && row<bottom-2 )
+		{
+			move(row++,3);
+			printw("%u connections seen on more than one", multi);
+		}
+		row++;
+	}
+
+	std::vector<struct pbstage> st;
+	app->packetBuffer()->stages(st);
+	if( ! st.empty() && row<bottom-2 )
+	{
+		move(row++,1);
+		printw("Pipeline");
+	}
+	for( unsigned int i=0; i<st.size() && row<bottom-2; i++ )
+	{
+		move(row++,3);
+		if( st[i].worker >= 0 )
+			printw("%s %-4d queue %-8u busy %3u%%", st[i].name,
+				st[i].worker, st[i].depth, st[i].util);
+		else
+			printw("%-10s queue %-8u busy %3u%%", st[i].name,
+				st[i].depth, st[i].util);
+		if( st[i].dropped > 0 )
+		{
+			printw("  dropped ");
+			print_count(st[i].dropped);
+		}
+	}
+	if( ! st.empty() )
+		row++;
+
+	if( row<bottom-2 )
+	{
+		move(row++,1);
+		printw("Overload level %d (%s)", app->governor.level(),
+			Governor::levelName(app->governor.level()));
+	}
+
+	attron(A_REVERSE);
+	move(bottom-1,0);
+	printw("%*.*s", size_x, size_x, " ");
+	move(bottom-1,1);
+	printw("Press ");
+	attron(A_UNDERLINE);
+	printw("i");
+	attroff(A_UNDERLINE);
+	printw(" to return to the connection list");
+	attroff(A_REVERSE);
+
+	move(size_y-1, size_x-1);
+	refresh();
+}
+
 // display the speed with the right format
-void TextUI::print_bps(unsigned int Bps)
+void TextUI::print_bps(uint64_t Bps)
 {
 	if( Bps < 1000 )
-		printw(" %4d  B",Bps);
+		printw(" %4d  B",(int)Bps);
 	else if(Bps < 1024*10 )
 		printw(" %4.2f kB",Bps/1024.0);
 	else if(Bps < 1024*100 )
@@ -552,8 +885,42 @@ void TextUI::print_bps(unsigned int Bps)
 		printw("%4.1f  MB",Bps/(1024*1024.0));
 	else if(Bps < 1024*1024*1000 )
 		printw("%4.0f  MB",Bps/(1024*1024.0));
-	else
+	else if(Bps < 1024ULL*1024*1024*10 )
 		printw("%4.2f  GB",Bps/(1024*1024*1024.0));
+	else if(Bps < 1024ULL*1024*1024*100 )
+		printw("%4.1f  GB",Bps/(1024*1024*1024.0));
+	else if(Bps < 1024ULL*1024*1024*1000 )
+		printw("%4.0f  GB",Bps/(1024*1024*1024.0));
+	else
+		printw("%4.2f  TB",Bps/(1024*1024*1024*1024.0));
+}
+
+// the capture counters of all the interfaces added up.
+void TextUI::capture_stats(struct capstats *cs)
+{
+	memset( cs, 0, sizeof(*cs) );
+	for( unsigned int i=0; i<app->numIfaces(); i++ )
+	{
+		struct capstats one;
+		app->sniffer(i)->stats(&one);
+		cs->live = one.live;
+		cs->received += one.received;
+		cs->dropped += one.dropped;
+		cs->ifdropped += one.ifdropped;
+		cs->ours += one.ours;
+	}
+}
+
+void TextUI::print_count(uint64_t n)
+{
+	if( n < 10000 )
+		printw("%llu",(unsigned long long)n);
+	else if( n < 1000*1000 )
+		printw("%lluk",(unsigned long long)(n/1000));
+	else if( n < 1000ULL*1000*1000 )
+		printw("%lluM",(unsigned long long)(n/(1000*1000)));
+	else
+		printw("%lluG",(unsigned long long)(n/(1000ULL*1000*1000)));
 }
 
 // reset the terminal. used only for unclean exits.
@@ -567,6 +934,7 @@ void TextUI::reset()
 void *displayer_thread_func( void *arg )
 {
 	TextUI *ui = (TextUI *) arg;
+	app->affinity.apply(AFF_UI);
 	try
 	{
 		ui->displayer_run();
@@ -28,6 +28,7 @@
 #include <curses.h>
 #include <pthread.h>
 #include "TCContainer.h"
+#include "TCCSnapshot.h"
 #include "SortedIterator.h"
 
 #define USTATE_IDLE 1
@@ -41,9 +42,17 @@ public:
 	TextUI( TCContainer * );
 	~TextUI();
 
-	void init(); // like a constructor, but exceptions can be thrown.
+	// like a constructor, but exceptions can be thrown.
+	// if threaded is false, no displayer thread is started and the
+	// caller has to call input() and update() itself.
+	void init( bool threaded=true );
 	void stop();
 
+	// handle a key read from the terminal.
+	void input( int c );
+	// pick up the latest snapshot and redraw the screen.
+	void update();
+
 	// try to make the terminal modes sane again during an unclean
 	// exit.
 	static void reset();
@@ -52,15 +61,19 @@ public:
 	void displayer_run();
 private:
 	void drawui(); // draw the screen.
-	void print_bps(unsigned int); // display the speed with the right format
+	void drawinfo(); // draw the statistics view instead.
+	void print_bps(uint64_t); // display the speed with the right format
+	void print_count(uint64_t); // a packet count, in 5 columns at most
+	void capture_stats(struct capstats *); // of all the Sniffers
 
-	bool run_displayer;
+	bool run_displayer; // false if the caller drives the display
 
 	// display packets in here.
 	TCContainer *container;
 
-	// an iterator over connections in the container.
-	SortedIterator * iter;
+	// the snapshot of the container we are showing. We hold on to it
+	// while paused.
+	TCCSnapshot *snap;
 
 	WINDOW *w;
 	// number of the last line on the screen.
@@ -77,6 +90,9 @@ private:
 
 	bool paused;
 
+	// show the statistics view instead of the connections?
+	bool showinfo;
+
 	int sort_type;
 
 	// TODO: moving this pthread_t var up to the top of the private block
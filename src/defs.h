@@ -7,6 +7,23 @@
 // This is used for the third argument to pcap_open_live
 #define PCAP_DELAY 0.001
 
+// with -b, ask the kernel to busy poll the device queue for this many
+// microseconds when the capture socket is read (SO_BUSY_POLL).
+#define BUSY_POLL_USEC 50
+
+// the overload governor sheds load one level when, during a refresh
+// interval, more packets than GOV_BACKLOG_HIGH were waiting to be
+// accounted or a packet waited longer than GOV_LAG_HIGH usec. It steps back
+// after GOV_CALM intervals under the LOW marks.
+#define GOV_BACKLOG_HIGH 100000
+#define GOV_BACKLOG_LOW  10000
+#define GOV_LAG_HIGH 500000
+#define GOV_LAG_LOW  50000
+#define GOV_CALM 5
+// packet sampling rate and refresh interval multiplier the governor uses.
+#define GOV_SAMPLE 10
+#define GOV_SLOWDOWN 4
+
 // the amount of time we will wait for a connection to finish opening after
 // the initial syn has been sent before we discard it
 #define SYN_SYNACK_WAIT 30
@@ -17,9 +34,47 @@
 // pcap snaplen. Should be as long as biggest link level header len + 
 // vlan header len + IP header len + tcp header len.
 #define SNAPLEN 100
+// with -D, room for the tunnel headers in front as well. Only SNAPLEN
+// bytes from the innermost IP header on are kept.
+#define DECAP_SNAPLEN 256
+
+// the most packets PacketBuffer validates and parses at once.
+// Must be a multiple of 32.
+#define PB_BATCH 64
+
+// the most parse workers PacketBuffer can be asked to start with -P.
+#define PB_MAXWORKERS 16
+
+// the most packets that may wait at any one stage of the PacketBuffer.
+// Past that, new packets are dropped instead of queueing up without end.
+#define PB_MAXQUEUE (1024*1024)
+
+// with -b, how many times a PacketBuffer thread checks its queue before
+// it goes to sleep on it after all.
+#define PB_SPINS 65536
+
+// the most interfaces that can be captured on at once, with repeated -i.
+#define MAX_IFACES 8
+
+// with -R, the most worker threads -P can ask for, and how many rows each
+// table of the report has.
+#define REPORT_MAXWORKERS 256
+#define REPORT_TOP 20
+
+// the fastest a test file can be replayed at, other than as fast as it
+// can be read (-x max).
+#define REPLAY_MAXSPEED 1024
+
+// how far the [ and ] keys jump in a test file's capture time, in seconds.
+#define REPLAY_JUMP 60
+
+// in single-threaded mode, packets read from a test file between checks
+// of the timer and the keyboard.
+#define OFFLINE_BATCH 256
 
 // stack sizes for the different threads
 #define SS_PB  2048 // PacketBuffer
 #define SS_S   4096 // Sniffer 2048 -> segfault on freebsd
 #define SS_TCC 4096 // TCContainer
 #define SS_TUI 5120 // TextUI. 4096 -> segfault on solaris
+#define SS_C   4096 // Collector
@@ -0,0 +1,200 @@
+/*
+ *  The code in this file is part of tcptrack. For more information see
+ *    http://www.rhythm.cx/~steve/devel/tcptrack
+ *
+ *     Copyright (C) Steve Benson - 2003
+ *
+ *  tcptrack is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your
+ *  option) any later version.
+ *
+ *  tcptrack is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GNU Make; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#include "../config.h" // for PACKAGE and VERSION
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h> // for getopt
+#include "Generator.h"
+
+/* tcptrack-gen writes made up traffic to a pcap file, for benchmarking
+ * tcptrack with -T when real captures can't be used. See Generator.
+ */
+
+static void printusage(int argc,char **argv)
+{
+	printf("Usage: %s [-hv] [-s <seed>] [-b <epoch>] [-d <seconds>] [-c <conns>] [-C <per second>] [-k <packets per second>] [-z <size>[:<weight>][,...]] [-M <percent>] [-I <percent>] [-6 <percent>] [-F <SYNs per second>] [-L <snaplen>] -w <file>|-\n", argv[0]);
+}
+
+// parses a -z size mix like "0:40,576:10,1448:50".
+static bool parse_sizes( char *s, std::vector<struct gensize> &sizes )
+{
+	sizes.clear();
+	for( char *tok=strtok(s, ","); tok != NULL; tok=strtok(NULL, ",") )
+	{
+		struct gensize z;
+		char *end;
+		long size = strtol(tok, &end, 10);
+		long weight = 1;
+		if( *end == ':' )
+			weight = strtol(end+1, &end, 10);
+		if( end == tok || *end != 0 || size < 0 || size > GEN_MAXSIZE
+				|| weight < 1 || weight > 1000000 )
+			return false;
+		z.size = size;
+		z.weight = weight;
+		sizes.push_back(z);
+	}
+	return ! sizes.empty();
+}
+
+// a percentage option, or exit.
+static unsigned int pct( int argc, char **argv, const char *arg )
+{
+	int n = atoi(arg);
+	if( n < 0 || n > 100 )
+	{
+		printusage(argc,argv);
+		exit(1);
+	}
+	return n;
+}
+
+// writes a pcap file header.
+static void write_header( FILE *f, unsigned int snaplen, int linktype )
+{
+	uint32_t hdr[6] = { 0xa1b2c3d4, 0x00040002, 0, 0, snaplen,
+		(uint32_t)linktype };
+	fwrite( hdr, sizeof(hdr), 1, f );
+}
+
+// writes a pcap record.
+static void write_packet( FILE *f, const struct pcap_pkthdr *h,
+		const u_char *data )
+{
+	uint32_t rec[4] = { (uint32_t)h->ts.tv_sec, (uint32_t)h->ts.tv_usec,
+		h->caplen, h->len };
+	fwrite( rec, sizeof(rec), 1, f );
+	fwrite( data, h->caplen, 1, f );
+}
+
+int main(int argc, char **argv)
+{
+	int o;
+	struct genconf cf;
+	const char *out = NULL;
+
+	cf.seed = 1;
+	cf.start = 1700000000;
+	cf.duration = 10;
+	cf.conns = 1000;
+	cf.churn = 100;
+	cf.pps = 20000;
+	char defsizes[] = "0:40,100:20,576:10,1448:30";
+	parse_sizes( defsizes, cf.sizes );
+	cf.midstream = 10;
+	cf.incomplete = 5;
+	cf.ipv6 = 0;
+	cf.flood = 0;
+	cf.snaplen = 65535;
+
+	while( (o=getopt(argc,argv,"hvb:c:d:k:s:w:z:C:F:I:L:M:6:")) > 0 )
+	{
+		if( o=='h' )
+		{
+			printusage(argc,argv);
+			exit(0);
+		}
+		if( o=='v' )
+		{
+			printf("%s-gen v%s\n",PACKAGE,VERSION);
+			exit(0);
+		}
+		if( o=='s' )
+			cf.seed = strtoull(optarg, NULL, 0);
+		if( o=='b' )
+			cf.start = atol(optarg);
+		if( o=='w' )
+			out = optarg;
+		if( o=='M' )
+			cf.midstream = pct(argc,argv,optarg);
+		if( o=='I' )
+			cf.incomplete = pct(argc,argv,optarg);
+		if( o=='6' )
+			cf.ipv6 = pct(argc,argv,optarg);
+		if( o=='z' && ! parse_sizes(optarg, cf.sizes) )
+		{
+			printf("Bad -z size mix: %s\n", optarg);
+			exit(1);
+		}
+		if( o=='C' )
+		{
+			cf.churn = atof(optarg);
+			if( cf.churn < 0 || cf.churn > 1000000 )
+			{
+				printusage(argc,argv);
+				exit(1);
+			}
+		}
+		if( o=='c' || o=='d' || o=='k' || o=='F' || o=='L' )
+		{
+			long n = atol(optarg);
+			if( n < 0 || n > 100000000 || (o=='L' && (n < 1 || n > 65535)) )
+			{
+				printusage(argc,argv);
+				exit(1);
+			}
+			if( o=='c' )
+				cf.conns = n;
+			else if( o=='d' )
+				cf.duration = n;
+			else if( o=='k' )
+				cf.pps = n;
+			else if( o=='F' )
+				cf.flood = n;
+			else
+				cf.snaplen = n;
+		}
+	}
+
+	if( out == NULL || optind != argc )
+	{
+		printusage(argc,argv);
+		exit(1);
+	}
+
+	FILE *f = stdout;
+	if( strcmp(out, "-") != 0 && (f=fopen(out, "wb")) == NULL )
+	{
+		perror(out);
+		exit(1);
+	}
+
+	Generator g(cf);
+	write_header( f, cf.snaplen, g.linktype() );
+
+	struct pcap_pkthdr h;
+	const u_char *data;
+	while( g.next(&h, &data) )
+		write_packet( f, &h, data );
+
+	if( fclose(f) != 0 )
+	{
+		perror(out);
+		exit(1);
+	}
+
+	fprintf(stderr, "%llu packets, %llu bytes, %llu connections\n",
+		(unsigned long long)g.packets(), (unsigned long long)g.bytes(),
+		(unsigned long long)g.connections());
+	return 0;
+}
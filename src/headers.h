@@ -43,6 +43,7 @@
 #define TCP_HEADER_LEN 20
 #define ENET_HEADER_LEN 14
 #define SLL_HEADER_LEN 16
+#define NULL_HEADER_LEN 4 // BSD loopback: the address family
 #define VLAN_HEADER_LEN 4
 
 #ifndef ETHER_ADDR_LEN
@@ -21,8 +21,13 @@
  */
 #include "util.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
 #include <cstring>
 #include "headers.h"
+#include "defs.h"
+#include "HugeMem.h"
+#include "LinkLayer.h"
 #ifdef HAVE_HASH_MAP
 # include <hash_map>
 #elif HAVE_EXT_HASH_MAP
@@ -40,143 +45,151 @@
  */
 struct nlp *getnlp( const u_char *p, int dlt, const pcap_pkthdr *pcap )
 {
-	struct nlp *n = (struct nlp *) malloc( sizeof(struct nlp) );
+	int off = nl_offset( p, dlt, pcap->caplen );
+	if( off < 0 )
+		return NULL;
 
-	n->p=NULL;
-	n->ts = pcap->ts;
-	n->len = 0;
-	int vlan_frame = 0;
+	return copynlp( p+off, pcap->caplen-off, pcap->ts );
+}
 
-	if( dlt==DLT_EN10MB )
-	{
-		if( pcap->caplen < ENET_HEADER_LEN+IP_HEADER_LEN )
-		{
-			free(n);
-			return NULL;
-		}
-
-		const struct sniff_ethernet *ethernet;
-		ethernet = (struct sniff_ethernet*)(p);
-		vlan_frame = ( ntohs(ethernet->ether_type) == ETHERTYPE_VLAN );
-		uint16_t ether_type;
-
-		if( vlan_frame )
-			ether_type = ntohs(*((uint16_t *)(p + ENET_HEADER_LEN + VLAN_HEADER_LEN - 2)));
-		else
-			ether_type = ntohs(ethernet->ether_type);
-
-		if( ether_type == ETHERTYPE_IP || ether_type == ETHERTYPE_IPV6 )
-		{
-			n->len = pcap->caplen-ENET_HEADER_LEN-(vlan_frame ? VLAN_HEADER_LEN : 0);
-			n->p = (u_char *) malloc( sizeof(u_char) * n->len );
-			memcpy( (void *)n->p, (void *)(p+ENET_HEADER_LEN+(vlan_frame ? VLAN_HEADER_LEN : 0)), n->len);
-		}
-		else
-		{
-			free(n);
-			return NULL;
-		}
-	}
-	else if( dlt==DLT_LINUX_SLL )
-	{
-		if( pcap->caplen < SLL_HEADER_LEN+IP_HEADER_LEN )
-		{
-			free(n);
-			return NULL;
-		}
-
-		n->len = pcap->caplen-SLL_HEADER_LEN;
-		n->p = (u_char *) malloc( sizeof(u_char) * n->len );
-		memcpy( (void *)n->p, (void *)(p+SLL_HEADER_LEN), n->len);
-	}
-	else if( dlt==DLT_RAW || dlt==DLT_NULL )
+// copy len bytes of network layer packet at p into a new struct nlp.
+struct nlp *copynlp( const u_char *p, unsigned int len, const struct timeval &ts )
+{
+	struct nlp *n = nlp_alloc( len );
+	if( n == NULL )
+		return NULL;
+	n->ts = ts;
+	memcpy( (void *)n->p, (void *)p, len );
+
+	return n;
+}
+
+// where the network layer header starts in a packet of the given link
+// type, or -1 if it isn't IP or there's not enough of it.
+int nl_offset( const u_char *p, int dlt, unsigned int caplen )
+{
+	switch( dlt )
 	{
-		if( pcap->caplen < IP_HEADER_LEN )
-		{
-			free(n);
-			return NULL;
-		}
-
-		n->len = pcap->caplen;
-		n->p = (u_char *) malloc( sizeof(u_char) * n->len );
-		memcpy( (void *)n->p, (void *)(p), n->len);
+		case DLT_EN10MB: return link_offset<DLT_EN10MB>( p, caplen );
+		case DLT_LINUX_SLL: return link_offset<DLT_LINUX_SLL>( p, caplen );
+		case DLT_RAW: return link_offset<DLT_RAW>( p, caplen );
+		case DLT_NULL: return link_offset<DLT_NULL>( p, caplen );
 	}
+	return -1;
+}
+
+// packets that fit in the snap length come out of a pool, so with -H
+// they sit in huge pages. Longer ones, from test files, are malloc()ed.
+static SlabPool nlppool( sizeof(struct nlp) + SNAPLEN );
 
+struct nlp *nlp_alloc( unsigned int len )
+{
+	struct nlp *n;
+	if( len <= SNAPLEN )
+		n = (struct nlp *) nlppool.alloc();
+	else
+		n = (struct nlp *) malloc( sizeof(struct nlp) + len );
+	if( n == NULL )
+		return NULL;
+
+	n->p = (u_char *)(n+1);
+	n->len = len;
+	n->weight = 1;
+	n->iface = 0;
 	return n;
 }
 
+void nlp_free( struct nlp *n )
+{
+	if( n->len <= SNAPLEN )
+		nlppool.free(n);
+	else
+		free(n);
+}
+
 /* This function performs all kinds of tests on captured packet data to 
- * ensure that it is a valid packet of the given network layer protocol.
- * data is the raw packet, data_len is its length
- * proto is one of the NLP_* values. currently only NLP_IPV4 works.
+ * ensure that it is a valid TCP packet over IPv4 or IPv6.
  * This needs to be run early upon packet reception. Other code assumes it 
  * has. If they detect a bad packet, assertions will fail.
  */
-// TODO: this should be split up into smaller functions
 bool checknlp( struct nlp *n )
 {
-	struct sniff_ip *ip = (struct sniff_ip *)n->p;
+	return check_nl( n->p, n->len );
+}
 
-	//TODO: Improve this / split in two functions (IPv6/IPv4)
+// hash one end of a connection. The two ends are combined with xor so
+// both directions of a connection hash the same.
+static uint32_t end_hash( const u_char *addr, unsigned int len, uint16_t port )
+{
+	uint32_t h = 2166136261U;
+	for( unsigned int i=0; i<len; i++ )
+		h = (h ^ addr[i]) * 16777619U;
+	h = (h ^ port) * 16777619U;
+	return h ^ (h >> 13);
+}
+
+uint32_t flow_hash( const u_char *p )
+{
+	const struct sniff_ip *ip = (const struct sniff_ip *) p;
 	if( ip->ip_v == 6 )
 	{
-		if( n->len < IP6_HEADER_LEN + TCP_HEADER_LEN )
-		{
-			return false;
-		}
-
-		struct sniff_ip6 *ip6 = (struct sniff_ip6 *)n->p;
-
-		if( ip6->ip_next != IPPROTO_TCP ) 
-		{
-			return false;
-		}
+		const struct sniff_ip6 *ip6 = (const struct sniff_ip6 *) p;
+		const struct sniff_tcp *tcp =
+			(const struct sniff_tcp *) (p + IP6_HEADER_LEN);
+		return end_hash( (const u_char *) &ip6->ip_src,
+				sizeof(struct in6_addr), tcp->th_sport )
+			^ end_hash( (const u_char *) &ip6->ip_dst,
+				sizeof(struct in6_addr), tcp->th_dport );
+	}
 
-		struct sniff_tcp *tcp = (struct sniff_tcp *) (n->p + IP6_HEADER_LEN);
+	const struct sniff_tcp *tcp =
+		(const struct sniff_tcp *) (p + ip->ip_hl*4);
+	return end_hash( (const u_char *) &ip->ip_src,
+			sizeof(struct in_addr), tcp->th_sport )
+		^ end_hash( (const u_char *) &ip->ip_dst,
+			sizeof(struct in_addr), tcp->th_dport );
+}
 
-		if( tcp->th_off < 5 ) // tcp header is at least 20 bytes long.
-		{
-			return false;
-		}
+uint64_t rate_per_sec( uint64_t bytes, uint64_t usec )
+{
+	if( usec == 0 )
+		return 0;
 
-		if( tcp->th_sport == 0 )
-			return false;
+	// bytes*1000000 could overflow, so scale the quotient and the
+	// remainder separately. The remainder is less than usec, which is
+	// never anywhere near 2^44.
+	return (bytes / usec) * 1000000 + (bytes % usec) * 1000000 / usec;
+}
 
-		if( tcp->th_dport == 0 )
+bool parse_when( const char *s, time_t start, time_t *t )
+{
+	if( s[0] == '+' || s[0] == '@' )
+	{
+		char *end;
+		long long n = strtoll( s+1, &end, 10 );
+		if( end == s+1 || *end != 0 || n < 0 )
 			return false;
-
+		*t = ( s[0] == '+' ) ? start + n : n;
 		return true;
 	}
 
-	unsigned int ip_header_len = ip->ip_hl * 4;
-
-	// not enough data to do anything with this...
-	// we're only interested in IPv4 TCP Packets
-	if( n->len < ip_header_len + TCP_HEADER_LEN )
-		return false;
-	
-	if( ip->ip_v != 4 )
-		return false;
-
-	if( ntohs(ip->ip_len) < ip_header_len + TCP_HEADER_LEN ) 
-		return false;
-
-	if( ip->ip_hl < 5 ) 
-		return false;
-
-	if( ip->ip_p != IPPROTO_TCP ) 
-		return false;
-
-	struct sniff_tcp *tcp = (struct sniff_tcp *) (n->p + ip_header_len);
-
-	if( tcp->th_off < 5 ) // tcp header is at least 20 bytes long.
-		return false;
-		
-	if( tcp->th_sport == 0 )
+	// the date defaults to that of start.
+	struct tm tm;
+	localtime_r( &start, &tm );
+	const char *r = strptime( s, "%Y-%m-%d %H:%M", &tm );
+	if( r == NULL )
+	{
+		localtime_r( &start, &tm );
+		r = strptime( s, "%H:%M", &tm );
+	}
+	if( r == NULL )
 		return false;
-
-	if( tcp->th_dport == 0 )
+	tm.tm_sec = 0;
+	if( *r == ':' )
+		r = strptime( r, ":%S", &tm );
+	if( r == NULL || *r != 0 )
 		return false;
-
-	return true;
+	tm.tm_isdst = -1;
+	*t = mktime( &tm );
+	return *t != -1;
 }
@@ -38,34 +38,94 @@
 #include <ext/hash_map>
 #endif
 #include "headers.h"
+#include "defs.h"
 #include "IPAddress.h"
 #include "TCPHeader.h"
 
 struct config
 {
-	char *iface; // interface to listen on
+	char *iface; // interface to listen on, the first if there are several
+	std::list<char *> ifaces; // all of them, in order
 	char *fexp;  // filter expression
 	unsigned int remto; // timeout to remove closed connections (secs)
 	bool detect; // detect pre-existing connections?
 	bool names;  // Convert addresses/ports to names?
 	bool promisc; // enable promisc mode?	        
 	char *test_file; // File to use as input data for a test
+	std::list<char *> test_files; // all of them, with -R
+	bool report; // -R: print a report of the test files and exit
+	char *startat; // -t: where in the test file to start
+	double speed; // -x: test file replay speed, 0 for max, -1 if not given
+	bool single; // run everything in one thread from an event loop?
+	bool busypoll; // spin on the capture instead of sleeping?
+	std::list<char *> affinity; // -A stage=cpus options
+	bool hugepages; // put the connection table and packets in huge pages?
+	unsigned int sample_packets; // -s: look at 1 in this many packets
+	unsigned int sample_flows;   // -S: track 1 in this many connections
+	bool governor; // shed load when overloaded?
+	bool flowcache; // count established flows in the capture thread?
+	int decap; // -D: tunnels to look inside, -1 to not decapsulate
+	unsigned int parse_workers; // -P: parse threads, 0 for none
+	unsigned int capbuf; // -B: kernel capture buffer in KiB, 0 for default
+	int snaplen; // -L: capture length, 0 for the default
+	bool immediate; // -m: immediate mode
+	bool nanots; // -N: nanosecond timestamps
+};
+
+// interface wide totals, kept up to date by TCContainer as packets are
+// accounted and connections come and go.
+struct tcctotals
+{
+	uint64_t bytes;   // bytes of all tracked connections
+	uint64_t packets; // packets of all tracked connections
+	uint64_t bps;     // sum of the connections' average rates
+	unsigned int connections;
+	unsigned int states[8]; // connections in each TCP_STATE_*
+	// time from capture to accounting over the last interval, in usec.
+	// only measured when busy polling.
+	uint64_t latency_avg;
+	uint64_t latency_max;
+	// bytes of tracked connections by the interface they were seen on,
+	// and the rate over the last interval.
+	uint64_t ifbytes[MAX_IFACES];
+	uint64_t ifbps[MAX_IFACES];
 };
 
 struct avgstat
 {
 	uint64_t ts;    // timestamp in microseconds
-	unsigned int size;
+	uint64_t size;  // bytes seen during the interval
+	uint64_t len;   // how long the interval was, in microseconds
 };
 
 struct nlp
 {
-	u_char *p; // dont forget to free this!
+	u_char *p; // the packet data, right after this struct
 	unsigned int len;
 	struct timeval ts;
+	unsigned int weight; // how many packets this one stands for
+	unsigned int iface;  // which -i interface it came from
 };
 
 struct nlp *getnlp( const u_char *p, int dlt, const pcap_pkthdr *pcap );
+int nl_offset( const u_char *p, int dlt, unsigned int caplen );
+struct nlp *copynlp( const u_char *p, unsigned int len, const struct timeval &ts );
+// allocate a struct nlp with room for len bytes of packet data at p.
+// free it with nlp_free(), not free().
+struct nlp *nlp_alloc( unsigned int len );
+void nlp_free( struct nlp *n );
 bool checknlp( struct nlp *n );
+// hash of a checked TCP packet's endpoints, starting at the network layer
+// header. Both directions of a connection hash the same.
+uint32_t flow_hash( const u_char *p );
+
+// bytes per second over usec microseconds, without overflowing on large
+// byte counts. 0 if usec is 0.
+uint64_t rate_per_sec( uint64_t bytes, uint64_t usec );
+
+// the time given to -t: "+secs" after start, "@secs" since the epoch, or
+// "[YYYY-MM-DD ]HH:MM[:SS]" in local time, on the day of start if there's
+// no date. Returns false if s isn't any of those.
+bool parse_when( const char *s, time_t start, time_t *t );
 
 #endif
@@ -0,0 +1,66 @@
+#!/bin/sh
+#
+# Replays a second of generated traffic at over 100 Gbps through tcptrack -R
+# and checks that no byte count or rate has wrapped: a single connection
+# carries more than 2^32 bytes at more than 2^32 bytes per second.
+#
+# run by make check, which sets top_builddir.
+
+top_builddir=${top_builddir:-..}
+gen=$top_builddir/src/tcptrack-gen
+tcptrack=$top_builddir/src/tcptrack
+
+cap=counters-$$.pcap
+trap 'rm -f $cap $cap.tcpidx counters-$$.gen counters-$$.out' 0
+
+# three connections at a million 9000 byte packets a second each. the
+# generator reports what it wrote on stderr.
+$gen -s 1 -d 1 -c 3 -C 0 -k 3000000 -z 9000 -L 54 -w $cap \
+	2> counters-$$.gen || exit 1
+$tcptrack -R -T $cap > counters-$$.out || exit 1
+
+cat counters-$$.out
+
+# the generator counts ethernet frames, tcptrack IP packets: 14 bytes less
+# each.
+awk '
+	FILENAME ~ /gen$/ && / packets, / {
+		gpackets = $1; gbytes = $3
+	}
+	FILENAME ~ /out$/ && / packets, .* bytes in / {
+		packets = $1; bytes = $3
+	}
+	FILENAME ~ /out$/ && /^Top .* connections/ { rows = 1; next }
+	FILENAME ~ /out$/ && rows && /^Client/ { next }
+	FILENAME ~ /out$/ && rows && NF == 0 { rows = 0 }
+	FILENAME ~ /out$/ && rows {
+		# client port server port state packets bytes duration rate
+		n++
+		rowbytes += $7
+		if( $7 > big ) { big = $7; bigdur = $8; bigrate = $9 }
+	}
+	END {
+		fail = 0
+		if( packets != gpackets ) {
+			print "packets: " packets ", generated " gpackets; fail = 1
+		}
+		if( bytes != gbytes - 14 * gpackets ) {
+			print "bytes: " bytes ", generated " gbytes - 14 * gpackets
+			fail = 1
+		}
+		if( rowbytes != bytes ) {
+			print "connections add up to " rowbytes ", total " bytes
+			fail = 1
+		}
+		if( big <= 4294967296 ) {
+			print "biggest connection only " big " bytes"; fail = 1
+		}
+		# the duration is rounded to the msec.
+		want = big / bigdur
+		if( bigrate <= 4294967296 || bigrate < want * 0.998 \
+				|| bigrate > want * 1.002 ) {
+			print "rate " bigrate ", about " want " expected"; fail = 1
+		}
+		exit fail
+	}
+' counters-$$.gen counters-$$.out